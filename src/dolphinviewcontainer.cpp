@@ -35,6 +35,7 @@
 #endif
 #include <KFileItemActions>
 #include <KFilePlacesModel>
+#include <KFormat>
 #include <KIO/PreviewJob>
 #include <KLocalizedString>
 #include <KMessageWidget>
@@ -149,6 +150,8 @@ DolphinViewContainer::DolphinViewContainer(const QUrl& url, QWidget* parent) :
             this, &DolphinViewContainer::updateDirectorySortingProgress);
     connect(m_view, &DolphinView::selectionChanged,
             this, &DolphinViewContainer::delayedStatusBarUpdate);
+    connect(m_view, &DolphinView::previewMemoryUsageChanged,
+            this, &DolphinViewContainer::updatePreviewMemoryUsage);
     connect(m_view, &DolphinView::errorMessage,
             this, &DolphinViewContainer::showErrorMessage);
     connect(m_view, &DolphinView::urlIsFileError,
@@ -510,6 +513,18 @@ void DolphinViewContainer::updateStatusBar()
     const QString text = m_view->statusBarText();
     m_statusBar->setDefaultText(text);
     m_statusBar->resetToDefaultText();
+
+    updatePreviewMemoryUsage();
+}
+
+void DolphinViewContainer::updatePreviewMemoryUsage()
+{
+    if (m_view->previewsShown()) {
+        m_statusBar->setToolTip(i18nc("@info:tooltip", "Memory used by previews: %1",
+                                      KFormat().formatByteSize(m_view->previewMemoryUsage())));
+    } else {
+        m_statusBar->setToolTip(QString());
+    }
 }
 
 void DolphinViewContainer::updateDirectoryLoadingProgress(int percent)
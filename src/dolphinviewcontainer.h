@@ -192,6 +192,12 @@ private slots:
      */
     void updateStatusBar();
 
+    /**
+     * Shows the memory that is used by the previews in the
+     * tooltip of the status bar.
+     */
+    void updatePreviewMemoryUsage();
+
     void updateDirectoryLoadingProgress(int percent);
 
     void updateDirectorySortingProgress(int percent);
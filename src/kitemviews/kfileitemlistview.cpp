@@ -104,6 +104,23 @@ bool KFileItemListView::enlargeSmallPreviews() const
     return m_modelRolesUpdater ? m_modelRolesUpdater->enlargeSmallPreviews() : false;
 }
 
+void KFileItemListView::setPreviewMemoryBudget(qint64 bytes)
+{
+    if (m_modelRolesUpdater) {
+        m_modelRolesUpdater->setPreviewMemoryBudget(bytes);
+    }
+}
+
+qint64 KFileItemListView::previewMemoryBudget() const
+{
+    return m_modelRolesUpdater ? m_modelRolesUpdater->previewMemoryBudget() : 0;
+}
+
+qint64 KFileItemListView::previewMemoryUsage() const
+{
+    return m_modelRolesUpdater ? m_modelRolesUpdater->previewMemoryUsage() : 0;
+}
+
 void KFileItemListView::setEnabledPlugins(const QStringList& list)
 {
     if (m_modelRolesUpdater) {
@@ -233,6 +250,8 @@ void KFileItemListView::onModelChanged(KItemModelBase* current, KItemModelBase*
     if (current) {
         m_modelRolesUpdater = new KFileItemModelRolesUpdater(static_cast<KFileItemModel*>(current), this);
         m_modelRolesUpdater->setIconSize(availableIconSize());
+        connect(m_modelRolesUpdater, &KFileItemModelRolesUpdater::previewMemoryUsageChanged,
+                this,                &KFileItemListView::previewMemoryUsageChanged);
 
         applyRolesToModel();
     }
@@ -54,6 +54,19 @@ public:
     void setEnlargeSmallPreviews(bool enlarge);
     bool enlargeSmallPreviews() const;
 
+    /**
+     * Sets the maximum memory in bytes that may be used by previews.
+     * @see KFileItemModelRolesUpdater::setPreviewMemoryBudget()
+     */
+    void setPreviewMemoryBudget(qint64 bytes);
+    qint64 previewMemoryBudget() const;
+
+    /**
+     * @return Memory in bytes that is used by the previews.
+     * @see KFileItemModelRolesUpdater::previewMemoryUsage()
+     */
+    qint64 previewMemoryUsage() const;
+
     /**
      * Sets the list of enabled thumbnail plugins that are used for previews.
      * Per default all plugins enabled in the KConfigGroup "PreviewSettings"
@@ -73,6 +86,12 @@ public:
 
     QPixmap createDragPixmap(const KItemSet& indexes) const override;
 
+signals:
+    /**
+     * Is emitted if the result of previewMemoryUsage() has been changed.
+     */
+    void previewMemoryUsageChanged();
+
 protected:
     KItemListWidgetCreatorBase* defaultWidgetCreator() const override;
     void initializeItemListWidget(KItemListWidget* item) override;
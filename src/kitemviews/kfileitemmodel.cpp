@@ -23,6 +23,7 @@
 
 #include "dolphin_generalsettings.h"
 #include "dolphindebug.h"
+#include "private/kfileitemmimetyperesolver.h"
 #include "private/kfileitemmodeldirlister.h"
 #include "private/kfileitemmodelsortalgorithm.h"
 
@@ -31,29 +32,100 @@
 
 #include <QElapsedTimer>
 #include <QMimeData>
+#include <QMimeDatabase>
+#include <QThread>
 #include <QTimer>
 #include <QWidget>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <limits>
 
 // #define KFILEITEMMODEL_DEBUG
 
+namespace {
+    // Sort value for items where the value of a numeric sort role is not
+    // known (yet), e.g. the number of sub-items of a directory or an
+    // invalid deletion time. Such items are sorted before all other items.
+    const qint64 UnknownSortValue = std::numeric_limits<qint64>::min();
+
+    // Minimum number of items that are checked by one thread in KFileItemModel::matchFilter()
+    const int MinItemsPerFilterChunk = 5000;
+
+    // Maximum number of inserted or removed items that are added to or removed from
+    // the keyboard search index one by one. Larger batches are merged in one pass.
+    const int MaxSingleKeyboardSearchUpdates = 32;
+
+    // Maximum number of searched texts whose matching items are kept ordered by
+    // their index, see KFileItemModel::m_keyboardSearchBlocks.
+    const int MaxKeyboardSearchBlocks = 16;
+
+    QString itemPath(const KFileItem& item)
+    {
+        QString path;
+        if (item.url().scheme() == QLatin1String("trash")) {
+            path = item.entry().stringValue(KIO::UDSEntry::UDS_EXTRA);
+        } else {
+            // For performance reasons cache the home-path in a static QString
+            // (see QDir::homePath() for more details)
+            static QString homePath;
+            if (homePath.isEmpty()) {
+                homePath = QDir::homePath();
+            }
+
+            path = item.localPath();
+            if (path.startsWith(homePath)) {
+                path.replace(0, homePath.length(), QLatin1Char('~'));
+            }
+        }
+
+        const int index = path.lastIndexOf(item.text());
+        return path.mid(0, index - 1);
+    }
+
+    QDateTime itemDeletionTime(const KFileItem& item)
+    {
+        QDateTime deletionTime;
+        if (item.url().scheme() == QLatin1String("trash")) {
+            deletionTime = QDateTime::fromString(item.entry().stringValue(KIO::UDSEntry::UDS_EXTRA + 1), Qt::ISODate);
+        }
+        return deletionTime;
+    }
+
+    bool groupIndexLessThan(const QPair<int, QVariant>& group, int index)
+    {
+        return group.first < index;
+    }
+}
+
 KFileItemModel::KFileItemModel(QObject* parent) :
     KItemModelBase("text", parent),
     m_dirLister(nullptr),
+    m_mimeTypeResolver(nullptr),
+    m_completedPending(false),
     m_sortDirsFirst(true),
     m_sortRole(NameRole),
     m_sortingProgressPercent(-1),
     m_roles(),
+    m_itemDataPool(),
     m_itemData(),
     m_items(),
+    m_fileCount(0),
+    m_folderCount(0),
+    m_totalFileSize(0),
     m_filter(),
     m_filteredItems(),
     m_requestRole(),
     m_maximumUpdateIntervalTimer(nullptr),
-    m_resortAllItemsTimer(nullptr),
+    m_resortPendingItemsTimer(nullptr),
     m_pendingItemsToInsert(),
+    m_pendingItemsToResort(),
     m_groups(),
     m_expandedDirs(),
-    m_urlsToExpand()
+    m_urlsToExpand(),
+    m_keyboardSearchIndex(),
+    m_keyboardSearchIndexDirty(true),
+    m_keyboardSearchBlocks()
 {
     m_collator.setNumericMode(true);
 
@@ -77,6 +149,9 @@ KFileItemModel::KFileItemModel(QObject* parent) :
     connect(m_dirLister, &KFileItemModelDirLister::infoMessage, this, &KFileItemModel::infoMessage);
     connect(m_dirLister, &KFileItemModelDirLister::errorMessage, this, &KFileItemModel::errorMessage);
     connect(m_dirLister, &KFileItemModelDirLister::percent, this, &KFileItemModel::directoryLoadingProgress);
+
+    m_mimeTypeResolver = new KFileItemMimeTypeResolver(this);
+    connect(m_mimeTypeResolver, &KFileItemMimeTypeResolver::itemsResolved, this, &KFileItemModel::slotMimeTypesResolved);
     connect(m_dirLister, static_cast<void(KFileItemModelDirLister::*)(const QUrl&, const QUrl&)>(&KFileItemModelDirLister::redirection), this, &KFileItemModel::directoryRedirection);
     connect(m_dirLister, &KFileItemModelDirLister::urlIsFileError, this, &KFileItemModel::urlIsFileError);
 
@@ -97,23 +172,29 @@ KFileItemModel::KFileItemModel(QObject* parent) :
     m_maximumUpdateIntervalTimer->setSingleShot(true);
     connect(m_maximumUpdateIntervalTimer, &QTimer::timeout, this, &KFileItemModel::dispatchPendingItemsToInsert);
 
-    // When changing the value of an item which represents the sort-role a resorting must be
-    // triggered. Especially in combination with KFileItemModelRolesUpdater this might be done
-    // for a lot of items within a quite small timeslot. To prevent expensive resortings the
-    // resorting is postponed until the timer has been exceeded.
-    m_resortAllItemsTimer = new QTimer(this);
-    m_resortAllItemsTimer->setInterval(500);
-    m_resortAllItemsTimer->setSingleShot(true);
-    connect(m_resortAllItemsTimer, &QTimer::timeout, this, &KFileItemModel::resortAllItems);
+    // When changing the value of an item which represents the sort-role the item must be
+    // moved to its new position. Especially in combination with KFileItemModelRolesUpdater
+    // this might be done for a lot of items within a quite small timeslot. To move all
+    // changed items at once, the resorting is postponed until the timer has been exceeded.
+    m_resortPendingItemsTimer = new QTimer(this);
+    m_resortPendingItemsTimer->setInterval(500);
+    m_resortPendingItemsTimer->setSingleShot(true);
+    connect(m_resortPendingItemsTimer, &QTimer::timeout, this, &KFileItemModel::resortPendingItems);
 
     connect(GeneralSettings::self(), &GeneralSettings::sortingChoiceChanged, this, &KFileItemModel::slotSortingChoiceChanged);
 }
 
 KFileItemModel::~KFileItemModel()
 {
-    qDeleteAll(m_itemData);
-    qDeleteAll(m_filteredItems);
-    qDeleteAll(m_pendingItemsToInsert);
+    foreach (ItemData* itemData, m_itemData) {
+        m_itemDataPool.destroy(itemData);
+    }
+    foreach (ItemData* itemData, m_filteredItems) {
+        m_itemDataPool.destroy(itemData);
+    }
+    foreach (ItemData* itemData, m_pendingItemsToInsert) {
+        m_itemDataPool.destroy(itemData);
+    }
 }
 
 void KFileItemModel::loadDirectory(const QUrl &url)
@@ -167,35 +248,46 @@ bool KFileItemModel::setData(int index, const QHash<QByteArray, QVariant>& value
         return false;
     }
 
-    QHash<QByteArray, QVariant> currentValues = data(index);
+    const QSet<QByteArray> changedRoles = storeValues(index, values);
+    if (changedRoles.isEmpty()) {
+        return false;
+    }
+
+    emitItemsChangedAndTriggerResorting(KItemRangeList() << KItemRange(index, 1), changedRoles);
+
+    return true;
+}
+
+bool KFileItemModel::setData(const QMap<int, QHash<QByteArray, QVariant> >& values)
+{
+    const int itemCount = count();
 
-    // Determine which roles have been changed
+    QVector<int> changedIndexes;
+    changedIndexes.reserve(values.count());
     QSet<QByteArray> changedRoles;
-    QHashIterator<QByteArray, QVariant> it(values);
+
+    // QMap iterates the indexes in ascending order, which allows to create
+    // the item ranges without sorting the changed indexes.
+    QMapIterator<int, QHash<QByteArray, QVariant> > it(values);
     while (it.hasNext()) {
         it.next();
-        const QByteArray role = sharedValue(it.key());
-        const QVariant value = it.value();
+        const int index = it.key();
+        if (index < 0 || index >= itemCount) {
+            continue;
+        }
 
-        if (currentValues[role] != value) {
-            currentValues[role] = value;
-            changedRoles.insert(role);
+        const QSet<QByteArray> changedItemRoles = storeValues(index, it.value());
+        if (!changedItemRoles.isEmpty()) {
+            changedIndexes.append(index);
+            changedRoles.unite(changedItemRoles);
         }
     }
 
-    if (changedRoles.isEmpty()) {
+    if (changedIndexes.isEmpty()) {
         return false;
     }
 
-    m_itemData[index]->values = currentValues;
-    if (changedRoles.contains("text")) {
-        QUrl url = m_itemData[index]->item.url();
-        url = url.adjusted(QUrl::RemoveFilename);
-        url.setPath(url.path() + currentValues["text"].toString());
-        m_itemData[index]->item.setUrl(url);
-    }
-
-    emitItemsChangedAndTriggerResorting(KItemRangeList() << KItemRange(index, 1), changedRoles);
+    emitItemsChangedAndTriggerResorting(KItemRangeList::fromSortedContainer(changedIndexes), changedRoles);
 
     return true;
 }
@@ -277,18 +369,32 @@ QMimeData* KFileItemModel::createMimeData(const KItemSet& indexes) const
 
 int KFileItemModel::indexForKeyboardSearch(const QString& text, int startFromIndex) const
 {
-    startFromIndex = qMax(0, startFromIndex);
-    for (int i = startFromIndex; i < count(); ++i) {
-        if (fileItem(i).text().startsWith(text, Qt::CaseInsensitive)) {
-            return i;
-        }
+    const int itemCount = count();
+    if (itemCount == 0) {
+        return -1;
     }
-    for (int i = 0; i < startFromIndex; ++i) {
-        if (fileItem(i).text().startsWith(text, Qt::CaseInsensitive)) {
-            return i;
-        }
+
+    if (startFromIndex < 0 || startFromIndex >= itemCount) {
+        startFromIndex = 0;
+    }
+
+    const QString foldedText = KFileItemModelFilter::foldedText(text);
+    if (foldedText.isEmpty()) {
+        return startFromIndex;
     }
-    return -1;
+
+    // Return the first matching item at or after 'startFromIndex'. If there is
+    // none, wrap around and return the first matching item.
+    const QVector<const ItemData*> block = keyboardSearchBlock(foldedText);
+    if (block.isEmpty()) {
+        return -1;
+    }
+
+    const auto it = std::lower_bound(block.constBegin(), block.constEnd(), startFromIndex,
+                                     [](const ItemData* itemData, int index) {
+        return itemData->index < index;
+    });
+    return (it != block.constEnd()) ? (*it)->index : block.first()->index;
 }
 
 bool KFileItemModel::supportsDropping(int index) const
@@ -321,33 +427,7 @@ QList<QPair<int, QVariant> > KFileItemModel::groups() const
         QElapsedTimer timer;
         timer.start();
 #endif
-        switch (typeForRole(sortRole())) {
-        case NameRole:        m_groups = nameRoleGroups(); break;
-        case SizeRole:        m_groups = sizeRoleGroups(); break;
-        case ModificationTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::ModificationTime);
-            });
-            break;
-        case CreationTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::CreationTime);
-            });
-            break;
-        case AccessTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::AccessTime);
-            });
-            break;
-        case DeletionTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->values.value("deletiontime").toDateTime();
-            });
-            break;
-        case PermissionsRole: m_groups = permissionRoleGroups(); break;
-        case RatingRole:      m_groups = ratingRoleGroups(); break;
-        default:              m_groups = genericStringRoleGroups(sortRole()); break;
-        }
+        m_groups = roleGroups(0, count());
 
 #ifdef KFILEITEMMODEL_DEBUG
         qCDebug(DolphinDebug) << "[TIME] Calculating groups for" << count() << "items:" << timer.elapsed();
@@ -375,6 +455,26 @@ KFileItem KFileItemModel::fileItem(const QUrl &url) const
     return KFileItem();
 }
 
+void KFileItemModel::setFileItem(int index, const KFileItem& item)
+{
+    if (index < 0 || index >= count()) {
+        return;
+    }
+
+    ItemData* data = m_itemData.at(index);
+    Q_ASSERT(data->item.url() == item.url());
+    updateItemStatistics(data->item, -1);
+    data->item = item;
+    updateItemStatistics(data->item, 1);
+}
+
+void KFileItemModel::itemStatistics(int& fileCount, int& folderCount, KIO::filesize_t& totalFileSize) const
+{
+    fileCount = m_fileCount;
+    folderCount = m_folderCount;
+    totalFileSize = m_totalFileSize;
+}
+
 int KFileItemModel::index(const KFileItem& item) const
 {
     return index(item.url());
@@ -384,33 +484,13 @@ int KFileItemModel::index(const QUrl& url) const
 {
     const QUrl urlToFind = url.adjusted(QUrl::StripTrailingSlash);
 
-    const int itemCount = m_itemData.count();
-    int itemsInHash = m_items.count();
-
-    int index = m_items.value(urlToFind, -1);
-    while (index < 0 && itemsInHash < itemCount) {
-        // Not all URLs are stored yet in m_items. We grow m_items until either
-        // urlToFind is found, or all URLs have been stored in m_items.
-        // Note that we do not add the URLs to m_items one by one, but in
-        // larger blocks. After each block, we check if urlToFind is in
-        // m_items. We could in principle compare urlToFind with each URL while
-        // we are going through m_itemData, but comparing two QUrls will,
-        // unlike calling qHash for the URLs, trigger a parsing of the URLs
-        // which costs both CPU cycles and memory.
-        const int blockSize = 1000;
-        const int currentBlockEnd = qMin(itemsInHash + blockSize, itemCount);
-        for (int i = itemsInHash; i < currentBlockEnd; ++i) {
-            const QUrl nextUrl = m_itemData.at(i)->item.url();
-            m_items.insert(nextUrl, i);
-        }
-
-        itemsInHash = currentBlockEnd;
-        index = m_items.value(urlToFind, -1);
-    }
+    const ItemData* data = m_items.value(urlToFind);
+    const int index = data ? data->index : -1;
+    Q_ASSERT(index < 0 || m_itemData.at(index) == data);
 
     if (index < 0) {
-        // The item could not be found, even though all items from m_itemData
-        // should be in m_items now. We print some diagnostic information which
+        // The item could not be found. If m_items and m_itemData are not
+        // consistent, we print some diagnostic information which
         // might help to find the cause of the problem, but only once. This
         // prevents that obtaining and printing the debugging information
         // wastes CPU cycles and floods the shell or .xsession-errors.
@@ -662,8 +742,18 @@ void KFileItemModel::setNameFilter(const QString& nameFilter)
 {
     if (m_filter.pattern() != nameFilter) {
         dispatchPendingItemsToInsert();
+        const QString previousNameFilter = m_filter.pattern();
         m_filter.setPattern(nameFilter);
-        applyFilters();
+
+        // While typing into the filter bar, the pattern usually gets only extended
+        // or shortened. Then only the shown or only the filtered items need to be checked.
+        if (KFileItemModelFilter::isNarrowing(previousNameFilter, nameFilter)) {
+            applyFilters(ShownItems);
+        } else if (KFileItemModelFilter::isNarrowing(nameFilter, previousNameFilter)) {
+            applyFilters(FilteredItems);
+        } else {
+            applyFilters(AllItems);
+        }
     }
 }
 
@@ -676,8 +766,27 @@ void KFileItemModel::setMimeTypeFilters(const QStringList& filters)
 {
     if (m_filter.mimeTypes() != filters) {
         dispatchPendingItemsToInsert();
+        const QStringList previousFilters = m_filter.mimeTypes();
         m_filter.setMimeTypes(filters);
-        applyFilters();
+
+        // An empty list of mimetypes lets all items pass
+        bool isNarrowing = !filters.isEmpty();
+        foreach (const QString& mimeType, filters) {
+            if (!previousFilters.isEmpty() && !previousFilters.contains(mimeType)) {
+                isNarrowing = false;
+                break;
+            }
+        }
+
+        bool isWidening = !previousFilters.isEmpty();
+        foreach (const QString& mimeType, previousFilters) {
+            if (!filters.isEmpty() && !filters.contains(mimeType)) {
+                isWidening = false;
+                break;
+            }
+        }
+
+        applyFilters(isNarrowing ? ShownItems : (isWidening ? FilteredItems : AllItems));
     }
 }
 
@@ -687,45 +796,90 @@ QStringList KFileItemModel::mimeTypeFilters() const
 }
 
 
-void KFileItemModel::applyFilters()
+void KFileItemModel::applyFilters(FilterScope scope)
 {
-    // Check which shown items from m_itemData must get
-    // hidden and hence moved to m_filteredItems.
-    QVector<int> newFilteredIndexes;
+    if (scope != FilteredItems) {
+        // Check which shown items from m_itemData must get
+        // hidden and hence moved to m_filteredItems.
+        QVector<int> newFilteredIndexes;
 
-    const int itemCount = m_itemData.count();
-    for (int index = 0; index < itemCount; ++index) {
-        ItemData* itemData = m_itemData.at(index);
+        const QVector<bool> matches = matchFilter(m_itemData);
+        const int itemCount = m_itemData.count();
+        for (int index = 0; index < itemCount; ++index) {
+            ItemData* itemData = m_itemData.at(index);
 
-        // Only filter non-expanded items as child items may never
-        // exist without a parent item
-        if (!itemData->values.value("isExpanded").toBool()) {
-            const KFileItem item = itemData->item;
-            if (!m_filter.matches(item)) {
+            // Only filter non-expanded items as child items may never
+            // exist without a parent item
+            if (!matches.at(index) && !itemData->values.value("isExpanded").toBool()) {
                 newFilteredIndexes.append(index);
-                m_filteredItems.insert(item, itemData);
+                m_filteredItems.insert(itemData->item, itemData);
             }
         }
-    }
 
-    const KItemRangeList removedRanges = KItemRangeList::fromSortedContainer(newFilteredIndexes);
-    removeItems(removedRanges, KeepItemData);
+        const KItemRangeList removedRanges = KItemRangeList::fromSortedContainer(newFilteredIndexes);
+        removeItems(removedRanges, KeepItemData);
+    }
 
-    // Check which hidden items from m_filteredItems should
-    // get visible again and hence removed from m_filteredItems.
-    QList<ItemData*> newVisibleItems;
+    if (scope != ShownItems) {
+        // Check which hidden items from m_filteredItems should
+        // get visible again and hence removed from m_filteredItems.
+        QList<ItemData*> newVisibleItems;
 
-    QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.begin();
-    while (it != m_filteredItems.end()) {
-        if (m_filter.matches(it.key())) {
-            newVisibleItems.append(it.value());
-            it = m_filteredItems.erase(it);
-        } else {
-            ++it;
+        const QList<ItemData*> filteredItems = m_filteredItems.values();
+        const QVector<bool> matches = matchFilter(filteredItems);
+        const int itemCount = filteredItems.count();
+        for (int index = 0; index < itemCount; ++index) {
+            if (matches.at(index)) {
+                ItemData* itemData = filteredItems.at(index);
+                newVisibleItems.append(itemData);
+                m_filteredItems.remove(itemData->item);
+            }
         }
+
+        insertItems(newVisibleItems);
     }
+}
+
+QVector<bool> KFileItemModel::matchFilter(const QList<ItemData*>& items) const
+{
+    const int itemCount = items.count();
+
+    // KFileItem::mimetype() might determine the mimetype on demand, which
+    // is not thread-safe. Hence only name filters are checked in parallel.
+    const int maxChunkCount = m_filter.mimeTypes().isEmpty() ? QThread::idealThreadCount() : 1;
+    const int chunkCount = qBound(1, itemCount / MinItemsPerFilterChunk, maxChunkCount);
+    if (chunkCount == 1) {
+        return matchFilterRange(&m_filter, &items, 0, itemCount - 1);
+    }
+
+    // The items and the filter are not changed while waiting for
+    // the results, so it is safe to read them from the worker threads.
+    const int chunkSize = (itemCount + chunkCount - 1) / chunkCount;
 
-    insertItems(newVisibleItems);
+    QList<QFuture<QVector<bool> > > futures;
+    for (int first = 0; first < itemCount; first += chunkSize) {
+        const int last = qMin(first + chunkSize, itemCount) - 1;
+        futures.append(QtConcurrent::run(matchFilterRange, &m_filter, &items, first, last));
+    }
+
+    QVector<bool> matches;
+    matches.reserve(itemCount);
+    foreach (const QFuture<QVector<bool> >& future, futures) {
+        matches += future.result();
+    }
+    return matches;
+}
+
+QVector<bool> KFileItemModel::matchFilterRange(const KFileItemModelFilter* filter, const QList<ItemData*>* items,
+                                               int first, int last)
+{
+    QVector<bool> matches;
+    matches.reserve(last - first + 1);
+    for (int index = first; index <= last; ++index) {
+        const ItemData* itemData = items->at(index);
+        matches.append(filter->matches(itemData->item, itemData->foldedText));
+    }
+    return matches;
 }
 
 void KFileItemModel::removeFilteredChildren(const KItemRangeList& itemRanges)
@@ -746,7 +900,7 @@ void KFileItemModel::removeFilteredChildren(const KItemRangeList& itemRanges)
     QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.begin();
     while (it != m_filteredItems.end()) {
         if (parents.contains(it.value()->parent)) {
-            delete it.value();
+            deleteItemData(it.value());
             it = m_filteredItems.erase(it);
         } else {
             ++it;
@@ -791,7 +945,6 @@ void KFileItemModel::onGroupedSortingChanged(bool current)
 
 void KFileItemModel::onSortRoleChanged(const QByteArray& current, const QByteArray& previous, bool resortItems)
 {
-    Q_UNUSED(previous);
     m_sortRole = typeForRole(current);
 
     if (!m_requestRole[m_sortRole]) {
@@ -800,6 +953,14 @@ void KFileItemModel::onSortRoleChanged(const QByteArray& current, const QByteArr
         setRoles(newRoles);
     }
 
+    // Only the values of the current sort role are stored in m_columns.
+    const RoleType previousSortRole = typeForRole(previous);
+    if (previousSortRole != m_sortRole) {
+        m_columns.removeColumn(previousSortRole);
+        m_groups.clear();
+    }
+    updateSortValues();
+
     if (resortItems) {
         resortAllItems();
     }
@@ -838,7 +999,8 @@ void KFileItemModel::loadSortingSettings()
 
 void KFileItemModel::resortAllItems()
 {
-    m_resortAllItemsTimer->stop();
+    m_resortPendingItemsTimer->stop();
+    m_pendingItemsToResort.clear();
 
     const int itemCount = count();
     if (itemCount <= 0) {
@@ -852,62 +1014,38 @@ void KFileItemModel::resortAllItems()
     qCDebug(DolphinDebug) << "Resorting" << itemCount << "items";
 #endif
 
-    // Remember the order of the current URLs so
-    // that it can be determined which indexes have
-    // been moved because of the resorting.
-    QList<QUrl> oldUrls;
-    oldUrls.reserve(itemCount);
-    foreach (const ItemData* itemData, m_itemData) {
-        oldUrls.append(itemData->item.url());
-    }
-
-    m_items.clear();
-    m_items.reserve(itemCount);
-
-    // Resort the items
+    // Resort the items. ItemData::index still contains the old index of
+    // each item, which allows to determine which items have been moved.
     sort(m_itemData.begin(), m_itemData.end());
-    for (int i = 0; i < itemCount; ++i) {
-        m_items.insert(m_itemData.at(i)->item.url(), i);
-    }
 
     // Determine the first index that has been moved.
     int firstMovedIndex = 0;
     while (firstMovedIndex < itemCount
-           && firstMovedIndex == m_items.value(oldUrls.at(firstMovedIndex))) {
+           && firstMovedIndex == m_itemData.at(firstMovedIndex)->index) {
         ++firstMovedIndex;
     }
 
     const bool itemsHaveMoved = firstMovedIndex < itemCount;
     if (itemsHaveMoved) {
-        m_groups.clear();
-
         int lastMovedIndex = itemCount - 1;
         while (lastMovedIndex > firstMovedIndex
-               && lastMovedIndex == m_items.value(oldUrls.at(lastMovedIndex))) {
+               && lastMovedIndex == m_itemData.at(lastMovedIndex)->index) {
             --lastMovedIndex;
         }
 
         Q_ASSERT(firstMovedIndex <= lastMovedIndex);
 
-        // Create a list movedToIndexes, which has the property that
-        // movedToIndexes[i] is the new index of the item with the old index
-        // firstMovedIndex + i.
         const int movedItemsCount = lastMovedIndex - firstMovedIndex + 1;
-        QList<int> movedToIndexes;
-        movedToIndexes.reserve(movedItemsCount);
-        for (int i = firstMovedIndex; i <= lastMovedIndex; ++i) {
-            const int newIndex = m_items.value(oldUrls.at(i));
-            movedToIndexes.append(newIndex);
-        }
+        const QList<int> movedToIndexes = updateMovedIndexes(firstMovedIndex, lastMovedIndex);
+
+        // Only the groups of the moved items can have changed.
+        updateGroups(KItemRangeList() << KItemRange(firstMovedIndex, movedItemsCount));
 
         emit itemsMoved(KItemRange(firstMovedIndex, movedItemsCount), movedToIndexes);
-    } else if (groupedSorting()) {
-        // The groups might have changed even if the order of the items has not.
-        const QList<QPair<int, QVariant> > oldGroups = m_groups;
-        m_groups.clear();
-        if (groups() != oldGroups) {
-            emit groupsChanged();
-        }
+    } else if (groupedSorting() && m_groups.isEmpty()) {
+        // The groups have been reset because the sort role has been changed.
+        // They might have changed even if the order of the items has not.
+        emit groupsChanged();
     }
 
 #ifdef KFILEITEMMODEL_DEBUG
@@ -915,8 +1053,364 @@ void KFileItemModel::resortAllItems()
 #endif
 }
 
+void KFileItemModel::resortPendingItems()
+{
+    m_resortPendingItemsTimer->stop();
+
+    if (m_pendingItemsToResort.isEmpty()) {
+        return;
+    }
+
+    const int itemCount = count();
+    const int pendingCount = m_pendingItemsToResort.count();
+    if (pendingCount > itemCount / 2) {
+        // Sorting all items is cheaper than binary searching the positions
+        // for most of them.
+        resortAllItems();
+        return;
+    }
+
+#ifdef KFILEITEMMODEL_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+    qCDebug(DolphinDebug) << "===========================================================";
+    qCDebug(DolphinDebug) << "Resorting" << pendingCount << "of" << itemCount << "items";
+#endif
+
+    QList<ItemData*> pendingItems;
+    pendingItems.reserve(pendingCount);
+    QVector<int> pendingIndexes;
+    pendingIndexes.reserve(pendingCount);
+    foreach (ItemData* itemData, m_pendingItemsToResort) {
+        const int index = itemData->index;
+        if (index < itemCount - 1 && m_itemData.at(index + 1)->parent == itemData) {
+            // The children of an expanded item must be moved together
+            // with the item.
+            resortAllItems();
+            return;
+        }
+        pendingItems.append(itemData);
+        pendingIndexes.append(index);
+    }
+
+    m_pendingItemsToResort.clear();
+
+    sort(pendingItems.begin(), pendingItems.end());
+    std::sort(pendingIndexes.begin(), pendingIndexes.end());
+
+    // The remaining items are still sorted. The item with the rank r among
+    // the remaining items has the index r + j in m_itemData, where j is the
+    // number of pending items in front of it. It is the number of values
+    // pendingIndexes[j] - j, which are not larger than r.
+    QVector<int> skippedIndexes(pendingCount);
+    for (int j = 0; j < pendingCount; ++j) {
+        skippedIndexes[j] = pendingIndexes.at(j) - j;
+    }
+    const auto remainingItem = [this, &skippedIndexes](int rank) {
+        const int skippedCount = std::upper_bound(skippedIndexes.constBegin(), skippedIndexes.constEnd(), rank) - skippedIndexes.constBegin();
+        return m_itemData.at(rank + skippedCount);
+    };
+
+    // Determine the new indexes of the pending items by a binary search in the
+    // remaining items, so only O(k * log(N)) comparisons are required for k
+    // pending items.
+    const int remainingCount = itemCount - pendingCount;
+    QVector<int> newIndexes(pendingCount);
+    int rank = 0;
+    for (int i = 0; i < pendingCount; ++i) {
+        const ItemData* pendingItem = pendingItems.at(i);
+        int high = remainingCount;
+        while (rank < high) {
+            const int middle = rank + (high - rank) / 2;
+            if (lessThan(pendingItem, remainingItem(middle), m_collator)) {
+                high = middle;
+            } else {
+                rank = middle + 1;
+            }
+        }
+        newIndexes[i] = rank + i;
+    }
+
+    // Only the items between the old and the new indexes of the pending
+    // items change their position.
+    int firstMovedIndex = qMin(pendingIndexes.first(), newIndexes.first());
+    int lastMovedIndex = qMax(pendingIndexes.last(), newIndexes.last());
+
+    QVector<ItemData*> movedItems;
+    movedItems.reserve(lastMovedIndex - firstMovedIndex + 1);
+    int pendingItemIndex = 0;
+    int skippedIndex = 0;
+    int source = firstMovedIndex;
+    for (int target = firstMovedIndex; target <= lastMovedIndex; ++target) {
+        if (pendingItemIndex < pendingCount && newIndexes.at(pendingItemIndex) == target) {
+            movedItems.append(pendingItems.at(pendingItemIndex));
+            ++pendingItemIndex;
+        } else {
+            while (skippedIndex < pendingCount && pendingIndexes.at(skippedIndex) == source) {
+                ++source;
+                ++skippedIndex;
+            }
+            movedItems.append(m_itemData.at(source));
+            ++source;
+        }
+    }
+
+    for (int index = firstMovedIndex; index <= lastMovedIndex; ++index) {
+        m_itemData[index] = movedItems.at(index - firstMovedIndex);
+    }
+
+    // Pending items might have been at their correct positions already.
+    while (firstMovedIndex <= lastMovedIndex && m_itemData.at(firstMovedIndex)->index == firstMovedIndex) {
+        ++firstMovedIndex;
+    }
+    while (lastMovedIndex > firstMovedIndex && m_itemData.at(lastMovedIndex)->index == lastMovedIndex) {
+        --lastMovedIndex;
+    }
+
+    if (firstMovedIndex > lastMovedIndex) {
+        return;
+    }
+
+    const int movedItemsCount = lastMovedIndex - firstMovedIndex + 1;
+    const QList<int> movedToIndexes = updateMovedIndexes(firstMovedIndex, lastMovedIndex);
+
+    updateGroups(KItemRangeList() << KItemRange(firstMovedIndex, movedItemsCount));
+
+    emit itemsMoved(KItemRange(firstMovedIndex, movedItemsCount), movedToIndexes);
+
+#ifdef KFILEITEMMODEL_DEBUG
+    qCDebug(DolphinDebug) << "[TIME] Resorting of" << pendingCount << "items:" << timer.elapsed();
+#endif
+}
+
+QList<int> KFileItemModel::updateMovedIndexes(int first, int last)
+{
+    // Create a list movedToIndexes, which has the property that
+    // movedToIndexes[i] is the new index of the item with the old index
+    // first + i.
+    const int movedItemsCount = last - first + 1;
+    QList<int> movedToIndexes;
+    movedToIndexes.reserve(movedItemsCount);
+    for (int i = 0; i < movedItemsCount; ++i) {
+        movedToIndexes.append(-1);
+    }
+
+    for (int index = first; index <= last; ++index) {
+        ItemData* itemData = m_itemData.at(index);
+        Q_ASSERT(itemData->index >= first && itemData->index <= last);
+        movedToIndexes[itemData->index - first] = index;
+        itemData->index = index;
+    }
+
+    // The items of the keyboard search blocks are not ordered by their indexes anymore
+    m_keyboardSearchBlocks.clear();
+
+    return movedToIndexes;
+}
+
+void KFileItemModel::removeItemFromHash(const ItemData* data)
+{
+    // Several items might have the same URL in an inconsistent model. Make
+    // sure that the URL of another item is not removed.
+    const auto it = m_items.find(data->item.url());
+    if (it != m_items.end() && it.value() == data) {
+        m_items.erase(it);
+    }
+}
+
+void KFileItemModel::updateKeyboardSearchIndex() const
+{
+    if (!m_keyboardSearchIndexDirty) {
+        return;
+    }
+
+    m_keyboardSearchIndex.clear();
+    m_keyboardSearchIndex.reserve(m_itemData.count());
+    foreach (const ItemData* itemData, m_itemData) {
+        KeyboardSearchEntry entry;
+        entry.foldedText = itemData->foldedText;
+        entry.itemData = itemData;
+        m_keyboardSearchIndex.append(entry);
+    }
+    std::sort(m_keyboardSearchIndex.begin(), m_keyboardSearchIndex.end());
+
+    m_keyboardSearchBlocks.clear();
+    m_keyboardSearchIndexDirty = false;
+}
+
+void KFileItemModel::addToKeyboardSearchIndex(const QList<ItemData*>& items)
+{
+    if (m_keyboardSearchIndexDirty) {
+        // The index is built on demand when searching the next time
+        return;
+    }
+
+    const auto indexLessThan = [](const ItemData* itemData, int index) {
+        return itemData->index < index;
+    };
+
+    if (items.count() > MaxSingleKeyboardSearchUpdates) {
+        m_keyboardSearchBlocks.clear();
+    }
+
+    QVector<KeyboardSearchEntry> newEntries;
+    newEntries.reserve(items.count());
+    foreach (const ItemData* itemData, items) {
+        KeyboardSearchEntry entry;
+        entry.foldedText = itemData->foldedText;
+        entry.itemData = itemData;
+        newEntries.append(entry);
+
+        for (auto it = m_keyboardSearchBlocks.begin(); it != m_keyboardSearchBlocks.end(); ++it) {
+            if (itemData->foldedText.startsWith(it.key())) {
+                QVector<const ItemData*>& block = it.value();
+                block.insert(std::lower_bound(block.begin(), block.end(), itemData->index, indexLessThan), itemData);
+            }
+        }
+    }
+
+    if (newEntries.count() <= MaxSingleKeyboardSearchUpdates) {
+        foreach (const KeyboardSearchEntry& entry, newEntries) {
+            m_keyboardSearchIndex.insert(std::upper_bound(m_keyboardSearchIndex.begin(), m_keyboardSearchIndex.end(), entry), entry);
+        }
+    } else {
+        std::sort(newEntries.begin(), newEntries.end());
+        const int oldCount = m_keyboardSearchIndex.count();
+        m_keyboardSearchIndex.append(newEntries);
+        std::inplace_merge(m_keyboardSearchIndex.begin(), m_keyboardSearchIndex.begin() + oldCount, m_keyboardSearchIndex.end());
+    }
+}
+
+void KFileItemModel::removeFromKeyboardSearchIndex(const KItemRangeList& itemRanges)
+{
+    if (m_keyboardSearchIndexDirty) {
+        return;
+    }
+
+    const auto indexLessThan = [](const ItemData* itemData, int index) {
+        return itemData->index < index;
+    };
+
+    int removedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        removedCount += range.count;
+    }
+    if (removedCount > MaxSingleKeyboardSearchUpdates) {
+        m_keyboardSearchBlocks.clear();
+    }
+
+    QSet<const ItemData*> removedItems;
+    foreach (const KItemRange& range, itemRanges) {
+        for (int index = range.index; index < range.index + range.count; ++index) {
+            const ItemData* itemData = m_itemData.at(index);
+
+            for (auto it = m_keyboardSearchBlocks.begin(); it != m_keyboardSearchBlocks.end(); ++it) {
+                if (itemData->foldedText.startsWith(it.key())) {
+                    QVector<const ItemData*>& block = it.value();
+                    const auto blockIt = std::lower_bound(block.begin(), block.end(), index, indexLessThan);
+                    if (blockIt != block.end() && *blockIt == itemData) {
+                        block.erase(blockIt);
+                    }
+                }
+            }
+
+            if (removedCount <= MaxSingleKeyboardSearchUpdates) {
+                KeyboardSearchEntry searchedEntry;
+                searchedEntry.foldedText = itemData->foldedText;
+                searchedEntry.itemData = itemData;
+                auto entryIt = std::lower_bound(m_keyboardSearchIndex.begin(), m_keyboardSearchIndex.end(), searchedEntry);
+                while (entryIt != m_keyboardSearchIndex.end() && entryIt->itemData != itemData
+                       && entryIt->foldedText == itemData->foldedText) {
+                    ++entryIt;
+                }
+                if (entryIt != m_keyboardSearchIndex.end() && entryIt->itemData == itemData) {
+                    m_keyboardSearchIndex.erase(entryIt);
+                }
+            } else {
+                removedItems.insert(itemData);
+            }
+        }
+    }
+
+    if (!removedItems.isEmpty()) {
+        const auto end = std::remove_if(m_keyboardSearchIndex.begin(), m_keyboardSearchIndex.end(),
+                                        [&removedItems](const KeyboardSearchEntry& entry) {
+            return removedItems.contains(entry.itemData);
+        });
+        m_keyboardSearchIndex.erase(end, m_keyboardSearchIndex.end());
+    }
+}
+
+QVector<const KFileItemModel::ItemData*> KFileItemModel::keyboardSearchBlock(const QString& foldedText) const
+{
+    updateKeyboardSearchIndex();
+
+    const auto it = m_keyboardSearchBlocks.constFind(foldedText);
+    if (it != m_keyboardSearchBlocks.constEnd()) {
+        return it.value();
+    }
+
+    QVector<const ItemData*> block;
+    const auto parentIt = m_keyboardSearchBlocks.constFind(foldedText.left(foldedText.length() - 1));
+    if (parentIt != m_keyboardSearchBlocks.constEnd()) {
+        // The text has been extended by one character while typing. The matching
+        // items are a subset of the items of the previous text in the same order.
+        foreach (const ItemData* itemData, parentIt.value()) {
+            if (itemData->foldedText.startsWith(foldedText)) {
+                block.append(itemData);
+            }
+        }
+    } else {
+        // All items whose names start with 'foldedText' are adjacent in the sorted index
+        KeyboardSearchEntry searchedEntry;
+        searchedEntry.foldedText = foldedText;
+        searchedEntry.itemData = nullptr;
+
+        const auto begin = std::lower_bound(m_keyboardSearchIndex.constBegin(), m_keyboardSearchIndex.constEnd(), searchedEntry);
+        const auto end = std::partition_point(begin, m_keyboardSearchIndex.constEnd(),
+                                              [&foldedText](const KeyboardSearchEntry& entry) {
+            return entry.foldedText.startsWith(foldedText);
+        });
+
+        block.reserve(end - begin);
+        for (auto entryIt = begin; entryIt != end; ++entryIt) {
+            block.append(entryIt->itemData);
+        }
+        std::sort(block.begin(), block.end(), [](const ItemData* a, const ItemData* b) {
+            return a->index < b->index;
+        });
+    }
+
+    if (m_keyboardSearchBlocks.count() >= MaxKeyboardSearchBlocks) {
+        m_keyboardSearchBlocks.clear();
+    }
+    m_keyboardSearchBlocks.insert(foldedText, block);
+    return block;
+}
+
+void KFileItemModel::updateItemStatistics(const KFileItem& item, int sign)
+{
+    if (item.isDir()) {
+        m_folderCount += sign;
+    } else {
+        m_fileCount += sign;
+        if (sign > 0) {
+            m_totalFileSize += item.size();
+        } else {
+            m_totalFileSize -= item.size();
+        }
+    }
+}
+
 void KFileItemModel::slotCompleted()
 {
+    if (m_mimeTypeResolver->isBusy()) {
+        // Wait until all items have been added, see slotMimeTypesResolved().
+        m_completedPending = true;
+        return;
+    }
+
+    m_completedPending = false;
     dispatchPendingItemsToInsert();
 
     if (!m_urlsToExpand.isEmpty()) {
@@ -946,6 +1440,8 @@ void KFileItemModel::slotCompleted()
 
 void KFileItemModel::slotCanceled()
 {
+    m_completedPending = false;
+    m_mimeTypeResolver->flush();
     m_maximumUpdateIntervalTimer->stop();
     dispatchPendingItemsToInsert();
 
@@ -956,6 +1452,27 @@ void KFileItemModel::slotItemsAdded(const QUrl &directoryUrl, const KFileItemLis
 {
     Q_ASSERT(!items.isEmpty());
 
+    if (m_sortRole == TypeRole || m_mimeTypeResolver->isBusy()) {
+        // Determine the MIME types in worker threads before adding the items, so
+        // that they can be inserted at their final positions. Items that arrive
+        // while other items are resolved are queued, so that the order is kept.
+        m_mimeTypeResolver->resolve(directoryUrl, items);
+    } else {
+        addItems(directoryUrl, items);
+    }
+}
+
+void KFileItemModel::slotMimeTypesResolved(const QUrl& directoryUrl, const KFileItemList& items)
+{
+    addItems(directoryUrl, items);
+
+    if (m_completedPending && !m_mimeTypeResolver->isBusy()) {
+        slotCompleted();
+    }
+}
+
+void KFileItemModel::addItems(const QUrl& directoryUrl, const KFileItemList& items)
+{
     QUrl parentUrl;
     if (m_expandedDirs.contains(directoryUrl)) {
         parentUrl = m_expandedDirs.value(directoryUrl);
@@ -999,7 +1516,7 @@ void KFileItemModel::slotItemsAdded(const QUrl &directoryUrl, const KFileItemLis
         // before inserting them into the model and remember
         // the filtered items in m_filteredItems.
         foreach (ItemData* itemData, itemDataList) {
-            if (m_filter.matches(itemData->item)) {
+            if (m_filter.matches(itemData->item, itemData->foldedText)) {
                 m_pendingItemsToInsert.append(itemData);
             } else {
                 m_filteredItems.insert(itemData->item, itemData);
@@ -1016,6 +1533,8 @@ void KFileItemModel::slotItemsAdded(const QUrl &directoryUrl, const KFileItemLis
 
 void KFileItemModel::slotItemsDeleted(const KFileItemList& items)
 {
+    // The deleted items might still be resolved by m_mimeTypeResolver
+    m_mimeTypeResolver->flush();
     dispatchPendingItemsToInsert();
 
     QVector<int> indexesToRemove;
@@ -1029,7 +1548,7 @@ void KFileItemModel::slotItemsDeleted(const KFileItemList& items)
             // Probably the item has been filtered.
             QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.find(item);
             if (it != m_filteredItems.end()) {
-                delete it.value();
+                deleteItemData(it.value());
                 m_filteredItems.erase(it);
             }
         }
@@ -1069,6 +1588,9 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
     qCDebug(DolphinDebug) << "Refreshing" << items.count() << "items";
 #endif
 
+    // The refreshed items might still be resolved by m_mimeTypeResolver
+    m_mimeTypeResolver->flush();
+
     // Get the indexes of all items that have been refreshed
     QList<int> indexes;
     indexes.reserve(items.count());
@@ -1082,7 +1604,17 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
         const KFileItem& newItem = itemPair.second;
         const int indexForItem = index(oldItem);
         if (indexForItem >= 0) {
+            removeItemFromHash(m_itemData[indexForItem]);
+            updateItemStatistics(m_itemData.at(indexForItem)->item, -1);
             m_itemData[indexForItem]->item = newItem;
+            updateItemStatistics(newItem, 1);
+            m_items.insert(newItem.url(), m_itemData[indexForItem]);
+            if (oldItem.text() != newItem.text()) {
+                removeFromKeyboardSearchIndex(KItemRangeList() << KItemRange(indexForItem, 1));
+                m_itemData[indexForItem]->foldedText = KFileItemModelFilter::foldedText(newItem.text());
+                addToKeyboardSearchIndex({m_itemData[indexForItem]});
+                updateSortKey(m_itemData[indexForItem]);
+            }
 
             // Keep old values as long as possible if they could not retrieved synchronously yet.
             // The update of the values will be done asynchronously by KFileItemModelRolesUpdater.
@@ -1097,8 +1629,8 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
                 }
             }
 
-            m_items.remove(oldItem.url());
-            m_items.insert(newItem.url(), indexForItem);
+            updateSortValue(m_itemData[indexForItem]);
+
             indexes.append(indexForItem);
         } else {
             // Check if 'oldItem' is one of the filtered items.
@@ -1106,6 +1638,8 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
             if (it != m_filteredItems.end()) {
                 ItemData* itemData = it.value();
                 itemData->item = newItem;
+                itemData->foldedText = KFileItemModelFilter::foldedText(newItem.text());
+                updateSortKey(itemData);
 
                 // The data stored in 'values' might have changed. Therefore, we clear
                 // 'values' and re-populate it the next time it is requested via data(int).
@@ -1117,7 +1651,7 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
         }
     }
 
-    // If the changed items have been created recently, they might not be in m_items yet.
+    // If the changed items have been created recently, they might not be in the model yet.
     // In that case, the list 'indexes' might be empty.
     if (indexes.isEmpty()) {
         return;
@@ -1135,30 +1669,53 @@ void KFileItemModel::slotClear()
     qCDebug(DolphinDebug) << "Clearing all items";
 #endif
 
-    qDeleteAll(m_filteredItems);
+    m_mimeTypeResolver->clear();
+    m_completedPending = false;
+
+    foreach (ItemData* itemData, m_filteredItems) {
+        m_itemDataPool.destroy(itemData);
+    }
     m_filteredItems.clear();
     m_groups.clear();
 
     m_maximumUpdateIntervalTimer->stop();
-    m_resortAllItemsTimer->stop();
+    m_resortPendingItemsTimer->stop();
+    m_pendingItemsToResort.clear();
 
-    qDeleteAll(m_pendingItemsToInsert);
+    foreach (ItemData* itemData, m_pendingItemsToInsert) {
+        m_itemDataPool.destroy(itemData);
+    }
     m_pendingItemsToInsert.clear();
 
     const int removedCount = m_itemData.count();
     if (removedCount > 0) {
-        qDeleteAll(m_itemData);
+        foreach (ItemData* itemData, m_itemData) {
+            m_itemDataPool.destroy(itemData);
+        }
         m_itemData.clear();
         m_items.clear();
+        m_fileCount = 0;
+        m_folderCount = 0;
+        m_totalFileSize = 0;
+        m_keyboardSearchIndex.clear();
+        m_keyboardSearchBlocks.clear();
+        m_keyboardSearchIndexDirty = true;
         emit itemsRemoved(KItemRangeList() << KItemRange(0, removedCount));
     }
 
+    // All items have been deleted, so all slots and the
+    // memory of the ItemData instances can be reused. Memory
+    // that has not been needed for these items is freed.
+    m_columns.clear();
+    m_itemDataPool.clear();
+
     m_expandedDirs.clear();
 }
 
 void KFileItemModel::slotSortingChoiceChanged()
 {
     loadSortingSettings();
+    updateSortKeys();
     resortAllItems();
 }
 
@@ -1183,17 +1740,14 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
     qCDebug(DolphinDebug) << "Inserting" << newItems.count() << "items";
 #endif
 
-    m_groups.clear();
-    prepareItemsForSorting(newItems);
-
-    if (m_sortRole == NameRole && m_naturalSorting) {
-        // Natural sorting of items can be very slow. However, it becomes much
-        // faster if the input sequence is already mostly sorted. Therefore, we
-        // first sort 'newItems' according to the QStrings returned by
-        // KFileItem::text() using QString::operator<(), which is quite fast.
-        parallelMergeSort(newItems.begin(), newItems.end(), nameLessThan, QThread::idealThreadCount());
+    // The new items are merged into m_itemData, which requires that all
+    // existing items are at their correct positions.
+    if (!m_pendingItemsToResort.isEmpty()) {
+        resortPendingItems();
     }
 
+    prepareItemsForSorting(newItems);
+
     sort(newItems.begin(), newItems.end());
 
 #ifdef KFILEITEMMODEL_DEBUG
@@ -1209,6 +1763,9 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
         // Optimization for the common special case that there are no
         // items in the model yet. Happens, e.g., when entering a folder.
         m_itemData = newItems;
+        for (int i = 0; i < newItemCount; ++i) {
+            m_itemData.at(i)->index = i;
+        }
         itemRanges << KItemRange(0, newItemCount);
     } else {
         m_itemData.reserve(totalItemCount);
@@ -1235,11 +1792,13 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
                 }
 
                 m_itemData[targetIndex] = m_itemData.at(sourceIndexExistingItems);
+                m_itemData[targetIndex]->index = targetIndex;
                 --sourceIndexExistingItems;
             } else {
                 // Insert a new item into the list.
                 ++rangeCount;
                 m_itemData[targetIndex] = newItem;
+                newItem->index = targetIndex;
                 --sourceIndexNewItems;
             }
             --targetIndex;
@@ -1254,9 +1813,14 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
         std::reverse(itemRanges.begin(), itemRanges.end());
     }
 
-    // The indexes in m_items are not correct anymore. Therefore, we clear m_items.
-    // It will be re-populated with the updated indices if index(const QUrl&) is called.
-    m_items.clear();
+    m_items.reserve(totalItemCount);
+    foreach (ItemData* itemData, newItems) {
+        m_items.insert(itemData->item.url(), itemData);
+        updateItemStatistics(itemData->item, 1);
+    }
+    addToKeyboardSearchIndex(newItems);
+
+    updateGroupsAfterInsertion(itemRanges);
 
     emit itemsInserted(itemRanges);
 
@@ -1271,7 +1835,8 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
         return;
     }
 
-    m_groups.clear();
+    // The index contains pointers to the removed items
+    removeFromKeyboardSearchIndex(itemRanges);
 
     // Step 1: Remove the items from m_itemData, and free the ItemData.
     int removedItemsCount = 0;
@@ -1279,8 +1844,11 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
         removedItemsCount += range.count;
 
         for (int index = range.index; index < range.index + range.count; ++index) {
+            m_pendingItemsToResort.remove(m_itemData.at(index));
+            removeItemFromHash(m_itemData.at(index));
+            updateItemStatistics(m_itemData.at(index)->item, -1);
             if (behavior == DeleteItemData) {
-                delete m_itemData.at(index);
+                deleteItemData(m_itemData.at(index));
             }
 
             m_itemData[index] = nullptr;
@@ -1295,6 +1863,7 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
     const int oldItemDataCount = m_itemData.count();
     while (source < oldItemDataCount) {
         m_itemData[target] = m_itemData[source];
+        m_itemData[target]->index = target;
         ++target;
         ++source;
 
@@ -1305,80 +1874,194 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
         }
     }
 
-    m_itemData.erase(m_itemData.end() - removedItemsCount, m_itemData.end());
+    m_itemData.erase(m_itemData.end() - removedItemsCount, m_itemData.end());
+
+    updateGroupsAfterRemoval(itemRanges);
+
+    emit itemsRemoved(itemRanges);
+}
+
+QList<KFileItemModel::ItemData*> KFileItemModel::createItemDataList(const QUrl& parentUrl, const KFileItemList& items)
+{
+    const int parentIndex = index(parentUrl);
+    ItemData* parentItem = parentIndex < 0 ? nullptr : m_itemData.at(parentIndex);
+
+    QList<ItemData*> itemDataList;
+    itemDataList.reserve(items.count());
+
+    foreach (const KFileItem& item, items) {
+        ItemData* itemData = m_itemDataPool.create();
+        itemData->item = item;
+        itemData->foldedText = KFileItemModelFilter::foldedText(item.text());
+        itemData->parent = parentItem;
+        itemData->slot = m_columns.allocateSlot();
+        itemData->index = -1;
+        itemDataList.append(itemData);
+    }
+
+    return itemDataList;
+}
+
+void KFileItemModel::deleteItemData(ItemData* data)
+{
+    m_columns.releaseSlot(data->slot);
+    m_itemDataPool.destroy(data);
+}
+
+void KFileItemModel::prepareItemsForSorting(QList<ItemData*>& itemDataList)
+{
+    if (m_naturalSorting) {
+        // Calling QCollator::compare() for each comparison is very slow. Create
+        // the collation keys once, the sorting only needs to compare them.
+        foreach (ItemData* itemData, itemDataList) {
+            if (!itemData->sortKey) {
+                updateSortKey(itemData);
+            }
+        }
+    }
+
+    // The sort role is compared by using the typed values from m_columns. Note
+    // that the items might have been filtered while the sort role has been
+    // changed, so the values are always updated.
+    if (m_sortRole != NameRole) {
+        foreach (ItemData* itemData, itemDataList) {
+            updateSortValue(itemData);
+        }
+    }
+}
+
+void KFileItemModel::updateSortKey(ItemData* data) const
+{
+    if (m_naturalSorting) {
+        data->sortKey.reset(new QCollatorSortKey(m_collator.sortKey(data->item.text())));
+    } else {
+        data->sortKey.reset();
+    }
+}
+
+void KFileItemModel::updateSortKeys()
+{
+    foreach (ItemData* itemData, m_itemData) {
+        updateSortKey(itemData);
+    }
+
+    foreach (ItemData* itemData, m_pendingItemsToInsert) {
+        updateSortKey(itemData);
+    }
+
+    QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.begin();
+    const QHash<KFileItem, ItemData*>::iterator end = m_filteredItems.end();
+    while (it != end) {
+        updateSortKey(it.value());
+        ++it;
+    }
+}
+
+void KFileItemModel::updateSortValue(ItemData* data)
+{
+    const KFileItem& item = data->item;
+    const int slot = data->slot;
 
-    // The indexes in m_items are not correct anymore. Therefore, we clear m_items.
-    // It will be re-populated with the updated indices if index(const QUrl&) is called.
-    m_items.clear();
+    switch (m_sortRole) {
+    case NoRole:
+    case NameRole:
+        // The name is compared by the collation keys or by KFileItem::text().
+        break;
 
-    emit itemsRemoved(itemRanges);
-}
+    case SizeRole:
+        if (item.isDir()) {
+            // The number of sub-items is resolved by KFileItemModelRolesUpdater.
+            const QVariant value = data->values.value("size");
+            m_columns.setNumber(SizeRole, slot, value.isNull() ? UnknownSortValue : value.toInt());
+        } else {
+            // Files with an unknown size (KIO::invalid_filesize) are sorted last.
+            const KIO::filesize_t size = qMin(item.size(), static_cast<KIO::filesize_t>(std::numeric_limits<qint64>::max()));
+            m_columns.setNumber(SizeRole, slot, static_cast<qint64>(size));
+        }
+        break;
 
-QList<KFileItemModel::ItemData*> KFileItemModel::createItemDataList(const QUrl& parentUrl, const KFileItemList& items) const
-{
-    if (m_sortRole == TypeRole) {
-        // Try to resolve the MIME-types synchronously to prevent a reordering of
-        // the items when sorting by type (per default MIME-types are resolved
-        // asynchronously by KFileItemModelRolesUpdater).
-        determineMimeTypes(items, 200);
-    }
+    case ModificationTimeRole:
+        m_columns.setNumber(ModificationTimeRole, slot, item.entry().numberValue(KIO::UDSEntry::UDS_MODIFICATION_TIME, -1));
+        break;
 
-    const int parentIndex = index(parentUrl);
-    ItemData* parentItem = parentIndex < 0 ? nullptr : m_itemData.at(parentIndex);
+    case CreationTimeRole:
+        m_columns.setNumber(CreationTimeRole, slot, item.entry().numberValue(KIO::UDSEntry::UDS_CREATION_TIME, -1));
+        break;
 
-    QList<ItemData*> itemDataList;
-    itemDataList.reserve(items.count());
+    case AccessTimeRole:
+        m_columns.setNumber(AccessTimeRole, slot, item.entry().numberValue(KIO::UDSEntry::UDS_ACCESS_TIME, -1));
+        break;
 
-    foreach (const KFileItem& item, items) {
-        ItemData* itemData = new ItemData();
-        itemData->item = item;
-        itemData->parent = parentItem;
-        itemDataList.append(itemData);
+    case DeletionTimeRole: {
+        const QDateTime deletionTime = itemDeletionTime(item);
+        m_columns.setNumber(DeletionTimeRole, slot, deletionTime.isValid() ? deletionTime.toMSecsSinceEpoch() : UnknownSortValue);
+        break;
     }
 
-    return itemDataList;
-}
+    case RatingRole:
+    case WidthRole:
+    case HeightRole:
+    case WordCountRole:
+    case LineCountRole:
+    case TrackRole:
+    case ReleaseYearRole:
+        m_columns.setNumber(m_sortRole, slot, data->values.value(roleForType(m_sortRole)).toInt());
+        break;
 
-void KFileItemModel::prepareItemsForSorting(QList<ItemData*>& itemDataList)
-{
-    switch (m_sortRole) {
     case PermissionsRole:
+        m_columns.setString(PermissionsRole, slot, item.permissionsString());
+        break;
+
     case OwnerRole:
+        m_columns.setString(OwnerRole, slot, item.user());
+        break;
+
     case GroupRole:
-    case DestinationRole:
+        m_columns.setString(GroupRole, slot, item.group());
+        break;
+
+    case DestinationRole: {
+        const QString destination = item.linkDest();
+        m_columns.setString(DestinationRole, slot, destination.isEmpty() ? QStringLiteral("-") : destination);
+        break;
+    }
+
     case PathRole:
-    case DeletionTimeRole:
-        // These roles can be determined with retrieveData, and they have to be stored
-        // in the QHash "values" for the sorting.
-        foreach (ItemData* itemData, itemDataList) {
-            if (itemData->values.isEmpty()) {
-                itemData->values = retrieveData(itemData->item, itemData->parent);
-            }
-        }
+        m_columns.setString(PathRole, slot, itemPath(item));
         break;
 
-    case TypeRole:
-        // At least store the data including the file type for items with known MIME type.
-        foreach (ItemData* itemData, itemDataList) {
-            if (itemData->values.isEmpty()) {
-                const KFileItem item = itemData->item;
-                if (item.isDir() || item.isMimeTypeKnown()) {
-                    itemData->values = retrieveData(itemData->item, itemData->parent);
-                }
-            }
+    case TypeRole: {
+        // The type of items with unknown MIME type is resolved by KFileItemModelRolesUpdater.
+        const QHash<QByteArray, QVariant>::const_iterator it = data->values.constFind("type");
+        if (it != data->values.constEnd()) {
+            m_columns.setString(TypeRole, slot, it.value().toString());
+        } else if (item.isMimeTypeKnown()) {
+            m_columns.setString(TypeRole, slot, item.mimeComment());
+        } else if (item.isDir()) {
+            // Like retrieveData(), don't determine the MIME type of each directory.
+            static const QString folderMimeComment = QMimeDatabase().mimeTypeForName(QStringLiteral("inode/directory")).comment();
+            m_columns.setString(TypeRole, slot, folderMimeComment);
+        } else {
+            m_columns.setString(TypeRole, slot, QString());
         }
         break;
+    }
 
     default:
-        // The other roles are either resolved by KFileItemModelRolesUpdater
-        // (this includes the SizeRole for directories), or they do not need
-        // to be stored in the QHash "values" for sorting because the data can
-        // be retrieved directly from the KFileItem (NameRole, SizeRole for files,
-        // DateRole).
+        m_columns.setString(m_sortRole, slot, data->values.value(roleForType(m_sortRole)).toString());
         break;
     }
 }
 
+void KFileItemModel::updateSortValues()
+{
+    if (m_sortRole != NameRole) {
+        foreach (ItemData* itemData, m_itemData) {
+            updateSortValue(itemData);
+        }
+    }
+}
+
 int KFileItemModel::expandedParentsCount(const ItemData* data)
 {
     // The hash 'values' is only guaranteed to contain the key "expandedParentsCount"
@@ -1417,7 +2100,7 @@ void KFileItemModel::removeExpandedItems()
 
     while (it != end) {
         if (it.value()->parent) {
-            delete it.value();
+            deleteItemData(it.value());
             it = m_filteredItems.erase(it);
         } else {
             ++it;
@@ -1425,55 +2108,133 @@ void KFileItemModel::removeExpandedItems()
     }
 }
 
+QSet<QByteArray> KFileItemModel::storeValues(int index, const QHash<QByteArray, QVariant>& values)
+{
+    ItemData* data = m_itemData.at(index);
+    if (data->values.isEmpty()) {
+        data->values = retrieveData(data->item, data->parent);
+    }
+
+    // Determine which roles have been changed. The values are modified in
+    // place, so the hash is only detached if something has been changed.
+    QHash<QByteArray, QVariant>& currentValues = data->values;
+    QSet<QByteArray> changedRoles;
+    QHashIterator<QByteArray, QVariant> it(values);
+    while (it.hasNext()) {
+        it.next();
+        const QVariant& value = it.value();
+        const QHash<QByteArray, QVariant>::const_iterator currentIt = currentValues.constFind(it.key());
+        const bool changed = (currentIt == currentValues.constEnd()) ? value.isValid() : (*currentIt != value);
+        if (changed) {
+            const QByteArray role = sharedValue(it.key());
+            currentValues.insert(role, value);
+            changedRoles.insert(role);
+        }
+    }
+
+    if (changedRoles.isEmpty()) {
+        return changedRoles;
+    }
+
+    if (changedRoles.contains("text")) {
+        QUrl url = data->item.url();
+        removeItemFromHash(data);
+        url = url.adjusted(QUrl::RemoveFilename);
+        url.setPath(url.path() + currentValues.value("text").toString());
+        data->item.setUrl(url);
+        m_items.insert(url, data);
+        removeFromKeyboardSearchIndex(KItemRangeList() << KItemRange(index, 1));
+        data->foldedText = KFileItemModelFilter::foldedText(data->item.text());
+        addToKeyboardSearchIndex({data});
+        updateSortKey(data);
+    }
+
+    if (changedRoles.contains(sortRole())) {
+        updateSortValue(data);
+    }
+
+    return changedRoles;
+}
+
 void KFileItemModel::emitItemsChangedAndTriggerResorting(const KItemRangeList& itemRanges, const QSet<QByteArray>& changedRoles)
 {
     emit itemsChanged(itemRanges, changedRoles);
 
+    if (groupedSorting() && changedRoles.contains(sortRole()) && !m_groups.isEmpty()) {
+        // The groups might have changed if a changed item is the first or the
+        // last item in a group. If the items must be resorted, resortAllItems()
+        // updates the groups of the moved items again. The signal is emitted
+        // together with the change of m_groups, so that the view never shows
+        // outdated group headers.
+        if (updateGroups(itemRanges)) {
+            emit groupsChanged();
+        }
+    }
+
     // Trigger a resorting if necessary. Note that this can happen even if the sort
     // role has not changed at all because the file name can be used as a fallback.
     if (changedRoles.contains(sortRole()) || changedRoles.contains(roleForType(NameRole))) {
+        // resortPendingItems() inserts the pending items among the other items
+        // with a binary search, so the items that are not pending must stay sorted.
+        // Only the changed items that are out of order relative to their nearest
+        // neighbors that are not pending are queued for resorting.
+        const int itemCount = count();
+        bool needsResorting = false;
         foreach (const KItemRange& range, itemRanges) {
-            bool needsResorting = false;
-
             const int first = range.index;
             const int last = range.index + range.count - 1;
 
-            // Resorting the model is necessary if
-            // (a)  The first item in the range is "lessThan" its predecessor,
-            // (b)  the successor of the last item is "lessThan" the last item, or
-            // (c)  the internal order of the items in the range is incorrect.
-            if (first > 0
-                && lessThan(m_itemData.at(first), m_itemData.at(first - 1), m_collator)) {
-                needsResorting = true;
-            } else if (last < count() - 1
-                && lessThan(m_itemData.at(last + 1), m_itemData.at(last), m_collator)) {
-                needsResorting = true;
-            } else {
-                for (int index = first; index < last; ++index) {
-                    if (lessThan(m_itemData.at(index + 1), m_itemData.at(index), m_collator)) {
-                        needsResorting = true;
-                        break;
-                    }
+            int previous = first - 1;
+            while (previous >= 0 && m_pendingItemsToResort.contains(m_itemData.at(previous))) {
+                --previous;
+            }
+            int next = last + 1;
+            while (next < itemCount && m_pendingItemsToResort.contains(m_itemData.at(next))) {
+                ++next;
+            }
+
+            // Indexes of the items in the range that keep their positions. They are sorted
+            // among themselves and not less than the item at 'previous'.
+            QVector<int> sortedIndexes;
+            for (int index = first; index <= last; ++index) {
+                ItemData* itemData = m_itemData.at(index);
+                if (m_pendingItemsToResort.contains(itemData)) {
+                    continue;
+                }
+
+                const int left = sortedIndexes.isEmpty() ? previous : sortedIndexes.last();
+                int right = index + 1;
+                while (right <= last && m_pendingItemsToResort.contains(m_itemData.at(right))) {
+                    ++right;
+                }
+                if (right > last) {
+                    right = next;
+                }
+
+                if ((left >= 0 && lessThan(itemData, m_itemData.at(left), m_collator))
+                    || (right < itemCount && lessThan(m_itemData.at(right), itemData, m_collator))) {
+                    m_pendingItemsToResort.insert(itemData);
+                    needsResorting = true;
+                } else {
+                    sortedIndexes.append(index);
                 }
             }
 
-            if (needsResorting) {
-                m_resortAllItemsTimer->start();
-                return;
+            // The right neighbor of an item might have been queued itself. Assure that
+            // the last remaining items of the range are not greater than the item at 'next'.
+            if (next < itemCount) {
+                const ItemData* nextItemData = m_itemData.at(next);
+                while (!sortedIndexes.isEmpty()
+                       && lessThan(nextItemData, m_itemData.at(sortedIndexes.last()), m_collator)) {
+                    m_pendingItemsToResort.insert(m_itemData.at(sortedIndexes.takeLast()));
+                    needsResorting = true;
+                }
             }
         }
-    }
 
-    if (groupedSorting() && changedRoles.contains(sortRole())) {
-        // The position is still correct, but the groups might have changed
-        // if the changed item is either the first or the last item in a
-        // group.
-        // In principle, we could try to find out if the item really is the
-        // first or last one in its group and then update the groups
-        // (possibly with a delayed timer to make sure that we don't
-        // re-calculate the groups very often if items are updated one by
-        // one), but starting m_resortAllItemsTimer is easier.
-        m_resortAllItemsTimer->start();
+        if (needsResorting) {
+            m_resortPendingItemsTimer->start();
+        }
     }
 }
 
@@ -1612,34 +2373,11 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
     }
 
     if (m_requestRole[PathRole]) {
-        QString path;
-        if (item.url().scheme() == QLatin1String("trash")) {
-            path = item.entry().stringValue(KIO::UDSEntry::UDS_EXTRA);
-        } else {
-            // For performance reasons cache the home-path in a static QString
-            // (see QDir::homePath() for more details)
-            static QString homePath;
-            if (homePath.isEmpty()) {
-                homePath = QDir::homePath();
-            }
-
-            path = item.localPath();
-            if (path.startsWith(homePath)) {
-                path.replace(0, homePath.length(), QLatin1Char('~'));
-            }
-        }
-
-        const int index = path.lastIndexOf(item.text());
-        path = path.mid(0, index - 1);
-        data.insert(sharedValue("path"), path);
+        data.insert(sharedValue("path"), itemPath(item));
     }
 
     if (m_requestRole[DeletionTimeRole]) {
-        QDateTime deletionTime;
-        if (item.url().scheme() == QLatin1String("trash")) {
-            deletionTime = QDateTime::fromString(item.entry().stringValue(KIO::UDSEntry::UDS_EXTRA + 1), Qt::ISODate);
-        }
-        data.insert(sharedValue("deletiontime"), deletionTime);
+        data.insert(sharedValue("deletiontime"), itemDeletionTime(item));
     }
 
     if (m_requestRole[IsExpandableRole] && isDir) {
@@ -1725,17 +2463,13 @@ void KFileItemModel::sort(const QList<KFileItemModel::ItemData*>::iterator &begi
         return lessThan(a, b, m_collator);
     };
 
-    if (m_sortRole == NameRole) {
-        // Sorting by name can be expensive, in particular if natural sorting is
-        // enabled. Use all CPU cores to speed up the sorting process.
-        static const int numberOfThreads = QThread::idealThreadCount();
-        parallelMergeSort(begin, end, lambdaLessThan, numberOfThreads);
-    } else {
-        // Sorting by other roles is quite fast. Use only one thread to prevent
-        // problems caused by non-reentrant comparison functions, see
-        // https://bugs.kde.org/show_bug.cgi?id=312679
-        mergeSort(begin, end, lambdaLessThan);
-    }
+    // Use all CPU cores to speed up the sorting process. The comparison is
+    // reentrant for all sort roles, because it only reads the collation keys,
+    // the typed values in m_columns and the KFileItems (in the past, reading
+    // the QHash 'values' caused problems, see
+    // https://bugs.kde.org/show_bug.cgi?id=312679).
+    static const int numberOfThreads = QThread::idealThreadCount();
+    parallelMergeSort(begin, end, lambdaLessThan, numberOfThreads);
 }
 
 int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const QCollator& collator) const
@@ -1750,71 +2484,14 @@ int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const
         // The name role is handled as default fallback after the switch
         break;
 
-    case SizeRole: {
-        if (itemA.isDir()) {
-            // See "if (m_sortFoldersFirst || m_sortRole == SizeRole)" in KFileItemModel::lessThan():
-            Q_ASSERT(itemB.isDir());
-
-            const QVariant valueA = a->values.value("size");
-            const QVariant valueB = b->values.value("size");
-            if (valueA.isNull() && valueB.isNull()) {
-                result = 0;
-            } else if (valueA.isNull()) {
-                result = -1;
-            } else if (valueB.isNull()) {
-                result = +1;
-            } else {
-                result = valueA.toInt() - valueB.toInt();
-            }
-        } else {
-            // See "if (m_sortFoldersFirst || m_sortRole == SizeRole)" in KFileItemModel::lessThan():
-            Q_ASSERT(!itemB.isDir());
-            const KIO::filesize_t sizeA = itemA.size();
-            const KIO::filesize_t sizeB = itemB.size();
-            if (sizeA > sizeB) {
-                result = +1;
-            } else if (sizeA < sizeB) {
-                result = -1;
-            } else {
-                result = 0;
-            }
-        }
-        break;
-    }
-
-    case ModificationTimeRole: {
-        const long long dateTimeA = itemA.entry().numberValue(KIO::UDSEntry::UDS_MODIFICATION_TIME, -1);
-        const long long dateTimeB = itemB.entry().numberValue(KIO::UDSEntry::UDS_MODIFICATION_TIME, -1);
-        if (dateTimeA < dateTimeB) {
-            result = -1;
-        } else if (dateTimeA > dateTimeB) {
-            result = +1;
-        }
-        break;
-    }
-
-    case CreationTimeRole: {
-        const long long dateTimeA = itemA.entry().numberValue(KIO::UDSEntry::UDS_CREATION_TIME, -1);
-        const long long dateTimeB = itemB.entry().numberValue(KIO::UDSEntry::UDS_CREATION_TIME, -1);
-        if (dateTimeA < dateTimeB) {
-            result = -1;
-        } else if (dateTimeA > dateTimeB) {
-            result = +1;
-        }
-        break;
-    }
-
-    case DeletionTimeRole: {
-        const QDateTime dateTimeA = a->values.value("deletiontime").toDateTime();
-        const QDateTime dateTimeB = b->values.value("deletiontime").toDateTime();
-        if (dateTimeA < dateTimeB) {
-            result = -1;
-        } else if (dateTimeA > dateTimeB) {
-            result = +1;
-        }
-        break;
-    }
-
+    case SizeRole:
+        // See "if (m_sortFoldersFirst || m_sortRole == SizeRole)" in KFileItemModel::lessThan():
+        Q_ASSERT(itemA.isDir() == itemB.isDir());
+        Q_FALLTHROUGH();
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole:
     case RatingRole:
     case WidthRole:
     case HeightRole:
@@ -1822,26 +2499,29 @@ int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const
     case LineCountRole:
     case TrackRole:
     case ReleaseYearRole: {
-        result = a->values.value(roleForType(m_sortRole)).toInt() - b->values.value(roleForType(m_sortRole)).toInt();
+        const qint64 valueA = m_columns.number(m_sortRole, a->slot);
+        const qint64 valueB = m_columns.number(m_sortRole, b->slot);
+        if (valueA < valueB) {
+            result = -1;
+        } else if (valueA > valueB) {
+            result = +1;
+        }
         break;
     }
 
-    default: {
-        const QByteArray role = roleForType(m_sortRole);
-        result = QString::compare(a->values.value(role).toString(),
-                                  b->values.value(role).toString());
+    default:
+        result = QString::compare(m_columns.string(m_sortRole, a->slot),
+                                  m_columns.string(m_sortRole, b->slot));
         break;
     }
 
-    }
-
     if (result != 0) {
         // The current sort role was sufficient to define an order
         return result;
     }
 
     // Fallback #1: Compare the text of the items
-    result = stringCompare(itemA.text(), itemB.text(), collator);
+    result = nameCompare(a, b, collator);
     if (result != 0) {
         return result;
     }
@@ -1875,21 +2555,211 @@ int KFileItemModel::stringCompare(const QString& a, const QString& b, const QCol
     return QString::compare(a, b, Qt::CaseSensitive);
 }
 
+int KFileItemModel::nameCompare(const ItemData* a, const ItemData* b, const QCollator& collator) const
+{
+    if (m_naturalSorting && a->sortKey && b->sortKey) {
+        return a->sortKey->compare(*b->sortKey);
+    }
+
+    return stringCompare(a->item.text(), b->item.text(), collator);
+}
+
 bool KFileItemModel::useMaximumUpdateInterval() const
 {
     return !m_dirLister->url().isLocalFile();
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::nameRoleGroups() const
+QList<QPair<int, QVariant> > KFileItemModel::roleGroups(int begin, int end) const
+{
+    switch (typeForRole(sortRole())) {
+    case NameRole:        return nameRoleGroups(begin, end);
+    case SizeRole:        return sizeRoleGroups(begin, end);
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+        return timeRoleGroups(begin, end, [this](const ItemData *item) {
+            const qint64 time = m_columns.number(m_sortRole, item->slot);
+            return time == -1 ? QDateTime() : QDateTime::fromSecsSinceEpoch(time);
+        });
+    case DeletionTimeRole:
+        return timeRoleGroups(begin, end, [this](const ItemData *item) {
+            const qint64 time = m_columns.number(DeletionTimeRole, item->slot);
+            return time == UnknownSortValue ? QDateTime() : QDateTime::fromMSecsSinceEpoch(time);
+        });
+    case PermissionsRole: return permissionRoleGroups(begin, end);
+    case RatingRole:      return ratingRoleGroups(begin, end);
+    default:              return genericStringRoleGroups(begin, end, sortRole());
+    }
+}
+
+bool KFileItemModel::updateGroups(const KItemRangeList& itemRanges)
+{
+    if (m_groups.isEmpty() || itemRanges.isEmpty()) {
+        // The groups will be calculated for all items in groups().
+        return false;
+    }
+
+    const int itemCount = count();
+    if (itemCount == 0) {
+        m_groups.clear();
+        return true;
+    }
+
+    // The xxxRoleGroups() methods decide whether an item starts a new group by
+    // comparing it with the preceding top-level item. Therefore the groups are
+    // calculated starting with the top-level item that precedes a range, and
+    // up to the first top-level item after the range, which might start a new
+    // group now or not anymore. The groups of all other items are not affected.
+    // Ranges whose affected items overlap are handled together.
+    QVector<QPair<int, int> > spans;
+    foreach (const KItemRange& range, itemRanges) {
+        int previous = range.index - 1;
+        while (previous >= 0 && isChildItem(previous)) {
+            --previous;
+        }
+
+        int next = range.index + range.count;
+        while (next < itemCount && isChildItem(next)) {
+            ++next;
+        }
+
+        const int end = qMin(next + 1, itemCount);
+        if (!spans.isEmpty() && previous + 1 < spans.last().second) {
+            spans.last().second = qMax(spans.last().second, end);
+        } else {
+            spans.append(qMakePair(previous, end));
+        }
+    }
+
+    // The spans are handled from the last to the first one, because replacing
+    // the groups of a span does not move the groups in front of it. The groups
+    // of each span are found by a binary search, and only they are replaced.
+    bool changed = false;
+    for (int i = spans.count() - 1; i >= 0; --i) {
+        const int previous = spans.at(i).first;
+        const int end = spans.at(i).second;
+        QList<QPair<int, QVariant> > newGroups = roleGroups(qMax(previous, 0), end);
+        if (previous >= 0 && !newGroups.isEmpty() && newGroups.first().first == previous) {
+            // The group of the preceding item is already known.
+            newGroups.removeFirst();
+        }
+
+        const auto replaceBegin = std::lower_bound(m_groups.begin(), m_groups.end(), previous + 1, groupIndexLessThan);
+        const auto replaceEnd = std::lower_bound(replaceBegin, m_groups.end(), end, groupIndexLessThan);
+        int position = replaceBegin - m_groups.begin();
+        const int replacedCount = replaceEnd - replaceBegin;
+
+        const int assignedCount = qMin(replacedCount, newGroups.count());
+        for (int j = 0; j < assignedCount; ++j) {
+            if (m_groups.at(position) != newGroups.at(j)) {
+                m_groups[position] = newGroups.at(j);
+                changed = true;
+            }
+            ++position;
+        }
+        if (replacedCount > assignedCount) {
+            m_groups.erase(m_groups.begin() + position, m_groups.begin() + position + replacedCount - assignedCount);
+            changed = true;
+        }
+        for (int j = assignedCount; j < newGroups.count(); ++j) {
+            m_groups.insert(position, newGroups.at(j));
+            ++position;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void KFileItemModel::updateGroupsAfterInsertion(const KItemRangeList& itemRanges)
+{
+    if (m_groups.isEmpty()) {
+        return;
+    }
+
+    // Shift the indexes of the existing groups by the number of items
+    // that have been inserted in front of them. The groups in front of
+    // the first inserted item are skipped by a binary search.
+    const int groupCount = m_groups.count();
+    int groupIndex = std::lower_bound(m_groups.constBegin(), m_groups.constEnd(),
+                                      itemRanges.first().index, groupIndexLessThan) - m_groups.constBegin();
+    int insertedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        while (groupIndex < groupCount && m_groups.at(groupIndex).first < range.index) {
+            m_groups[groupIndex].first += insertedCount;
+            ++groupIndex;
+        }
+        insertedCount += range.count;
+    }
+    while (groupIndex < groupCount) {
+        m_groups[groupIndex].first += insertedCount;
+        ++groupIndex;
+    }
+
+    // Determine the groups of the inserted items and of their successors.
+    KItemRangeList insertedRanges;
+    insertedRanges.reserve(itemRanges.count());
+    insertedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        insertedRanges.append(KItemRange(range.index + insertedCount, range.count));
+        insertedCount += range.count;
+    }
+    updateGroups(insertedRanges);
+}
+
+void KFileItemModel::updateGroupsAfterRemoval(const KItemRangeList& itemRanges)
+{
+    if (m_groups.isEmpty()) {
+        return;
+    }
+
+    // Remove the groups which have been started by a removed item, and shift the
+    // indexes of the remaining groups by the number of items that have been
+    // removed in front of them. The groups in front of the first removed item
+    // are skipped by a binary search, the other groups are compacted in place.
+    const int groupCount = m_groups.count();
+    int keptCount = std::lower_bound(m_groups.constBegin(), m_groups.constEnd(),
+                                     itemRanges.first().index, groupIndexLessThan) - m_groups.constBegin();
+    int rangeIndex = 0;
+    int removedCount = 0;
+    for (int i = keptCount; i < groupCount; ++i) {
+        const int index = m_groups.at(i).first;
+        while (rangeIndex < itemRanges.count()
+               && index >= itemRanges.at(rangeIndex).index + itemRanges.at(rangeIndex).count) {
+            removedCount += itemRanges.at(rangeIndex).count;
+            ++rangeIndex;
+        }
+
+        if (rangeIndex < itemRanges.count() && index >= itemRanges.at(rangeIndex).index) {
+            continue;
+        }
+
+        m_groups[keptCount] = QPair<int, QVariant>(index - removedCount, m_groups.at(i).second);
+        ++keptCount;
+    }
+    m_groups.erase(m_groups.begin() + keptCount, m_groups.end());
+
+    // The items that have been behind the removed items might start a new
+    // group now, or belong to the group of the items in front of the removed items.
+    KItemRangeList boundaries;
+    boundaries.reserve(itemRanges.count());
+    removedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        boundaries.append(KItemRange(range.index - removedCount, 0));
+        removedCount += range.count;
+    }
+    updateGroups(boundaries);
+}
+
+QList<QPair<int, QVariant> > KFileItemModel::nameRoleGroups(int begin, int end) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
     QString groupValue;
     QChar firstChar;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
@@ -1947,21 +2817,21 @@ QList<QPair<int, QVariant> > KFileItemModel::nameRoleGroups() const
     return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::sizeRoleGroups() const
+QList<QPair<int, QVariant> > KFileItemModel::sizeRoleGroups(int begin, int end) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
     QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
 
-        const KFileItem& item = m_itemData.at(i)->item;
-        const KIO::filesize_t fileSize = !item.isNull() ? item.size() : ~0U;
+        const ItemData* itemData = m_itemData.at(i);
+        const KFileItem& item = itemData->item;
+        const qint64 fileSize = !item.isNull() ? m_columns.number(SizeRole, itemData->slot) : std::numeric_limits<qint64>::max();
         QString newGroupValue;
         if (!item.isNull() && item.isDir()) {
             newGroupValue = i18nc("@title:group Size", "Folders");
@@ -1982,18 +2852,17 @@ QList<QPair<int, QVariant> > KFileItemModel::sizeRoleGroups() const
     return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::timeRoleGroups(const std::function<QDateTime(const ItemData *)> &fileTimeCb) const
+QList<QPair<int, QVariant> > KFileItemModel::timeRoleGroups(int begin, int end, const std::function<QDateTime(const ItemData *)> &fileTimeCb) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
     const QDate currentDate = QDate::currentDate();
 
     QDate previousFileDate;
     QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
@@ -2148,22 +3017,21 @@ QList<QPair<int, QVariant> > KFileItemModel::timeRoleGroups(const std::function<
     return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::permissionRoleGroups() const
+QList<QPair<int, QVariant> > KFileItemModel::permissionRoleGroups(int begin, int end) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
     QString permissionsString;
     QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
 
         const ItemData* itemData = m_itemData.at(i);
-        const QString newPermissionsString = itemData->values.value("permissions").toString();
+        const QString& newPermissionsString = m_columns.string(PermissionsRole, itemData->slot);
         if (newPermissionsString == permissionsString) {
             continue;
         }
@@ -2220,19 +3088,18 @@ QList<QPair<int, QVariant> > KFileItemModel::permissionRoleGroups() const
     return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::ratingRoleGroups() const
+QList<QPair<int, QVariant> > KFileItemModel::ratingRoleGroups(int begin, int end) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
     int groupValue = -1;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
-        const int newGroupValue = m_itemData.at(i)->values.value("rating", 0).toInt();
+        const int newGroupValue = static_cast<int>(m_columns.number(RatingRole, m_itemData.at(i)->slot));
         if (newGroupValue != groupValue) {
             groupValue = newGroupValue;
             groups.append(QPair<int, QVariant>(i, newGroupValue));
@@ -2242,20 +3109,37 @@ QList<QPair<int, QVariant> > KFileItemModel::ratingRoleGroups() const
     return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::genericStringRoleGroups(const QByteArray& role) const
+QList<QPair<int, QVariant> > KFileItemModel::genericStringRoleGroups(int begin, int end, const QByteArray& role) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    Q_ASSERT(begin >= 0 && end <= count());
 
-    const int maxIndex = count() - 1;
     QList<QPair<int, QVariant> > groups;
 
+    // The values of string roles are stored in m_columns. Numeric roles
+    // are grouped by the string representation of the original value.
+    bool useColumn = false;
+    switch (m_sortRole) {
+    case WidthRole:
+    case HeightRole:
+    case WordCountRole:
+    case LineCountRole:
+    case TrackRole:
+    case ReleaseYearRole:
+        break;
+    default:
+        useColumn = true;
+        break;
+    }
+
     bool isFirstGroupValue = true;
     QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
-        const QString newGroupValue = m_itemData.at(i)->values.value(role).toString();
+        const ItemData* itemData = m_itemData.at(i);
+        const QString newGroupValue = useColumn ? m_columns.string(m_sortRole, itemData->slot)
+                                                : itemData->values.value(role).toString();
         if (newGroupValue != groupValue || isFirstGroupValue) {
             groupValue = newGroupValue;
             groups.append(QPair<int, QVariant>(i, newGroupValue));
@@ -2277,9 +3161,8 @@ void KFileItemModel::emitSortProgress(int resolvedCount)
     const int itemCount = count();
     if (resolvedCount >= itemCount) {
         m_sortingProgressPercent = -1;
-        if (m_resortAllItemsTimer->isActive()) {
-            m_resortAllItemsTimer->stop();
-            resortAllItems();
+        if (m_resortPendingItemsTimer->isActive()) {
+            resortPendingItems();
         }
 
         emit directorySortingProgress(100);
@@ -2337,28 +3220,6 @@ const KFileItemModel::RoleInfoMap* KFileItemModel::rolesInfoMap(int& count)
     return rolesInfoMap;
 }
 
-void KFileItemModel::determineMimeTypes(const KFileItemList& items, int timeout)
-{
-    QElapsedTimer timer;
-    timer.start();
-    foreach (const KFileItem& item, items) { // krazy:exclude=foreach
-        // Only determine mime types for files here. For directories,
-        // KFileItem::determineMimeType() reads the .directory file inside to
-        // load the icon, but this is not necessary at all if we just need the
-        // type. Some special code for setting the correct mime type for
-        // directories is in retrieveData().
-        if (!item.isDir()) {
-            item.determineMimeType();
-        }
-
-        if (timer.elapsed() > timeout) {
-            // Don't block the user interface, let the remaining items
-            // be resolved asynchronously.
-            return;
-        }
-    }
-}
-
 QByteArray KFileItemModel::sharedValue(const QByteArray& value)
 {
     static QSet<QByteArray> pool;
@@ -2374,9 +3235,8 @@ QByteArray KFileItemModel::sharedValue(const QByteArray& value)
 
 bool KFileItemModel::isConsistent() const
 {
-    // m_items may contain less items than m_itemData because m_items
-    // is populated lazily, see KFileItemModel::index(const QUrl& url).
-    if (m_items.count() > m_itemData.count()) {
+    if (m_items.count() != m_itemData.count()) {
+        qCWarning(DolphinDebug) << "m_items contains" << m_items.count() << "items, but m_itemData contains" << m_itemData.count() << "items";
         return false;
     }
 
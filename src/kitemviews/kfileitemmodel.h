@@ -23,16 +23,21 @@
 #include "dolphin_export.h"
 #include "kitemviews/kitemmodelbase.h"
 #include "kitemviews/private/kfileitemmodelfilter.h"
+#include "kitemviews/private/kfileitemmodelrolecolumns.h"
+#include "kitemviews/private/kobjectpool.h"
 
 #include <KFileItem>
 
 #include <QCollator>
 #include <QHash>
+#include <QMap>
+#include <QScopedPointer>
 #include <QSet>
 #include <QUrl>
 
 #include <functional>
 
+class KFileItemMimeTypeResolver;
 class KFileItemModelDirLister;
 class QTimer;
 
@@ -86,6 +91,15 @@ public:
     QHash<QByteArray, QVariant> data(int index) const override;
     bool setData(int index, const QHash<QByteArray, QVariant>& values) override;
 
+    /**
+     * Sets the values for several items at once. The keys of \a values are
+     * the indexes of the items. In contrast to calling setData(int, const QHash&)
+     * for each item, only one itemsChanged() signal is emitted for all changed
+     * items, and it is checked only once whether a resorting is required.
+     * @return True if the value of at least one item has been changed.
+     */
+    bool setData(const QMap<int, QHash<QByteArray, QVariant> >& values);
+
     /**
      * Sets a separate sorting with directories first (true) or a mixed
      * sorting of files and directories (false).
@@ -127,6 +141,23 @@ public:
      */
     KFileItem fileItem(const QUrl& url) const;
 
+    /**
+     * Replaces the file-item for the index \a index by \a item, which must
+     * have the same URL. Is invoked by KFileItemModelRolesUpdater to take over
+     * the MIME type that has been determined for a copy of the file-item in a
+     * worker thread. No signal is emitted, as the values of the item are not
+     * changed.
+     */
+    void setFileItem(int index, const KFileItem& item);
+
+    /**
+     * Provides the number of files and folders and the total size of the
+     * files of all items in the model. The values are updated incrementally
+     * whenever items are inserted, removed or refreshed, so the runtime
+     * complexity of this call is O(1).
+     */
+    void itemStatistics(int& fileCount, int& folderCount, KIO::filesize_t& totalFileSize) const;
+
     /**
      * @return The index for the file-item \a item. -1 is returned if no file-item
      *         is found or if the file-item is null. The amortized runtime
@@ -270,6 +301,15 @@ private slots:
      */
     void resortAllItems();
 
+    /**
+     * Moves the items from m_pendingItemsToResort to their correct
+     * positions by binary searching them in the remaining items, which
+     * are still sorted. Falls back to resortAllItems() if most of the
+     * items must be moved or if an expanded item must be moved together
+     * with its children.
+     */
+    void resortPendingItems();
+
     void slotCompleted();
     void slotCanceled();
     void slotItemsAdded(const QUrl& directoryUrl, const KFileItemList& items);
@@ -278,6 +318,12 @@ private slots:
     void slotClear();
     void slotSortingChoiceChanged();
 
+    /**
+     * Adds the items whose MIME types have been determined by
+     * m_mimeTypeResolver to the model.
+     */
+    void slotMimeTypesResolved(const QUrl& directoryUrl, const KFileItemList& items);
+
     void dispatchPendingItemsToInsert();
 
 private:
@@ -300,6 +346,18 @@ private:
         KFileItem item;
         QHash<QByteArray, QVariant> values;
         ItemData* parent;
+        // Collation key of item.text(). It is only available if natural
+        // sorting is enabled, see KFileItemModel::updateSortKey().
+        QScopedPointer<QCollatorSortKey> sortKey;
+        // Case folded item.text(), which is used for the name filter
+        // and the keyboard search.
+        QString foldedText;
+        // Index of the item in the columns of KFileItemModel::m_columns.
+        int slot;
+        // Position of the item in KFileItemModel::m_itemData. It is updated
+        // whenever the item is moved, which happens anyway when inserting or
+        // removing items in front of it.
+        int index;
     };
 
     enum RemoveItemsBehavior {
@@ -307,6 +365,12 @@ private:
         DeleteItemData
     };
 
+    enum FilterScope {
+        AllItems,       // Check the shown and the filtered items.
+        ShownItems,     // Only check the shown items, the filter got more restrictive.
+        FilteredItems   // Only check the filtered items, the filter got less restrictive.
+    };
+
     void insertItems(QList<ItemData*>& items);
     void removeItems(const KItemRangeList& itemRanges, RemoveItemsBehavior behavior);
 
@@ -314,25 +378,117 @@ private:
      * Helper method for insertItems() and removeItems(): Creates
      * a list of ItemData elements based on the given items.
      * Note that the ItemData instances are created dynamically and
-     * must be deleted by the caller.
+     * must be deleted by the caller with deleteItemData().
+     */
+    QList<ItemData*> createItemDataList(const QUrl& parentUrl, const KFileItemList& items);
+
+    /**
+     * Adds the items \a items of the directory \a directoryUrl to
+     * m_pendingItemsToInsert or m_filteredItems.
+     */
+    void addItems(const QUrl& directoryUrl, const KFileItemList& items);
+
+    /**
+     * Deletes the item-data \a data and releases its slot in m_columns.
      */
-    QList<ItemData*> createItemDataList(const QUrl& parentUrl, const KFileItemList& items) const;
+    void deleteItemData(ItemData* data);
+
+    /**
+     * Updates ItemData::index for the items between \a first and \a last,
+     * which have been moved within this range.
+     * @return List movedToIndexes as required by the signal itemsMoved():
+     *         movedToIndexes[i] is the new index of the item with the old
+     *         index first + i.
+     */
+    QList<int> updateMovedIndexes(int first, int last);
+
+    /**
+     * Removes \a data from m_items, which must be done before the URL
+     * of the item is changed or the item is removed from m_itemData.
+     */
+    void removeItemFromHash(const ItemData* data);
+
+    /**
+     * Adds the item \a item to the statistics returned by itemStatistics() if
+     * \a sign is 1, or removes it from the statistics if \a sign is -1.
+     */
+    void updateItemStatistics(const KFileItem& item, int sign);
+
+    /**
+     * Builds m_keyboardSearchIndex if it has been invalidated.
+     */
+    void updateKeyboardSearchIndex() const;
+
+    /**
+     * Adds the items \a items, which must have valid indexes already,
+     * to m_keyboardSearchIndex and m_keyboardSearchBlocks.
+     */
+    void addToKeyboardSearchIndex(const QList<ItemData*>& items);
+
+    /**
+     * Removes the items of the ranges \a itemRanges from m_keyboardSearchIndex
+     * and m_keyboardSearchBlocks. Must be called before the indexes of the
+     * remaining items are changed.
+     */
+    void removeFromKeyboardSearchIndex(const KItemRangeList& itemRanges);
+
+    /**
+     * @return Items whose case folded names start with \a foldedText,
+     *         ordered by their index.
+     */
+    QVector<const ItemData*> keyboardSearchBlock(const QString& foldedText) const;
 
     /**
      * Prepares the items for sorting. Normally, the hash 'values' in ItemData is filled
      * lazily to save time and memory, but for some sort roles, it is expected that the
-     * sort role data is stored in 'values'.
+     * sort role data is stored in 'values'. If natural sorting is enabled, the
+     * collation keys of the items are created too.
      */
     void prepareItemsForSorting(QList<ItemData*>& itemDataList);
 
+    /**
+     * (Re-)creates the collation key ItemData::sortKey for the text of the
+     * item if natural sorting is enabled. Must be invoked each time the text
+     * of the item has been changed.
+     */
+    void updateSortKey(ItemData* data) const;
+
+    /**
+     * Recreates the collation keys of all items. Must be invoked if the
+     * sorting settings have been changed.
+     */
+    void updateSortKeys();
+
+    /**
+     * Stores the value of the sort role of \a data in the typed column
+     * of m_columns, which is used by sortRoleCompare() and the
+     * xxxRoleGroups() methods. Must be invoked each time the item or
+     * the sort role value in ItemData::values has been changed.
+     */
+    void updateSortValue(ItemData* data);
+
+    /**
+     * Fills the column of the sort role for all items of the model.
+     */
+    void updateSortValues();
+
     static int expandedParentsCount(const ItemData* data);
 
     void removeExpandedItems();
 
+    /**
+     * Helper method for setData(): Stores the values for the item with the
+     * index \a index. The values of roles which are not contained in
+     * \a values are kept.
+     * @return Roles whose values have been changed.
+     */
+    QSet<QByteArray> storeValues(int index, const QHash<QByteArray, QVariant>& values);
+
     /**
      * This function is called by setData() and slotRefreshItems(). It emits
      * the itemsChanged() signal, checks if the sort order is still correct,
-     * and starts m_resortAllItemsTimer if that is not the case.
+     * and adds the items to m_pendingItemsToResort and starts
+     * m_resortPendingItemsTimer if that is not the case.
      */
     void emitItemsChangedAndTriggerResorting(const KItemRangeList& itemRanges, const QSet<QByteArray>& changedRoles);
 
@@ -355,12 +511,6 @@ private:
 
     QHash<QByteArray, QVariant> retrieveData(const KFileItem& item, const ItemData* parent) const;
 
-    /**
-     * @return True if \a a has a KFileItem whose text is 'less than' the one
-     *         of \a b according to QString::operator<(const QString&).
-     */
-    static bool nameLessThan(const ItemData* a, const ItemData* b);
-
     /**
      * @return True if the item-data \a a should be ordered before the item-data
      *         \b. The item-data may have different parent-items.
@@ -382,14 +532,54 @@ private:
 
     int stringCompare(const QString& a, const QString& b, const QCollator& collator) const;
 
+    /**
+     * Compares the texts of the passed item-data. If natural sorting is enabled,
+     * the precomputed collation keys are compared, which is much faster than
+     * calling QCollator::compare().
+     */
+    int nameCompare(const ItemData* a, const ItemData* b, const QCollator& collator) const;
+
     bool useMaximumUpdateInterval() const;
 
-    QList<QPair<int, QVariant> > nameRoleGroups() const;
-    QList<QPair<int, QVariant> > sizeRoleGroups() const;
-    QList<QPair<int, QVariant> > timeRoleGroups(const std::function<QDateTime(const ItemData *)> &fileTimeCb) const;
-    QList<QPair<int, QVariant> > permissionRoleGroups() const;
-    QList<QPair<int, QVariant> > ratingRoleGroups() const;
-    QList<QPair<int, QVariant> > genericStringRoleGroups(const QByteArray& typeForRole) const;
+    /**
+     * @return Groups for the items between the indexes \a begin and \a end
+     *         (exclusive). Calls the xxxRoleGroups() method for the
+     *         current sort role.
+     */
+    QList<QPair<int, QVariant> > roleGroups(int begin, int end) const;
+
+    QList<QPair<int, QVariant> > nameRoleGroups(int begin, int end) const;
+    QList<QPair<int, QVariant> > sizeRoleGroups(int begin, int end) const;
+    QList<QPair<int, QVariant> > timeRoleGroups(int begin, int end, const std::function<QDateTime(const ItemData *)> &fileTimeCb) const;
+    QList<QPair<int, QVariant> > permissionRoleGroups(int begin, int end) const;
+    QList<QPair<int, QVariant> > ratingRoleGroups(int begin, int end) const;
+    QList<QPair<int, QVariant> > genericStringRoleGroups(int begin, int end, const QByteArray& typeForRole) const;
+
+    /**
+     * Recalculates the group boundaries for the items of the ranges \a itemRanges,
+     * which must be sorted by their indexes. The groups of all other items must be
+     * valid already. As the group of an item only depends on its own values and
+     * the values of its predecessor, only the items in the ranges and the
+     * adjacent items are inspected. A range may be empty to update the boundary
+     * between two items, e.g., after removing the items between them.
+     * Does nothing if the groups have not been calculated yet.
+     * @return True if m_groups has been changed.
+     */
+    bool updateGroups(const KItemRangeList& itemRanges);
+
+    /**
+     * Updates m_groups after the items \a itemRanges have been inserted
+     * into m_itemData. The ranges refer to the indexes before the insertion
+     * like in the signal itemsInserted().
+     */
+    void updateGroupsAfterInsertion(const KItemRangeList& itemRanges);
+
+    /**
+     * Updates m_groups after the items \a itemRanges have been removed
+     * from m_itemData. The ranges refer to the indexes before the removal
+     * like in the signal itemsRemoved().
+     */
+    void updateGroupsAfterRemoval(const KItemRangeList& itemRanges);
 
     /**
      * Helper method for all xxxRoleGroups() methods to check whether the
@@ -409,8 +599,22 @@ private:
 
     /**
      * Applies the filters set through @ref setNameFilter and @ref setMimeTypeFilters.
+     * Only the items given by \a scope are checked.
+     */
+    void applyFilters(FilterScope scope = AllItems);
+
+    /**
+     * @return For each item of \a items whether it matches m_filter. The
+     *         items are checked in parallel by several threads if possible.
      */
-    void applyFilters();
+    QVector<bool> matchFilter(const QList<ItemData*>& items) const;
+
+    /**
+     * @return For the items of \a items from \a first to \a last whether
+     *         they match \a filter. Is invoked by matchFilter() in worker threads.
+     */
+    static QVector<bool> matchFilterRange(const KFileItemModelFilter* filter, const QList<ItemData*>* items,
+                                          int first, int last);
 
     /**
      * Removes filtered items whose expanded parents have been deleted
@@ -444,12 +648,6 @@ private:
      */
     static const RoleInfoMap* rolesInfoMap(int& count);
 
-    /**
-     * Determines the MIME-types of all items that can be done within
-     * the given timeout.
-     */
-    static void determineMimeTypes(const KFileItemList& items, int timeout);
-
     /**
      * @return Returns a copy of \a value that is implicitly shared
      * with other users to save memory.
@@ -464,6 +662,12 @@ private:
 private:
     KFileItemModelDirLister* m_dirLister;
 
+    // Determines the MIME types of new items in worker threads if the
+    // items are sorted by type. The completed() signal of the dir lister
+    // is handled after all items have been resolved, see m_completedPending.
+    KFileItemMimeTypeResolver* m_mimeTypeResolver;
+    bool m_completedPending;
+
     QCollator m_collator;
     bool m_naturalSorting;
     bool m_sortDirsFirst;
@@ -472,13 +676,23 @@ private:
     int m_sortingProgressPercent; // Value of directorySortingProgress() signal
     QSet<QByteArray> m_roles;
 
+    // Allocates all ItemData instances. Items that are loaded together
+    // are stored next to each other in memory that way.
+    KObjectPool<ItemData> m_itemDataPool;
     QList<ItemData*> m_itemData;
 
-    // m_items is a cache for the method index(const QUrl&). If it contains N
-    // entries, it is guaranteed that these correspond to the first N items in
-    // the model, i.e., that (for every i between 0 and N - 1)
-    // m_items.value(fileItem(i).url()) == i
-    mutable QHash<QUrl, int> m_items;
+    // Typed values of the sort role for all items, see updateSortValue().
+    KFileItemModelRoleColumns m_columns;
+
+    // m_items is used by the method index(const QUrl&). It contains all items
+    // of m_itemData, and is updated when items are inserted, removed or renamed.
+    // The index of an item is stored in ItemData::index.
+    QHash<QUrl, ItemData*> m_items;
+
+    // Statistics of all items of m_itemData, see itemStatistics().
+    int m_fileCount;
+    int m_folderCount;
+    KIO::filesize_t m_totalFileSize;
 
     KFileItemModelFilter m_filter;
     QHash<KFileItem, ItemData*> m_filteredItems; // Items that got hidden by KFileItemModel::setNameFilter()
@@ -486,10 +700,15 @@ private:
     bool m_requestRole[RolesCount];
 
     QTimer* m_maximumUpdateIntervalTimer;
-    QTimer* m_resortAllItemsTimer;
+    QTimer* m_resortPendingItemsTimer;
     QList<ItemData*> m_pendingItemsToInsert;
 
-    // Cache for KFileItemModel::groups()
+    // Items that are not at their correct position anymore because the value
+    // of the sort role has changed. All other items of m_itemData are sorted.
+    QSet<ItemData*> m_pendingItemsToResort;
+
+    // Cache for KFileItemModel::groups(). Once calculated, it is updated
+    // incrementally if items are inserted, removed, moved or changed.
     mutable QList<QPair<int, QVariant> > m_groups;
 
     // Stores the URLs (key: target url, value: url) of the expanded directories.
@@ -499,19 +718,34 @@ private:
     // and done step after step in slotCompleted().
     QSet<QUrl> m_urlsToExpand;
 
+    // Case folded names of all items of m_itemData, sorted by the name. Used by
+    // indexForKeyboardSearch() to find the items starting with a text by a
+    // binary search. The index is built on demand after loading a directory and
+    // updated when items are inserted, removed or renamed.
+    struct KeyboardSearchEntry
+    {
+        QString foldedText;
+        const ItemData* itemData;
+        bool operator<(const KeyboardSearchEntry& other) const { return foldedText < other.foldedText; }
+    };
+    mutable QVector<KeyboardSearchEntry> m_keyboardSearchIndex;
+    mutable bool m_keyboardSearchIndexDirty;
+
+    // The items matching the recently searched texts, ordered by their index.
+    // Allows to find the next match after the current item by a binary search.
+    // The blocks are updated when items are inserted or removed, and discarded
+    // when items are moved.
+    mutable QHash<QString, QVector<const ItemData*> > m_keyboardSearchBlocks;
+
     friend class KFileItemModelRolesUpdater;   // Accesses emitSortProgress() method
     friend class KFileItemModelTest;           // For unit testing
     friend class KFileItemModelBenchmark;      // For unit testing
     friend class KFileItemListViewTest;        // For unit testing
+    friend class KItemListViewBenchmark;       // For unit testing
+    friend class DolphinViewTest;              // For unit testing
     friend class DolphinPart;                  // Accesses m_dirLister
 };
 
-inline bool KFileItemModel::nameLessThan(const ItemData* a, const ItemData* b)
-{
-    return a->item.text() < b->item.text();
-}
-
-
 inline bool KFileItemModel::isChildItem(int index) const
 {
     if (m_itemData.at(index)->parent) {
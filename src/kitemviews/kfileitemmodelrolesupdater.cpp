@@ -19,8 +19,10 @@
 
 #include "kfileitemmodelrolesupdater.h"
 
+#include "dolphindebug.h"
 #include "kfileitemmodel.h"
 #include "private/kdirectorycontentscounter.h"
+#include "private/kfileitempreviewcache.h"
 #include "private/kpixmapmodifier.h"
 
 #include <KConfig>
@@ -35,23 +37,22 @@
 
 #ifdef HAVE_BALOO
 #include "private/kbaloorolesprovider.h"
-#include <Baloo/File>
 #include <Baloo/FileMonitor>
 #endif
 
 #include <QApplication>
+#include <QFutureWatcher>
+#include <QMap>
 #include <QPainter>
-#include <QElapsedTimer>
+#include <QPixmapCache>
+#include <QThread>
 #include <QTimer>
+#include <QtConcurrentRun>
 
 
 // #define KFILEITEMMODELROLESUPDATER_DEBUG
 
 namespace {
-    // Maximum time in ms that the KFileItemModelRolesUpdater
-    // may perform a blocking operation
-    const int MaxBlockTimeout = 200;
-
     // If the number of items is smaller than ResolveAllItemsLimit,
     // the roles of all items will be resolved.
     const int ResolveAllItemsLimit = 500;
@@ -59,6 +60,83 @@ namespace {
     // Not only the visible area, but up to ReadAheadPages before and after
     // this area will be resolved.
     const int ReadAheadPages = 5;
+
+    // Maximum number of items that are passed to one preview job. Small jobs
+    // allow to reprioritize the remaining items quickly if the visible area
+    // changes.
+    const int MaxPreviewItemsPerJob = 20;
+
+    // Maximum number of items whose roles are resolved by one request to
+    // the worker thread.
+    const int ResolveRolesBatchSize = 100;
+
+    // Default maximum memory of the previews that have been applied to the model
+    // and of the KFileItemPreviewCache
+    const qint64 DefaultPreviewMemoryBudget = 256 * 1024 * 1024;
+
+    // The KFileItemPreviewCache may use 1 / PreviewCacheBudgetDivisor of the budget
+    const int PreviewCacheBudgetDivisor = 4;
+
+    // Maximum number of preview jobs, and of previews that are scaled
+    // in worker threads, that run at the same time
+    int maximumPreviewTasks()
+    {
+        return qMax(1, QThread::idealThreadCount());
+    }
+
+    KFileItemList determineMimeTypes(const KFileItemList& items)
+    {
+        foreach (const KFileItem& item, items) {
+            item.determineMimeType();
+        }
+        return items;
+    }
+
+    // Scales the unmodified preview \a preview for the icon size \a iconSize
+    // and adds a frame if required. Is invoked in a worker thread.
+    QImage createPreviewImage(const QImage& preview, const QSize& iconSize, qreal dpr, bool enlargeSmallPreviews)
+    {
+        QImage image = preview;
+
+        if (!image.hasAlphaChannel()
+            && iconSize.width()  > KIconLoader::SizeSmallMedium
+            && iconSize.height() > KIconLoader::SizeSmallMedium) {
+            if (enlargeSmallPreviews) {
+                KPixmapModifier::applyFrame(image, iconSize, dpr);
+            } else {
+                // Assure that small previews don't get enlarged. Instead they
+                // should be shown centered within the frame.
+                const QSize contentSize = KPixmapModifier::sizeInsideFrame(iconSize);
+                const bool enlargingRequired = image.width()  < contentSize.width() &&
+                                               image.height() < contentSize.height();
+                if (enlargingRequired) {
+                    QSize frameSize = image.size() / image.devicePixelRatio();
+                    frameSize.scale(iconSize, Qt::KeepAspectRatio);
+
+                    QImage largeFrame(frameSize, QImage::Format_ARGB32_Premultiplied);
+                    largeFrame.fill(Qt::transparent);
+
+                    KPixmapModifier::applyFrame(largeFrame, frameSize, dpr);
+
+                    QPainter painter(&largeFrame);
+                    painter.drawImage((largeFrame.width()  - image.width() / image.devicePixelRatio()) / 2,
+                                      (largeFrame.height() - image.height() / image.devicePixelRatio()) / 2,
+                                      image);
+                    painter.end();
+                    image = largeFrame;
+                } else {
+                    // The image must be shrunk as it is too large to fit into
+                    // the available icon size
+                    KPixmapModifier::applyFrame(image, iconSize, dpr);
+                }
+            }
+        } else {
+            KPixmapModifier::scale(image, iconSize * dpr);
+            image.setDevicePixelRatio(dpr);
+        }
+
+        return image;
+    }
 }
 
 KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QObject* parent) :
@@ -71,6 +149,10 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     m_enlargeSmallPreviews(true),
     m_clearPreviews(false),
     m_finishedItems(),
+    m_residentPreviews(),
+    m_previewUseCounter(0),
+    m_previewMemoryUsage(0),
+    m_previewMemoryBudget(DefaultPreviewMemoryBudget),
     m_model(model),
     m_iconSize(),
     m_firstVisibleIndex(0),
@@ -80,13 +162,20 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     m_resolvableRoles(),
     m_enabledPlugins(),
     m_pendingSortRoleItems(),
+    m_pendingSortRoleDirectories(),
     m_pendingIndexes(),
     m_pendingPreviewItems(),
-    m_previewJob(),
+    m_previewJobs(),
+    m_mimeTypeWatchers(),
+    m_previewImageWatchers(),
+    m_pendingPreviewImages(),
+    m_previewItemsInProgress(),
     m_recentlyChangedItemsTimer(nullptr),
     m_recentlyChangedItems(),
     m_changedItems(),
-    m_directoryContentsCounter(nullptr)
+    m_directoryContentsCounter(nullptr),
+    m_rolesResolverWorker(nullptr),
+    m_rolesResolverIsBusy(false)
   #ifdef HAVE_BALOO
   , m_balooFileMonitor(nullptr)
   #endif
@@ -125,6 +214,20 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     connect(m_directoryContentsCounter, &KDirectoryContentsCounter::result,
             this,                       &KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived);
 
+    if (!m_rolesResolverThread) {
+        m_rolesResolverThread = new QThread();
+        m_rolesResolverThread->start();
+    }
+
+    m_rolesResolverWorker = new KFileItemRolesResolverWorker();
+    m_rolesResolverWorker->moveToThread(m_rolesResolverThread);
+    ++m_rolesResolverWorkersCount;
+
+    connect(this,                  &KFileItemModelRolesUpdater::requestRolesResolving,
+            m_rolesResolverWorker, &KFileItemRolesResolverWorker::resolveRoles);
+    connect(m_rolesResolverWorker, &KFileItemRolesResolverWorker::result,
+            this,                  &KFileItemModelRolesUpdater::slotRolesResolved);
+
     auto plugins = KPluginLoader::instantiatePlugins(QStringLiteral("kf5/overlayicon"), nullptr, qApp);
     foreach (QObject *it, plugins) {
         auto plugin = qobject_cast<KOverlayIconPlugin*>(it);
@@ -141,6 +244,21 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
 KFileItemModelRolesUpdater::~KFileItemModelRolesUpdater()
 {
     killPreviewJob();
+
+    --m_rolesResolverWorkersCount;
+
+    if (m_rolesResolverWorkersCount > 0) {
+        // The worker thread might be resolving roles for m_rolesResolverWorker
+        // at the moment, so it is deleted using deleteLater().
+        m_rolesResolverWorker->deleteLater();
+    } else {
+        m_rolesResolverThread->quit();
+        m_rolesResolverThread->wait();
+        delete m_rolesResolverThread;
+        m_rolesResolverThread = nullptr;
+
+        delete m_rolesResolverWorker;
+    }
 }
 
 void KFileItemModelRolesUpdater::setIconSize(const QSize& size)
@@ -152,6 +270,7 @@ void KFileItemModelRolesUpdater::setIconSize(const QSize& size)
         } else if (m_previewShown) {
             // An icon size change requires the regenerating of
             // all previews
+            killPreviewJob();
             m_finishedItems.clear();
             startUpdating();
         }
@@ -180,6 +299,18 @@ void KFileItemModelRolesUpdater::setVisibleIndexRange(int index, int count)
     m_firstVisibleIndex = index;
     m_lastVisibleIndex = qMin(index + count - 1, m_model->count() - 1);
 
+    m_directoryContentsCounter->setVisibleIndexRange(index, count);
+
+    // Remember that the previews of the visible items have been used
+    if (!m_residentPreviews.isEmpty()) {
+        for (int i = m_firstVisibleIndex; i <= m_lastVisibleIndex; ++i) {
+            auto it = m_residentPreviews.find(m_model->fileItem(i));
+            if (it != m_residentPreviews.end()) {
+                it->lastUse = ++m_previewUseCounter;
+            }
+        }
+    }
+
     startUpdating();
 }
 
@@ -197,6 +328,8 @@ void KFileItemModelRolesUpdater::setPreviewsShown(bool show)
     m_previewShown = show;
     if (!show) {
         m_clearPreviews = true;
+        m_residentPreviews.clear();
+        m_previewMemoryUsage = 0;
     }
 
     updateAllPreviews();
@@ -222,10 +355,36 @@ bool KFileItemModelRolesUpdater::enlargeSmallPreviews() const
     return m_enlargeSmallPreviews;
 }
 
+void KFileItemModelRolesUpdater::setPreviewMemoryBudget(qint64 bytes)
+{
+    if (bytes != m_previewMemoryBudget) {
+        m_previewMemoryBudget = bytes;
+
+        // The cache is shared by all views, which use the same budget
+        const qint64 budget = (bytes > 0) ? bytes : DefaultPreviewMemoryBudget;
+        KFileItemPreviewCache::instance()->setMaximumSize(budget / PreviewCacheBudgetDivisor);
+
+        evictPreviews();
+        emit previewMemoryUsageChanged();
+    }
+}
+
+qint64 KFileItemModelRolesUpdater::previewMemoryBudget() const
+{
+    return m_previewMemoryBudget;
+}
+
+qint64 KFileItemModelRolesUpdater::previewMemoryUsage() const
+{
+    return m_previewMemoryUsage + KFileItemPreviewCache::instance()->size();
+}
+
 void KFileItemModelRolesUpdater::setEnabledPlugins(const QStringList& list)
 {
     if (m_enabledPlugins != list) {
         m_enabledPlugins = list;
+        // The cached previews might have been created by other plugins
+        KFileItemPreviewCache::instance()->clear();
         if (m_previewShown) {
             updateAllPreviews();
         }
@@ -320,29 +479,22 @@ QStringList KFileItemModelRolesUpdater::enabledPlugins() const
 
 void KFileItemModelRolesUpdater::slotItemsInserted(const KItemRangeList& itemRanges)
 {
-    QElapsedTimer timer;
-    timer.start();
-
-    // Determine the sort role synchronously for as many items as possible.
+    // The sort role is determined asynchronously, so that inserting a
+    // large number of items never blocks the GUI thread.
     if (m_resolvableRoles.contains(m_model->sortRole())) {
         int insertedCount = 0;
         foreach (const KItemRange& range, itemRanges) {
             const int lastIndex = insertedCount + range.index + range.count - 1;
             for (int i = insertedCount + range.index; i <= lastIndex; ++i) {
-                if (timer.elapsed() < MaxBlockTimeout) {
-                    applySortRole(i);
-                } else {
-                    m_pendingSortRoleItems.insert(m_model->fileItem(i));
-                }
+                m_pendingSortRoleItems.insert(m_model->fileItem(i));
             }
             insertedCount += range.count;
         }
 
         applySortProgressToModel();
 
-        // If there are still items whose sort role is unknown, check if the
-        // asynchronous determination of the sort role is already in progress,
-        // and start it if that is not the case.
+        // Check if the asynchronous determination of the sort role is
+        // already in progress, and start it if that is not the case.
         if (!m_pendingSortRoleItems.isEmpty() && m_state != ResolvingSortRole) {
             killPreviewJob();
             m_state = ResolvingSortRole;
@@ -381,16 +533,19 @@ void KFileItemModelRolesUpdater::slotItemsRemoved(const KItemRangeList& itemRang
 
         m_finishedItems.clear();
         m_pendingSortRoleItems.clear();
+        m_pendingSortRoleDirectories.clear();
         m_pendingIndexes.clear();
         m_pendingPreviewItems.clear();
         m_recentlyChangedItems.clear();
         m_recentlyChangedItemsTimer->stop();
         m_changedItems.clear();
+        m_residentPreviews.clear();
+        m_previewMemoryUsage = 0;
 
         killPreviewJob();
     } else {
-        // Only remove the items from m_finishedItems. They will be removed
-        // from the other sets later on.
+        // Only remove the items from m_finishedItems and m_residentPreviews.
+        // They will be removed from the other sets later on.
         QSet<KFileItem>::iterator it = m_finishedItems.begin();
         while (it != m_finishedItems.end()) {
             if (m_model->index(*it) < 0) {
@@ -400,6 +555,31 @@ void KFileItemModelRolesUpdater::slotItemsRemoved(const KItemRangeList& itemRang
             }
         }
 
+        auto previewIt = m_residentPreviews.begin();
+        while (previewIt != m_residentPreviews.end()) {
+            if (m_model->index(previewIt.key()) < 0) {
+                m_previewMemoryUsage -= previewIt->bytes;
+                previewIt = m_residentPreviews.erase(previewIt);
+            } else {
+                ++previewIt;
+            }
+        }
+
+        // m_directoryContentsCounter drops the removed directories from its
+        // queue, so no result will be received for them.
+        QSet<QString>::iterator dirIt = m_pendingSortRoleDirectories.begin();
+        while (dirIt != m_pendingSortRoleDirectories.end()) {
+            if (m_model->index(QUrl::fromLocalFile(*dirIt)) < 0) {
+                dirIt = m_pendingSortRoleDirectories.erase(dirIt);
+            } else {
+                ++dirIt;
+            }
+        }
+
+        if (m_state == ResolvingSortRole) {
+            resolveNextSortRole();
+        }
+
         // The visible items might have changed.
         startUpdating();
     }
@@ -450,19 +630,13 @@ void KFileItemModelRolesUpdater::slotSortRoleChanged(const QByteArray& current,
 
     if (m_resolvableRoles.contains(current)) {
         m_pendingSortRoleItems.clear();
+        m_pendingSortRoleDirectories.clear();
         m_finishedItems.clear();
 
         const int count = m_model->count();
-        QElapsedTimer timer;
-        timer.start();
-
-        // Determine the sort role synchronously for as many items as possible.
+        m_pendingSortRoleItems.reserve(count);
         for (int index = 0; index < count; ++index) {
-            if (timer.elapsed() < MaxBlockTimeout) {
-                applySortRole(index);
-            } else {
-                m_pendingSortRoleItems.insert(m_model->fileItem(index));
-            }
+            m_pendingSortRoleItems.insert(m_model->fileItem(index));
         }
 
         applySortProgressToModel();
@@ -476,99 +650,56 @@ void KFileItemModelRolesUpdater::slotSortRoleChanged(const QByteArray& current,
     } else {
         m_state = Idle;
         m_pendingSortRoleItems.clear();
+        m_pendingSortRoleDirectories.clear();
         applySortProgressToModel();
     }
 }
 
-void KFileItemModelRolesUpdater::slotGotPreview(const KFileItem& item, const QPixmap& pixmap)
+void KFileItemModelRolesUpdater::slotGotPreview(const KFileItem& previewItem, const QPixmap& pixmap)
 {
     if (m_state != PreviewJobRunning) {
         return;
     }
 
-    m_changedItems.remove(item);
-
-    const int index = m_model->index(item);
+    // The preview job works on copies of the items whose MIME types have
+    // been determined in a worker thread. Continue with the item of the model.
+    const int index = m_model->index(previewItem);
     if (index < 0) {
         return;
     }
 
-    QPixmap scaledPixmap = pixmap;
-
-    if (!pixmap.hasAlpha()
-        && m_iconSize.width()  > KIconLoader::SizeSmallMedium
-        && m_iconSize.height() > KIconLoader::SizeSmallMedium) {
-        if (m_enlargeSmallPreviews) {
-            KPixmapModifier::applyFrame(scaledPixmap, m_iconSize);
-        } else {
-            // Assure that small previews don't get enlarged. Instead they
-            // should be shown centered within the frame.
-            const QSize contentSize = KPixmapModifier::sizeInsideFrame(m_iconSize);
-            const bool enlargingRequired = scaledPixmap.width()  < contentSize.width() &&
-                                           scaledPixmap.height() < contentSize.height();
-            if (enlargingRequired) {
-                QSize frameSize = scaledPixmap.size() / scaledPixmap.devicePixelRatio();
-                frameSize.scale(m_iconSize, Qt::KeepAspectRatio);
-
-                QPixmap largeFrame(frameSize);
-                largeFrame.fill(Qt::transparent);
-
-                KPixmapModifier::applyFrame(largeFrame, frameSize);
-
-                QPainter painter(&largeFrame);
-                painter.drawPixmap((largeFrame.width()  - scaledPixmap.width() / scaledPixmap.devicePixelRatio()) / 2,
-                                   (largeFrame.height() - scaledPixmap.height() / scaledPixmap.devicePixelRatio()) / 2,
-                                   scaledPixmap);
-                scaledPixmap = largeFrame;
-            } else {
-                // The image must be shrunk as it is too large to fit into
-                // the available icon size
-                KPixmapModifier::applyFrame(scaledPixmap, m_iconSize);
-            }
-        }
-    } else {
-        KPixmapModifier::scale(scaledPixmap, m_iconSize * qApp->devicePixelRatio());
-        scaledPixmap.setDevicePixelRatio(qApp->devicePixelRatio());
-    }
-
-    QHash<QByteArray, QVariant> data = rolesData(item);
+    const KFileItem item = m_model->fileItem(index);
+    m_changedItems.remove(item);
 
-    const QStringList overlays = data["iconOverlays"].toStringList();
-    // Strangely KFileItem::overlays() returns empty string-values, so
-    // we need to check first whether an overlay must be drawn at all.
-    // It is more efficient to do it here, as KIconLoader::drawOverlays()
-    // assumes that an overlay will be drawn and has some additional
-    // setup time.
-    foreach (const QString& overlay, overlays) {
-        if (!overlay.isEmpty()) {
-            // There is at least one overlay, draw all overlays above m_pixmap
-            // and cancel the check
-            KIconLoader::global()->drawOverlays(overlays, scaledPixmap, KIconLoader::Desktop);
+    // The item stays in progress until its preview has been scaled and
+    // framed. Prevent that slotPreviewJobFinished() releases it.
+    for (auto it = m_previewJobs.begin(); it != m_previewJobs.end(); ++it) {
+        if (it.value().removeOne(item)) {
             break;
         }
     }
 
-    data.insert("iconPixmap", scaledPixmap);
+    // Remember the unmodified preview, so that previews for other
+    // icon sizes can be created without starting a preview job.
+    const QImage preview = pixmap.toImage();
+    KFileItemPreviewCache::instance()->insert(item, KFileItemPreviewCache::sizeClass(m_iconSize), preview);
 
-    disconnect(m_model, &KFileItemModel::itemsChanged,
-               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-    m_model->setData(index, data);
-    connect(m_model, &KFileItemModel::itemsChanged,
-            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-
-    m_finishedItems.insert(item);
+    startPreviewImageCreation(item, preview);
 }
 
-void KFileItemModelRolesUpdater::slotPreviewFailed(const KFileItem& item)
+void KFileItemModelRolesUpdater::slotPreviewFailed(const KFileItem& previewItem)
 {
     if (m_state != PreviewJobRunning) {
         return;
     }
 
-    m_changedItems.remove(item);
-
-    const int index = m_model->index(item);
+    const int index = m_model->index(previewItem);
     if (index >= 0) {
+        const KFileItem item = m_model->fileItem(index);
+        m_changedItems.remove(item);
+        m_previewItemsInProgress.remove(item);
+        m_previewMemoryUsage -= m_residentPreviews.take(item).bytes;
+
         QHash<QByteArray, QVariant> data;
         data.insert("iconPixmap", QPixmap());
 
@@ -583,19 +714,23 @@ void KFileItemModelRolesUpdater::slotPreviewFailed(const KFileItem& item)
     }
 }
 
-void KFileItemModelRolesUpdater::slotPreviewJobFinished()
+void KFileItemModelRolesUpdater::slotPreviewJobFinished(KJob* job)
 {
-    m_previewJob = nullptr;
+    // Items for which neither a preview nor a failure has been reported
+    // must be resolved again by a later job.
+    foreach (const KFileItem& item, m_previewJobs.take(job)) {
+        m_previewItemsInProgress.remove(item);
+    }
 
     if (m_state != PreviewJobRunning) {
         return;
     }
 
-    m_state = Idle;
-
     if (!m_pendingPreviewItems.isEmpty()) {
         startPreviewJob();
-    } else {
+    } else if (m_previewJobs.isEmpty() && m_mimeTypeWatchers.isEmpty() && m_previewImageWatchers.isEmpty()) {
+        m_state = Idle;
+
         if (!m_changedItems.isEmpty()) {
             updateChangedItems();
         }
@@ -604,30 +739,46 @@ void KFileItemModelRolesUpdater::slotPreviewJobFinished()
 
 void KFileItemModelRolesUpdater::resolveNextSortRole()
 {
-    if (m_state != ResolvingSortRole) {
+    if (m_state != ResolvingSortRole || m_rolesResolverIsBusy) {
         return;
     }
 
+    const QByteArray& sortRole = m_model->sortRole();
+
+    KFileItemList items;
     QSet<KFileItem>::iterator it = m_pendingSortRoleItems.begin();
-    while (it != m_pendingSortRoleItems.end()) {
+    while (it != m_pendingSortRoleItems.end() && items.count() < ResolveRolesBatchSize) {
         const KFileItem item = *it;
         const int index = m_model->index(item);
 
-        // Continue if the sort role has already been determined for the
-        // item, and the item has not been changed recently.
-        if (!m_changedItems.contains(item) && m_model->data(index).contains(m_model->sortRole())) {
+        // Continue if the item has been removed, or if the sort role has
+        // already been determined for the item and the item has not been
+        // changed recently.
+        if (index < 0 || (!m_changedItems.contains(item) && m_model->data(index).contains(sortRole))) {
             it = m_pendingSortRoleItems.erase(it);
             continue;
         }
 
-        applySortRole(index);
-        m_pendingSortRoleItems.erase(it);
-        break;
+        if (sortRole == "size" && item.isLocalFile() && item.isDir()) {
+            // The contents of local directories are counted asynchronously by
+            // m_directoryContentsCounter, which also watches them for changes.
+            // The result is applied in slotDirectoryContentsCountReceived().
+            const QString path = item.localPath();
+            m_pendingSortRoleDirectories.insert(path);
+            m_directoryContentsCounter->addDirectory(path);
+            it = m_pendingSortRoleItems.erase(it);
+            continue;
+        }
+
+        items.append(item);
+        ++it;
     }
 
-    if (!m_pendingSortRoleItems.isEmpty()) {
+    if (!items.isEmpty()) {
+        startRolesResolving(items);
+    } else if (!m_pendingSortRoleDirectories.isEmpty()) {
+        // Wait until the remaining directories have been counted.
         applySortProgressToModel();
-        QTimer::singleShot(0, this, &KFileItemModelRolesUpdater::resolveNextSortRole);
     } else {
         m_state = Idle;
 
@@ -643,26 +794,22 @@ void KFileItemModelRolesUpdater::resolveNextSortRole()
 
 void KFileItemModelRolesUpdater::resolveNextPendingRoles()
 {
-    if (m_state != ResolvingAllRoles) {
+    if (m_state != ResolvingAllRoles || m_rolesResolverIsBusy) {
         return;
     }
 
-    while (!m_pendingIndexes.isEmpty()) {
+    KFileItemList items;
+    while (!m_pendingIndexes.isEmpty() && items.count() < ResolveRolesBatchSize) {
         const int index = m_pendingIndexes.takeFirst();
         const KFileItem item = m_model->fileItem(index);
 
-        if (m_finishedItems.contains(item)) {
-            continue;
+        if (!item.isNull() && !m_finishedItems.contains(item)) {
+            items.append(item);
         }
-
-        applyResolvedRoles(index, ResolveAll);
-        m_finishedItems.insert(item);
-        m_changedItems.remove(item);
-        break;
     }
 
-    if (!m_pendingIndexes.isEmpty()) {
-        QTimer::singleShot(0, this, &KFileItemModelRolesUpdater::resolveNextPendingRoles);
+    if (!items.isEmpty()) {
+        startRolesResolving(items);
     } else {
         m_state = Idle;
 
@@ -672,13 +819,16 @@ void KFileItemModelRolesUpdater::resolveNextPendingRoles()
                 QHash<QByteArray, QVariant> data;
                 data.insert("iconPixmap", QPixmap());
 
-                disconnect(m_model, &KFileItemModel::itemsChanged,
-                           this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-                for (int index = 0; index <= m_model->count(); ++index) {
+                QMap<int, QHash<QByteArray, QVariant> > values;
+                for (int index = 0; index < m_model->count(); ++index) {
                     if (m_model->data(index).contains("iconPixmap")) {
-                        m_model->setData(index, data);
+                        values.insert(index, data);
                     }
                 }
+
+                disconnect(m_model, &KFileItemModel::itemsChanged,
+                           this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+                m_model->setData(values);
                 connect(m_model, &KFileItemModel::itemsChanged,
                         this,    &KFileItemModelRolesUpdater::slotItemsChanged);
 
@@ -692,6 +842,67 @@ void KFileItemModelRolesUpdater::resolveNextPendingRoles()
     }
 }
 
+void KFileItemModelRolesUpdater::slotRolesResolved(const KFileItemList& items,
+                                                   const QList<QHash<QByteArray, QVariant> >& values)
+{
+    Q_ASSERT(items.count() == values.count());
+    m_rolesResolverIsBusy = false;
+
+    QMap<int, QHash<QByteArray, QVariant> > changedValues;
+
+    for (int i = 0; i < items.count(); ++i) {
+        const KFileItem& resolvedItem = items.at(i);
+        const int index = m_model->index(resolvedItem);
+        if (index < 0) {
+            continue;
+        }
+
+        const KFileItem item = m_model->fileItem(index);
+        if (m_state == ResolvingSortRole) {
+            m_pendingSortRoleItems.remove(item);
+        }
+
+        if (!item.cmp(resolvedItem)) {
+            // The item has been changed while its roles have been resolved. It
+            // will be resolved again by updateChangedItems().
+            continue;
+        }
+
+        // Take over the MIME type that has been determined by the worker thread.
+        m_model->setFileItem(index, resolvedItem);
+
+        QHash<QByteArray, QVariant> data = values.at(i);
+        addGuiThreadRolesData(resolvedItem, data);
+        data.insert("iconName", resolvedItem.iconName());
+        if (m_clearPreviews) {
+            data.insert("iconPixmap", QPixmap());
+        }
+        changedValues.insert(index, data);
+
+        if (!m_previewShown) {
+            m_finishedItems.insert(item);
+            m_changedItems.remove(item);
+        }
+    }
+
+    disconnect(m_model, &KFileItemModel::itemsChanged,
+               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+    m_model->setData(changedValues);
+    connect(m_model, &KFileItemModel::itemsChanged,
+            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+
+    switch (m_state) {
+    case ResolvingSortRole:
+        resolveNextSortRole();
+        break;
+    case ResolvingAllRoles:
+        resolveNextPendingRoles();
+        break;
+    default:
+        break;
+    }
+}
+
 void KFileItemModelRolesUpdater::resolveRecentlyChangedItems()
 {
     m_changedItems += m_recentlyChangedItems;
@@ -718,24 +929,7 @@ void KFileItemModelRolesUpdater::applyChangedBalooRoles(const QString& file)
 void KFileItemModelRolesUpdater::applyChangedBalooRolesForItem(const KFileItem &item)
 {
 #ifdef HAVE_BALOO
-    Baloo::File file(item.localPath());
-    file.load();
-
-    const KBalooRolesProvider& rolesProvider = KBalooRolesProvider::instance();
-    QHash<QByteArray, QVariant> data;
-
-    foreach (const QByteArray& role, rolesProvider.roles()) {
-        // Overwrite all the role values with an empty QVariant, because the roles
-        // provider doesn't overwrite it when the property value list is empty.
-        // See bug 322348
-        data.insert(role, QVariant());
-    }
-
-    QHashIterator<QByteArray, QVariant> it(rolesProvider.roleValues(file, m_roles));
-    while (it.hasNext()) {
-        it.next();
-        data.insert(it.key(), it.value());
-    }
+    const QHash<QByteArray, QVariant> data = KFileItemRolesResolverWorker::balooRolesData(item, m_roles);
 
     disconnect(m_model, &KFileItemModel::itemsChanged,
                this,    &KFileItemModelRolesUpdater::slotItemsChanged);
@@ -752,7 +946,8 @@ void KFileItemModelRolesUpdater::applyChangedBalooRolesForItem(const KFileItem &
 
 void KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived(const QString& path, int count)
 {
-    const bool getSizeRole = m_roles.contains("size");
+    const bool isSortRoleDirectory = m_pendingSortRoleDirectories.remove(path);
+    const bool getSizeRole = m_roles.contains("size") || isSortRoleDirectory;
     const bool getIsExpandableRole = m_roles.contains("isExpandable");
 
     if (getSizeRole || getIsExpandableRole) {
@@ -774,6 +969,10 @@ void KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived(const QStrin
                     this,    &KFileItemModelRolesUpdater::slotItemsChanged);
         }
     }
+
+    if (isSortRoleDirectory && m_state == ResolvingSortRole) {
+        resolveNextSortRole();
+    }
 }
 
 void KFileItemModelRolesUpdater::startUpdating()
@@ -788,14 +987,14 @@ void KFileItemModelRolesUpdater::startUpdating()
         return;
     }
 
-    // Terminate all updates that are currently active.
-    killPreviewJob();
+    // Terminate all updates that are currently active. Running preview jobs
+    // are kept, as the remaining items are only reprioritized below.
+    if (!m_previewShown) {
+        killPreviewJob();
+    }
     m_pendingIndexes.clear();
 
-    QElapsedTimer timer;
-    timer.start();
-
-    // Determine the icons for the visible items synchronously.
+    // Apply the icons of the visible items whose MIME type is known already.
     updateVisibleIcons();
 
     // A detailed update of the items in and near the visible area
@@ -813,7 +1012,7 @@ void KFileItemModelRolesUpdater::startUpdating()
 
         foreach (int index, indexes) {
             const KFileItem item = m_model->fileItem(index);
-            if (!m_finishedItems.contains(item)) {
+            if (!m_finishedItems.contains(item) && !m_previewItemsInProgress.contains(item)) {
                 m_pendingPreviewItems.append(item);
             }
         }
@@ -839,18 +1038,16 @@ void KFileItemModelRolesUpdater::updateVisibleIcons()
         }
     }
 
-    QElapsedTimer timer;
-    timer.start();
-
-    // Try to determine the final icons for all visible items.
-    int index;
-    for (index = m_firstVisibleIndex; index <= lastVisibleIndex && timer.elapsed() < MaxBlockTimeout; ++index) {
-        applyResolvedRoles(index, ResolveFast);
+    // Determining the MIME type may block on slow devices, so it is left to
+    // the worker thread. Only items whose MIME type is known already get their
+    // final icons here. KFileItemListView::initializeItemListWidget(KItemListWidget*)
+    // loads preliminary icons for the remaining items, which are replaced
+    // when the visible items have been resolved by the worker thread.
+    for (int index = m_firstVisibleIndex; index <= lastVisibleIndex; ++index) {
+        if (m_model->fileItem(index).isMimeTypeKnown()) {
+            applyResolvedRoles(index, ResolveFast);
+        }
     }
-
-    // KFileItemListView::initializeItemListWidget(KItemListWidget*) will load
-    // preliminary icons (i.e., without mime type determination) for the
-    // remaining items.
 }
 
 void KFileItemModelRolesUpdater::startPreviewJob()
@@ -858,49 +1055,100 @@ void KFileItemModelRolesUpdater::startPreviewJob()
     m_state = PreviewJobRunning;
 
     if (m_pendingPreviewItems.isEmpty()) {
-        QTimer::singleShot(0, this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
+        if (m_previewJobs.isEmpty() && m_mimeTypeWatchers.isEmpty() && m_previewImageWatchers.isEmpty()) {
+            QTimer::singleShot(0, this, [this]() { slotPreviewJobFinished(nullptr); });
+        }
         return;
     }
 
+    // Previews are created by KIO slaves in separate processes, so one job
+    // per CPU core can run in parallel. The pending items are spread across
+    // the available jobs, so that the visible items at the beginning of the
+    // list are handled by all jobs at the same time.
+    const int maximumJobs = maximumPreviewTasks();
+    const int itemsPerJob = qBound(1, (m_pendingPreviewItems.count() + maximumJobs - 1) / maximumJobs,
+                                   MaxPreviewItemsPerJob);
+
+    KFileItemPreviewCache* previewCache = KFileItemPreviewCache::instance();
+    const int sizeClass = KFileItemPreviewCache::sizeClass(m_iconSize);
+
+    bool scalingTasksBusy = false;
+    while (!scalingTasksBusy && !m_pendingPreviewItems.isEmpty()
+           && m_previewJobs.count() + m_mimeTypeWatchers.count() < maximumJobs) {
+        KFileItemList items;
+        KFileItemList itemsWithKnownMimeType;
+        KFileItemList itemsWithUnknownMimeType;
+        items.reserve(itemsPerJob);
+
+        while (!m_pendingPreviewItems.isEmpty() && items.count() < itemsPerJob) {
+            // Previews that are available in the cache only need to be
+            // scaled, which does not require a preview job. If all scaling
+            // tasks are busy, the remaining items are handled once a task
+            // has been finished.
+            const QImage preview = previewCache->image(m_pendingPreviewItems.first(), sizeClass);
+            if (!preview.isNull()) {
+                if (m_previewImageWatchers.count() >= maximumJobs) {
+                    scalingTasksBusy = true;
+                    break;
+                }
+
+                const KFileItem item = m_pendingPreviewItems.takeFirst();
+                m_previewItemsInProgress.insert(item);
+                m_changedItems.remove(item);
+                startPreviewImageCreation(item, preview);
+                continue;
+            }
+
+            KFileItem item = m_pendingPreviewItems.takeFirst();
+            m_previewItemsInProgress.insert(item);
+            items.append(item);
+
+            if (item.isMimeTypeKnown()) {
+                itemsWithKnownMimeType.append(item);
+            } else {
+                // KIO::filePreview() will request the MIME-type of all passed items, which (in the
+                // worst case) might block the application for several seconds. The MIME types are
+                // determined in a worker thread instead. refreshMimeType() detaches the item from
+                // the item of the model, so that the worker thread has exclusive access to it.
+                item.refreshMimeType();
+                itemsWithUnknownMimeType.append(item);
+            }
+        }
+
+        if (items.isEmpty()) {
+            continue;
+        }
+
+        if (itemsWithUnknownMimeType.isEmpty()) {
+            createPreviewJob(itemsWithKnownMimeType, items);
+            continue;
+        }
+
+        auto watcher = new QFutureWatcher<KFileItemList>(this);
+        connect(watcher, &QFutureWatcher<KFileItemList>::finished, this,
+                [this, watcher, itemsWithKnownMimeType, items]() {
+                    m_mimeTypeWatchers.removeOne(watcher);
+                    watcher->deleteLater();
+                    createPreviewJob(itemsWithKnownMimeType + watcher->result(), items);
+                });
+        m_mimeTypeWatchers.append(watcher);
+        watcher->setFuture(QtConcurrent::run(determineMimeTypes, itemsWithUnknownMimeType));
+    }
+}
+
+void KFileItemModelRolesUpdater::createPreviewJob(const KFileItemList& previewItems, const KFileItemList& items)
+{
     // PreviewJob internally caches items always with the size of
     // 128 x 128 pixels or 256 x 256 pixels. A (slow) downscaling is done
     // by PreviewJob if a smaller size is requested. For images KFileItemModelRolesUpdater must
     // do a downscaling anyhow because of the frame, so in this case only the provided
     // cache sizes are requested.
-    const QSize cacheSize = (m_iconSize.width() > 128) || (m_iconSize.height() > 128)
-                             ? QSize(256, 256) : QSize(128, 128);
-
-    // KIO::filePreview() will request the MIME-type of all passed items, which (in the
-    // worst case) might block the application for several seconds. To prevent such
-    // a blocking, we only pass items with known mime type to the preview job.
-    const int count = m_pendingPreviewItems.count();
-    KFileItemList itemSubSet;
-    itemSubSet.reserve(count);
-
-    if (m_pendingPreviewItems.first().isMimeTypeKnown()) {
-        // Some mime types are known already, probably because they were
-        // determined when loading the icons for the visible items. Start
-        // a preview job for all items at the beginning of the list which
-        // have a known mime type.
-        do {
-            itemSubSet.append(m_pendingPreviewItems.takeFirst());
-        } while (!m_pendingPreviewItems.isEmpty() && m_pendingPreviewItems.first().isMimeTypeKnown());
-    } else {
-        // Determine mime types for MaxBlockTimeout ms, and start a preview
-        // job for the corresponding items.
-        QElapsedTimer timer;
-        timer.start();
+    const int sizeClass = KFileItemPreviewCache::sizeClass(m_iconSize);
+    const QSize cacheSize(sizeClass, sizeClass);
 
-        do {
-            const KFileItem item = m_pendingPreviewItems.takeFirst();
-            item.determineMimeType();
-            itemSubSet.append(item);
-        } while (!m_pendingPreviewItems.isEmpty() && timer.elapsed() < MaxBlockTimeout);
-    }
-
-    KIO::PreviewJob* job = new KIO::PreviewJob(itemSubSet, cacheSize, &m_enabledPlugins);
+    KIO::PreviewJob* job = new KIO::PreviewJob(previewItems, cacheSize, &m_enabledPlugins);
 
-    job->setIgnoreMaximumSize(itemSubSet.first().isLocalFile());
+    job->setIgnoreMaximumSize(previewItems.first().isLocalFile());
     if (job->uiDelegate()) {
         KJobWidgets::setWindow(job, qApp->activeWindow());
     }
@@ -912,7 +1160,82 @@ void KFileItemModelRolesUpdater::startPreviewJob()
     connect(job,  &KIO::PreviewJob::finished,
             this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
 
-    m_previewJob = job;
+    m_previewJobs.insert(job, items);
+}
+
+void KFileItemModelRolesUpdater::startPreviewImageCreation(const KFileItem& item, const QImage& preview)
+{
+    if (m_previewImageWatchers.count() >= maximumPreviewTasks()) {
+        // Previews that are received from preview jobs cannot be held back.
+        // They are scaled once a running task has been finished.
+        m_pendingPreviewImages.append(qMakePair(item, preview));
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this,
+            [this, watcher, item]() {
+                m_previewImageWatchers.removeOne(watcher);
+                watcher->deleteLater();
+                m_previewItemsInProgress.remove(item);
+                applyPreview(item, QPixmap::fromImage(watcher->result()));
+
+                if (!m_pendingPreviewImages.isEmpty()) {
+                    const QPair<KFileItem, QImage> pendingPreview = m_pendingPreviewImages.takeFirst();
+                    startPreviewImageCreation(pendingPreview.first, pendingPreview.second);
+                }
+
+                // Continues with the pending items, whose previews
+                // might be available in the cache
+                slotPreviewJobFinished(nullptr);
+            });
+    m_previewImageWatchers.append(watcher);
+    watcher->setFuture(QtConcurrent::run(createPreviewImage, preview, m_iconSize,
+                                         qApp->devicePixelRatio(), m_enlargeSmallPreviews));
+}
+
+void KFileItemModelRolesUpdater::applyPreview(const KFileItem& item, QPixmap pixmap)
+{
+    const int index = m_model->index(item);
+    if (index < 0) {
+        return;
+    }
+
+    QHash<QByteArray, QVariant> data = rolesData(item);
+
+    const QStringList overlays = data["iconOverlays"].toStringList();
+    // Strangely KFileItem::overlays() returns empty string-values, so
+    // we need to check first whether an overlay must be drawn at all.
+    // It is more efficient to do it here, as KIconLoader::drawOverlays()
+    // assumes that an overlay will be drawn and has some additional
+    // setup time.
+    foreach (const QString& overlay, overlays) {
+        if (!overlay.isEmpty()) {
+            // There is at least one overlay, draw all overlays above m_pixmap
+            // and cancel the check
+            KIconLoader::global()->drawOverlays(overlays, pixmap, KIconLoader::Desktop);
+            break;
+        }
+    }
+
+    data.insert("iconPixmap", pixmap);
+
+    disconnect(m_model, &KFileItemModel::itemsChanged,
+               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+    m_model->setData(index, data);
+    connect(m_model, &KFileItemModel::itemsChanged,
+            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+
+    m_finishedItems.insert(item);
+
+    const qint64 bytes = qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    ResidentPreview& residentPreview = m_residentPreviews[item];
+    m_previewMemoryUsage += bytes - residentPreview.bytes;
+    residentPreview.bytes = bytes;
+    residentPreview.lastUse = ++m_previewUseCounter;
+
+    evictPreviews();
+    emit previewMemoryUsageChanged();
 }
 
 void KFileItemModelRolesUpdater::updateChangedItems()
@@ -970,9 +1293,7 @@ void KFileItemModelRolesUpdater::updateChangedItems()
             m_pendingPreviewItems.append(m_model->fileItem(index));
         }
 
-        if (!m_previewJob) {
-            startPreviewJob();
-        }
+        startPreviewJob();
     } else {
         const bool resolvingInProgress = !m_pendingIndexes.isEmpty();
         m_pendingIndexes = visibleChangedIndexes + m_pendingIndexes + invisibleChangedIndexes;
@@ -984,37 +1305,12 @@ void KFileItemModelRolesUpdater::updateChangedItems()
     }
 }
 
-void KFileItemModelRolesUpdater::applySortRole(int index)
-{
-    QHash<QByteArray, QVariant> data;
-    const KFileItem item = m_model->fileItem(index);
-
-    if (m_model->sortRole() == "type") {
-        if (!item.isMimeTypeKnown()) {
-            item.determineMimeType();
-        }
-
-        data.insert("type", item.mimeComment());
-    } else if (m_model->sortRole() == "size" && item.isLocalFile() && item.isDir()) {
-        const QString path = item.localPath();
-        data.insert("size", m_directoryContentsCounter->countDirectoryContentsSynchronously(path));
-    } else {
-        // Probably the sort role is a baloo role - just determine all roles.
-        data = rolesData(item);
-    }
-
-    disconnect(m_model, &KFileItemModel::itemsChanged,
-               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-    m_model->setData(index, data);
-    connect(m_model, &KFileItemModel::itemsChanged,
-            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-}
-
 void KFileItemModelRolesUpdater::applySortProgressToModel()
 {
     // Inform the model about the progress of the resolved items,
     // so that it can give an indication when the sorting has been finished.
-    const int resolvedCount = m_model->count() - m_pendingSortRoleItems.count();
+    const int resolvedCount = m_model->count() - m_pendingSortRoleItems.count()
+                              - m_pendingSortRoleDirectories.count();
     m_model->emitSortProgress(resolvedCount);
 }
 
@@ -1060,39 +1356,70 @@ bool KFileItemModelRolesUpdater::applyResolvedRoles(int index, ResolveHint hint)
 
 QHash<QByteArray, QVariant> KFileItemModelRolesUpdater::rolesData(const KFileItem& item)
 {
-    QHash<QByteArray, QVariant> data;
+    KFileItemRolesResolverWorker::Options options;
+#ifdef HAVE_BALOO
+    if (m_balooFileMonitor) {
+        options |= KFileItemRolesResolverWorker::ResolveBalooRoles;
+    }
+#endif
 
+    QHash<QByteArray, QVariant> data = KFileItemRolesResolverWorker::rolesData(item, m_roles, options);
+    addGuiThreadRolesData(item, data);
+    return data;
+}
+
+void KFileItemModelRolesUpdater::addGuiThreadRolesData(const KFileItem& item, QHash<QByteArray, QVariant>& data)
+{
     const bool getSizeRole = m_roles.contains("size");
     const bool getIsExpandableRole = m_roles.contains("isExpandable");
 
-    if ((getSizeRole || getIsExpandableRole) && item.isDir()) {
-        if (item.isLocalFile()) {
-            // Tell m_directoryContentsCounter that we want to count the items
-            // inside the directory. The result will be received in slotDirectoryContentsCountReceived.
-            const QString path = item.localPath();
-            m_directoryContentsCounter->addDirectory(path);
-        } else if (getSizeRole) {
-            data.insert("size", -1); // -1 indicates an unknown number of items
+    if ((getSizeRole || getIsExpandableRole) && item.isDir() && item.isLocalFile()) {
+        // Tell m_directoryContentsCounter that we want to count the items
+        // inside the directory. The result will be received in slotDirectoryContentsCountReceived.
+        const QString path = item.localPath();
+        m_directoryContentsCounter->addDirectory(path);
+    }
+
+    if (!m_overlayIconsPlugin.isEmpty()) {
+        QStringList overlays = data.value("iconOverlays").toStringList();
+        foreach (KOverlayIconPlugin *it, m_overlayIconsPlugin) {
+            overlays.append(it->getOverlays(item.url()));
         }
+        data.insert("iconOverlays", overlays);
+    }
+
+#ifdef HAVE_BALOO
+    if (m_balooFileMonitor) {
+        m_balooFileMonitor->addFile(item.localPath());
     }
+#endif
+}
 
-    if (m_roles.contains("type")) {
-        data.insert("type", item.mimeComment());
+void KFileItemModelRolesUpdater::startRolesResolving(const KFileItemList& items)
+{
+    KFileItemList resolverItems;
+    resolverItems.reserve(items.count());
+    foreach (KFileItem item, items) {
+        // Detach the item from the item of the model, as the worker
+        // thread modifies it when determining the MIME type.
+        item.refreshMimeType();
+        resolverItems.append(item);
     }
 
-    QStringList overlays = item.overlays();
-    foreach(KOverlayIconPlugin *it, m_overlayIconsPlugin) {
-        overlays.append(it->getOverlays(item.url()));
+    QSet<QByteArray> roles = m_roles;
+    if (m_resolvableRoles.contains(m_model->sortRole())) {
+        roles.insert(m_model->sortRole());
     }
-    data.insert("iconOverlays", overlays);
 
+    KFileItemRolesResolverWorker::Options options;
 #ifdef HAVE_BALOO
     if (m_balooFileMonitor) {
-        m_balooFileMonitor->addFile(item.localPath());
-        applyChangedBalooRolesForItem(item);
+        options |= KFileItemRolesResolverWorker::ResolveBalooRoles;
     }
 #endif
-    return data;
+
+    m_rolesResolverIsBusy = true;
+    emit requestRolesResolving(resolverItems, roles, options);
 }
 
 void KFileItemModelRolesUpdater::slotOverlaysChanged(const QUrl& url, const QStringList &)
@@ -1116,6 +1443,7 @@ void KFileItemModelRolesUpdater::updateAllPreviews()
     if (m_state == Paused) {
         m_previewChangedDuringPausing = true;
     } else {
+        killPreviewJob();
         m_finishedItems.clear();
         startUpdating();
     }
@@ -1123,17 +1451,94 @@ void KFileItemModelRolesUpdater::updateAllPreviews()
 
 void KFileItemModelRolesUpdater::killPreviewJob()
 {
-    if (m_previewJob) {
-        disconnect(m_previewJob,  &KIO::PreviewJob::gotPreview,
-                   this, &KFileItemModelRolesUpdater::slotGotPreview);
-        disconnect(m_previewJob,  &KIO::PreviewJob::failed,
-                   this, &KFileItemModelRolesUpdater::slotPreviewFailed);
-        disconnect(m_previewJob,  &KIO::PreviewJob::finished,
-                   this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
-        m_previewJob->kill();
-        m_previewJob = nullptr;
-        m_pendingPreviewItems.clear();
+    for (auto it = m_previewJobs.constBegin(); it != m_previewJobs.constEnd(); ++it) {
+        KJob* job = it.key();
+        disconnect(job,  nullptr, this, nullptr);
+        job->kill();
+    }
+    m_previewJobs.clear();
+
+    // The worker threads cannot be interrupted. Their results are ignored.
+    foreach (QFutureWatcher<KFileItemList>* watcher, m_mimeTypeWatchers) {
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->deleteLater();
+    }
+    m_mimeTypeWatchers.clear();
+
+    foreach (QFutureWatcher<QImage>* watcher, m_previewImageWatchers) {
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->deleteLater();
+    }
+    m_previewImageWatchers.clear();
+    m_pendingPreviewImages.clear();
+
+    m_previewItemsInProgress.clear();
+    m_pendingPreviewItems.clear();
+}
+
+void KFileItemModelRolesUpdater::evictPreviews()
+{
+    if (m_previewMemoryBudget <= 0) {
+        return;
+    }
+
+    // The previews in the KFileItemPreviewCache and the previews with effects
+    // in QPixmapCache (its limit is given in KiB) are part of the budget.
+    const qint64 budget = qMax(qint64(0), m_previewMemoryBudget
+                                          - KFileItemPreviewCache::instance()->maximumSize()
+                                          - qint64(QPixmapCache::cacheLimit()) * 1024);
+    if (m_previewMemoryUsage <= budget) {
+        return;
+    }
+
+    // The previews of items that are visible or will be resolved soon are kept.
+    QSet<KFileItem> keptItems;
+    foreach (int index, indexesToResolve()) {
+        keptItems.insert(m_model->fileItem(index));
+    }
+
+    // Sort the other previews by their last use. The values of
+    // m_previewUseCounter are unique, so no previews get lost.
+    QMap<quint64, KFileItem> evictableItems;
+    for (auto it = m_residentPreviews.constBegin(); it != m_residentPreviews.constEnd(); ++it) {
+        if (!keptItems.contains(it.key())) {
+            evictableItems.insert(it->lastUse, it.key());
+        }
     }
+
+    // Free more memory than required. This prevents that each
+    // new preview triggers an eviction.
+    const qint64 targetUsage = budget / 4 * 3;
+
+    QHash<QByteArray, QVariant> data;
+    data.insert("iconPixmap", QPixmap());
+
+    disconnect(m_model, &KFileItemModel::itemsChanged,
+               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+
+    int evictedCount = 0;
+    foreach (const KFileItem& item, evictableItems) {
+        if (m_previewMemoryUsage <= targetUsage) {
+            break;
+        }
+
+        const int index = m_model->index(item);
+        if (index >= 0) {
+            m_model->setData(index, data);
+        }
+
+        // The preview is created again by startUpdating() when the item
+        // gets close to the visible area.
+        m_finishedItems.remove(item);
+        m_previewMemoryUsage -= m_residentPreviews.take(item).bytes;
+        ++evictedCount;
+    }
+
+    connect(m_model, &KFileItemModel::itemsChanged,
+            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+
+    qCDebug(DolphinDebug) << "Evicted" << evictedCount << "previews, preview memory:"
+                          << m_previewMemoryUsage / 1024 << "KiB of" << budget / 1024 << "KiB";
 }
 
 QList<int> KFileItemModelRolesUpdater::indexesToResolve() const
@@ -1193,3 +1598,5 @@ QList<int> KFileItemModelRolesUpdater::indexesToResolve() const
     return result;
 }
 
+QThread* KFileItemModelRolesUpdater::m_rolesResolverThread = nullptr;
+int KFileItemModelRolesUpdater::m_rolesResolverWorkersCount = 0;
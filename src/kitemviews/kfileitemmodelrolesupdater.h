@@ -22,10 +22,13 @@
 
 #include "dolphin_export.h"
 #include "kitemviews/kitemmodelbase.h"
+#include "kitemviews/private/kfileitemrolesresolverworker.h"
 
 #include <KFileItem>
 #include <config-baloo.h>
 
+#include <QHash>
+#include <QImage>
 #include <QObject>
 #include <QSet>
 #include <QSize>
@@ -33,10 +36,15 @@
 
 class KDirectoryContentsCounter;
 class KFileItemModel;
+class KJob;
+class QImage;
 class QPixmap;
+class QThread;
 class QTimer;
 class KOverlayIconPlugin;
 
+template<typename T> class QFutureWatcher;
+
 namespace KIO {
     class PreviewJob;
 }
@@ -66,7 +74,8 @@ namespace KIO {
  *
  * 1.   If the sort role is "slow", it is determined for all items. If this
  *      cannot be finished synchronously in 200 ms, the remaining items are
- *      handled asynchronously by \a resolveNextSortRole().
+ *      handled asynchronously by \a resolveNextSortRole(), which passes
+ *      them in batches to a KFileItemRolesResolverWorker.
  *
  * 2.   The function startUpdating(), which is called if either the sort role
  *      has been successfully determined for all items, or items are inserted
@@ -76,14 +85,21 @@ namespace KIO {
  *
  *      (a) If previews are disabled, icons and all other roles are determined
  *          asynchronously for the interesting items. This is done by the
- *          function \a resolveNextPendingRoles().
+ *          function \a resolveNextPendingRoles(), which lets a
+ *          KFileItemRolesResolverWorker determine the roles for batches of
+ *          items in a worker thread. The GUI thread only applies the results.
  *
- *      (b) If previews are enabled, a \a KIO::PreviewJob is started that loads
- *          the previews for the interesting items. At the same time, the icons
+ *      (b) If previews are enabled, up to one \a KIO::PreviewJob per CPU core
+ *          is started to load the previews for the interesting items. The
+ *          MIME types that are required by the preview jobs are determined
+ *          in a worker thread. At the same time, the icons
  *          for these items are determined asynchronously as fast as possible
  *          by \a resolveNextPendingRoles(). This minimizes the risk that the
  *          user sees "unknown" icons when scrolling before the previews have
- *          arrived.
+ *          arrived. The received previews are kept in the
+ *          KFileItemPreviewCache, and they are scaled and framed in worker
+ *          threads. If the icon size is changed, the previews are derived
+ *          from the cache and no new preview jobs are required.
  *
  * 3.   Finally, the entire process is repeated for any items that might have
  *      changed in the mean time.
@@ -123,6 +139,27 @@ public:
     void setEnlargeSmallPreviews(bool enlarge);
     bool enlargeSmallPreviews() const;
 
+    /**
+     * Sets the maximum memory in bytes that may be used by the previews which
+     * have been applied to the model and by the KFileItemPreviewCache. The
+     * cache gets a quarter of the budget. If the budget is exceeded, the
+     * previews of items far outside the visible area are removed from the
+     * model in least-recently-used order. They are created again from the
+     * KFileItemPreviewCache if the items get visible again. The limit of
+     * QPixmapCache, which keeps the previews with effects, is reserved
+     * within the budget, too. A budget of 0 means that the memory of the
+     * previews in the model is not limited. Per default 256 MiB are used.
+     */
+    void setPreviewMemoryBudget(qint64 bytes);
+    qint64 previewMemoryBudget() const;
+
+    /**
+     * @return Memory in bytes that is used by the previews which have been
+     *         applied to the model and by the KFileItemPreviewCache.
+     * @see previewMemoryUsageChanged()
+     */
+    qint64 previewMemoryUsage() const;
+
     /**
      * If \a paused is set to true the asynchronous resolving of roles will be paused.
      * State changes during pauses like changing the icon size or the preview-shown
@@ -154,6 +191,19 @@ public:
      */
     QStringList enabledPlugins() const;
 
+signals:
+    /**
+     * Is emitted if the result of previewMemoryUsage() has been changed.
+     */
+    void previewMemoryUsageChanged();
+
+    /**
+     * Requests the worker thread to resolve the roles \a roles for \a items.
+     * @see startRolesResolving()
+     */
+    void requestRolesResolving(const KFileItemList& items, const QSet<QByteArray>& roles,
+                               KFileItemRolesResolverWorker::Options options);
+
 private slots:
     void slotItemsInserted(const KItemRangeList& itemRanges);
     void slotItemsRemoved(const KItemRangeList& itemRanges);
@@ -164,8 +214,10 @@ private slots:
                              const QByteArray& previous);
 
     /**
-     * Is invoked after a preview has been received successfully.
+     * Is invoked after a preview has been received successfully. Stores
+     * the preview in the preview cache and starts scaling it.
      * @see startPreviewJob()
+     * @see startPreviewImageCreation()
      */
     void slotGotPreview(const KFileItem& item, const QPixmap& pixmap);
 
@@ -176,12 +228,12 @@ private slots:
     void slotPreviewFailed(const KFileItem& item);
 
     /**
-     * Is invoked when the preview job has been finished. Starts a new preview
-     * job if there are any interesting items without previews left, or updates
-     * the changed items otherwise.     *
+     * Is invoked when the preview job \a job has been finished. Starts new preview
+     * jobs if there are any interesting items without previews left, or updates
+     * the changed items otherwise.
      * @see startPreviewJob()
      */
-    void slotPreviewJobFinished();
+    void slotPreviewJobFinished(KJob* job);
 
     /**
      * Is invoked when one of the KOverlayIconPlugin emit the signal that an overlay has changed
@@ -189,19 +241,27 @@ private slots:
     void slotOverlaysChanged(const QUrl& url, const QStringList&);
 
     /**
-     * Resolves the sort role of the next item in m_pendingSortRole, applies it
-     * to the model, and invokes itself if there are any pending items left. If
-     * that is not the case, \a startUpdating() is called.
+     * Starts resolving the sort role of the next batch of items in
+     * m_pendingSortRoleItems. It is invoked again when the results have been
+     * applied to the model, until no pending items are left. If that is the
+     * case, \a startUpdating() is called.
      */
     void resolveNextSortRole();
 
     /**
-     * Resolves the icon name and (if previews are disabled) all other roles
-     * for the next interesting item. If there are no pending items left, any
-     * changed items are updated.
+     * Starts resolving the icon name and (if previews are disabled) all other
+     * roles for the next batch of interesting items. If there are no pending
+     * items left, any changed items are updated.
      */
     void resolveNextPendingRoles();
 
+    /**
+     * Is invoked when the worker thread has resolved the roles of \a items.
+     * Applies \a values to the model and continues with the next batch.
+     * @see startRolesResolving()
+     */
+    void slotRolesResolved(const KFileItemList& items, const QList<QHash<QByteArray, QVariant> >& values);
+
     /**
      * Resolves items that have not been resolved yet after the change has been
      * notified by slotItemsChanged(). Is invoked if the m_changedItemsTimer
@@ -230,8 +290,10 @@ private:
     void updateVisibleIcons();
 
     /**
-     * Creates previews for the items starting from the first item in
-     * m_pendingPreviewItems.
+     * Starts preview jobs for the items at the beginning of
+     * m_pendingPreviewItems until the maximum number of concurrent
+     * jobs has been reached. Preview jobs that are running already are
+     * not touched.
      * @see slotGotPreview()
      * @see slotPreviewFailed()
      * @see slotPreviewJobFinished()
@@ -239,15 +301,30 @@ private:
     void startPreviewJob();
 
     /**
-     * Ensures that icons, previews, and other roles are determined for any
-     * items that have been changed.
+     * Creates a preview job for \a previewItems, which must have a known MIME
+     * type. \a items contains the corresponding items of the model.
      */
-    void updateChangedItems();
+    void createPreviewJob(const KFileItemList& previewItems, const KFileItemList& items);
+
+    /**
+     * Scales the unmodified preview \a preview of \a item to the icon size
+     * and adds a frame if required. This is done in a worker thread, and the
+     * result is applied to the model by applyPreview(). If the maximum number
+     * of scaling tasks is running already, the preview is queued.
+     */
+    void startPreviewImageCreation(const KFileItem& item, const QImage& preview);
+
+    /**
+     * Draws the overlays of \a item above \a pixmap and applies the result
+     * as "iconPixmap" to the model.
+     */
+    void applyPreview(const KFileItem& item, QPixmap pixmap);
 
     /**
-     * Resolves the sort role of the item and applies it to the model.
+     * Ensures that icons, previews, and other roles are determined for any
+     * items that have been changed.
      */
-    void applySortRole(int index);
+    void updateChangedItems();
 
     void applySortProgressToModel();
 
@@ -258,6 +335,18 @@ private:
     bool applyResolvedRoles(int index, ResolveHint hint);
     QHash<QByteArray, QVariant> rolesData(const KFileItem& item);
 
+    /**
+     * Adds the roles of \a item that can only be determined in the GUI thread
+     * to \a data.
+     */
+    void addGuiThreadRolesData(const KFileItem& item, QHash<QByteArray, QVariant>& data);
+
+    /**
+     * Passes copies of \a items to the worker thread, which determines their
+     * MIME types and roles. The result is received by \a slotRolesResolved().
+     */
+    void startRolesResolving(const KFileItemList& items);
+
     /**
      * @return The number of items of the path \a path.
      */
@@ -271,6 +360,13 @@ private:
 
     void killPreviewJob();
 
+    /**
+     * Removes the least recently used previews of items outside the range
+     * returned by indexesToResolve() from the model, until the memory used
+     * by the previews is clearly below the preview memory budget.
+     */
+    void evictPreviews();
+
     QList<int> indexesToResolve() const;
 
 private:
@@ -305,6 +401,19 @@ private:
     // previews and other expensive roles are determined again.
     QSet<KFileItem> m_finishedItems;
 
+    struct ResidentPreview
+    {
+        qint64 bytes;
+        quint64 lastUse;
+    };
+
+    // Previews which have been applied to the model, with their size and
+    // the value of m_previewUseCounter when they have been used last.
+    QHash<KFileItem, ResidentPreview> m_residentPreviews;
+    quint64 m_previewUseCounter;
+    qint64 m_previewMemoryUsage;
+    qint64 m_previewMemoryBudget;
+
     KFileItemModel* m_model;
     QSize m_iconSize;
     int m_firstVisibleIndex;
@@ -317,15 +426,35 @@ private:
     // Items for which the sort role still has to be determined.
     QSet<KFileItem> m_pendingSortRoleItems;
 
+    // Local directories that are counted by m_directoryContentsCounter
+    // to determine the "size" sort role.
+    QSet<QString> m_pendingSortRoleDirectories;
+
     // Indexes of items which still have to be handled by
     // resolveNextPendingRoles().
     QList<int> m_pendingIndexes;
 
     // Items which have been left over from the last call of startPreviewJob().
-    // A new preview job will be started from them once the first one finishes.
+    // New preview jobs will be started from them once running jobs finish.
     KFileItemList m_pendingPreviewItems;
 
-    KIO::PreviewJob* m_previewJob;
+    // Running preview jobs and the items of the model they have been started for.
+    QHash<KJob*, KFileItemList> m_previewJobs;
+
+    // Determines the MIME types of items before a preview job is started for them.
+    QList<QFutureWatcher<KFileItemList>*> m_mimeTypeWatchers;
+
+    // Scale and frame the received or cached previews.
+    QList<QFutureWatcher<QImage>*> m_previewImageWatchers;
+
+    // Received previews that are scaled once a running scaling task has been
+    // finished. The number of scaling tasks is limited like the number of jobs.
+    QList<QPair<KFileItem, QImage> > m_pendingPreviewImages;
+
+    // Items that are handled by a running preview job, whose MIME types are
+    // being determined or whose previews are being scaled. They are skipped
+    // when the pending items are reprioritized.
+    QSet<KFileItem> m_previewItemsInProgress;
 
     // When downloading or copying large files, the slot slotItemsChanged()
     // will be called periodically within a quite short delay. To prevent
@@ -340,6 +469,12 @@ private:
 
     KDirectoryContentsCounter* m_directoryContentsCounter;
 
+    static QThread* m_rolesResolverThread;
+    static int m_rolesResolverWorkersCount;
+
+    KFileItemRolesResolverWorker* m_rolesResolverWorker;
+    bool m_rolesResolverIsBusy;
+
     QList<KOverlayIconPlugin*> m_overlayIconsPlugin;
 
 #ifdef HAVE_BALOO
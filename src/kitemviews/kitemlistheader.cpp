@@ -19,6 +19,7 @@
 
 #include "kitemlistheader.h"
 #include "kitemlistview.h"
+#include "private/kitemlistcolumnwidthresolver.h"
 #include "private/kitemlistheaderwidget.h"
 
 KItemListHeader::~KItemListHeader()
@@ -30,6 +31,9 @@ void KItemListHeader::setAutomaticColumnResizing(bool automatic)
     if (m_headerWidget->automaticColumnResizing() != automatic) {
         m_headerWidget->setAutomaticColumnResizing(automatic);
         if (automatic) {
+            if (m_view->m_itemSize.isEmpty() && m_view->m_columnWidthResolver->roles() != m_view->m_visibleRoles) {
+                m_view->updatePreferredColumnWidths();
+            }
             m_view->applyAutomaticColumnWidths();
             m_view->doLayout(KItemListView::NoAnimation);
         }
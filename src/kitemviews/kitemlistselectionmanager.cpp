@@ -163,6 +163,44 @@ void KItemListSelectionManager::setSelected(int index, int count, SelectionMode
     }
 }
 
+void KItemListSelectionManager::setSelected(const KItemSet& items, SelectionMode mode)
+{
+    if (items.isEmpty() || !m_model) {
+        return;
+    }
+
+    Q_ASSERT(items.first() >= 0);
+    Q_ASSERT(items.last() < m_model->count());
+
+    endAnchoredSelection();
+    const KItemSet previous = selectedItems();
+
+    switch (mode) {
+    case Select:
+        m_selectedItems = m_selectedItems + items;
+        break;
+
+    case Deselect:
+        // The union contains all items of 'items', so the symmetric
+        // difference removes exactly these items.
+        m_selectedItems = (m_selectedItems + items) ^ items;
+        break;
+
+    case Toggle:
+        m_selectedItems = m_selectedItems ^ items;
+        break;
+
+    default:
+        Q_ASSERT(false);
+        break;
+    }
+
+    const KItemSet selection = selectedItems();
+    if (selection != previous) {
+        emit selectionChanged(selection, previous);
+    }
+}
+
 void KItemListSelectionManager::clearSelection()
 {
     const KItemSet previous = selectedItems();
@@ -62,6 +62,13 @@ public:
     bool hasSelection() const;
 
     void setSelected(int index, int count = 1, SelectionMode mode = Select);
+
+    /**
+     * Selects, deselects or toggles all items in \a items, depending on \a mode.
+     * In contrast to calling setSelected(int, int, SelectionMode) for each
+     * item, the signal selectionChanged() is emitted only once.
+     */
+    void setSelected(const KItemSet& items, SelectionMode mode = Select);
     void clearSelection();
 
     void beginAnchoredSelection(int anchor);
@@ -30,6 +30,7 @@
 #include "kitemlistviewaccessible.h"
 #include "kstandarditemlistwidget.h"
 
+#include "private/kitemlistcolumnwidthresolver.h"
 #include "private/kitemlistheaderwidget.h"
 #include "private/kitemlistrubberband.h"
 #include "private/kitemlistsizehintresolver.h"
@@ -49,6 +50,14 @@ namespace {
 
     // Delay in ms for triggering the next autoscroll
     const int RepeatingAutoScrollDelay = 1000 / 60;
+
+    // Maximum time in ms that is spent for replacing estimated size hints
+    // by exact ones before the event loop gets control back
+    const int MaxEstimatedSizeHintsResolvingTime = 20;
+
+    // Maximum time in ms that is spent for calculating preferred
+    // column widths before the event loop gets control back
+    const int MaxColumnWidthsResolvingTime = 20;
 }
 
 #ifndef QT_NO_ACCESSIBILITY
@@ -69,6 +78,7 @@ QAccessibleInterface* accessibleInterfaceFactory(const QString& key, QObject* ob
 KItemListView::KItemListView(QGraphicsWidget* parent) :
     QGraphicsWidget(parent),
     m_enabledSelectionToggles(false),
+    m_cachedItemPainting(false),
     m_grouped(false),
     m_supportsItemExpanding(false),
     m_editingRole(false),
@@ -85,9 +95,12 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     m_visibleGroups(),
     m_visibleCells(),
     m_sizeHintResolver(nullptr),
+    m_columnWidthResolver(nullptr),
     m_layouter(nullptr),
     m_animation(nullptr),
     m_layoutTimer(nullptr),
+    m_estimatedSizeHintsTimer(nullptr),
+    m_columnWidthsTimer(nullptr),
     m_oldScrollOffset(0),
     m_oldMaximumScrollOffset(0),
     m_oldItemOffset(0),
@@ -104,6 +117,7 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     setAcceptHoverEvents(true);
 
     m_sizeHintResolver = new KItemListSizeHintResolver(this);
+    m_columnWidthResolver = new KItemListColumnWidthResolver(this);
 
     m_layouter = new KItemListViewLayouter(m_sizeHintResolver, this);
 
@@ -116,6 +130,16 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     m_layoutTimer->setSingleShot(true);
     connect(m_layoutTimer, &QTimer::timeout, this, &KItemListView::slotLayoutTimerFinished);
 
+    m_estimatedSizeHintsTimer = new QTimer(this);
+    m_estimatedSizeHintsTimer->setInterval(0);
+    m_estimatedSizeHintsTimer->setSingleShot(true);
+    connect(m_estimatedSizeHintsTimer, &QTimer::timeout, this, &KItemListView::slotResolveEstimatedSizeHints);
+
+    m_columnWidthsTimer = new QTimer(this);
+    m_columnWidthsTimer->setInterval(0);
+    m_columnWidthsTimer->setSingleShot(true);
+    connect(m_columnWidthsTimer, &QTimer::timeout, this, &KItemListView::slotResolvePreferredColumnWidths);
+
     m_rubberBand = new KItemListRubberBand(this);
     connect(m_rubberBand, &KItemListRubberBand::activationChanged, this, &KItemListView::slotRubberBandActivationChanged);
 
@@ -143,6 +167,9 @@ KItemListView::~KItemListView()
 
     delete m_sizeHintResolver;
     m_sizeHintResolver = nullptr;
+
+    delete m_columnWidthResolver;
+    m_columnWidthResolver = nullptr;
 }
 
 void KItemListView::setScrollOffset(qreal offset)
@@ -292,6 +319,27 @@ bool KItemListView::enabledSelectionToggles() const
     return m_enabledSelectionToggles;
 }
 
+void KItemListView::setCachedItemPainting(bool cached)
+{
+    if (m_cachedItemPainting != cached) {
+        m_cachedItemPainting = cached;
+
+        const QGraphicsItem::CacheMode mode = cached ? QGraphicsItem::DeviceCoordinateCache
+                                                     : QGraphicsItem::NoCache;
+        foreach (KItemListWidget* widget, m_visibleItems) {
+            widget->setCacheMode(mode);
+        }
+        foreach (KItemListGroupHeader* groupHeader, m_visibleGroups) {
+            groupHeader->setCacheMode(mode);
+        }
+    }
+}
+
+bool KItemListView::cachedItemPainting() const
+{
+    return m_cachedItemPainting;
+}
+
 KItemListController* KItemListView::controller() const
 {
     return m_controller;
@@ -472,6 +520,16 @@ void KItemListView::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, q
     widgetCreator()->calculateItemSizeHints(logicalHeightHints, logicalWidthHint, this);
 }
 
+void KItemListView::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint) const
+{
+    widgetCreator()->calculateItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, this);
+}
+
+void KItemListView::estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint) const
+{
+    widgetCreator()->estimateItemSizeHints(logicalHeightHints, logicalWidthHint, this);
+}
+
 void KItemListView::setSupportsItemExpanding(bool supportsExpanding)
 {
     if (m_supportsItemExpanding != supportsExpanding) {
@@ -740,8 +798,16 @@ void KItemListView::setItemSize(const QSizeF& size)
             const qreal currentWidth = m_layouter->itemSize().width();
             const QSizeF newSize(currentWidth, size.height());
             m_layouter->setItemSize(newSize);
+
+            // The resolver has been cleared when leaving the details mode. Keep
+            // the preferred widths up to date, so that they are available as
+            // soon as the automatic column resizing gets enabled again.
+            updatePreferredColumnWidths();
         }
     } else {
+        // The preferred column widths are only required for an empty item size
+        m_columnWidthResolver->setRoles(QList<QByteArray>());
+        m_columnWidthsTimer->stop();
         m_layouter->setItemSize(size);
     }
 
@@ -1002,7 +1068,8 @@ void KItemListView::updatePalette()
 void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
 {
     if (m_itemSize.isEmpty()) {
-        updatePreferredColumnWidths(itemRanges);
+        m_columnWidthResolver->itemsInserted(itemRanges);
+        slotResolvePreferredColumnWidths();
     }
 
     const bool hasMultipleRanges = (itemRanges.count() > 1);
@@ -1010,7 +1077,7 @@ void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
         beginTransaction();
     }
 
-    m_layouter->markAsDirty();
+    m_layouter->markItemsAsDirty(itemRanges.first().index);
 
     m_sizeHintResolver->itemsInserted(itemRanges);
 
@@ -1111,9 +1178,9 @@ void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
 void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
 {
     if (m_itemSize.isEmpty()) {
-        // Don't pass the item-range: The preferred column-widths of
-        // all items must be adjusted when removing items.
-        updatePreferredColumnWidths();
+        // The maximum column widths might get smaller when removing items.
+        m_columnWidthResolver->itemsRemoved(itemRanges);
+        applyPreferredColumnWidths();
     }
 
     const bool hasMultipleRanges = (itemRanges.count() > 1);
@@ -1121,7 +1188,7 @@ void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
         beginTransaction();
     }
 
-    m_layouter->markAsDirty();
+    m_layouter->markItemsAsDirty(itemRanges.first().index);
 
     m_sizeHintResolver->itemsRemoved(itemRanges);
 
@@ -1226,7 +1293,8 @@ void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
 void KItemListView::slotItemsMoved(const KItemRange& itemRange, const QList<int>& movedToIndexes)
 {
     m_sizeHintResolver->itemsMoved(itemRange, movedToIndexes);
-    m_layouter->markAsDirty();
+    m_columnWidthResolver->itemsMoved(itemRange, movedToIndexes);
+    m_layouter->markItemsAsDirty(itemRange.index, itemRange.count);
 
     if (m_controller) {
         m_controller->selectionManager()->itemsMoved(itemRange, movedToIndexes);
@@ -1252,7 +1320,8 @@ void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
 {
     const bool updateSizeHints = itemSizeHintUpdateRequired(roles);
     if (updateSizeHints && m_itemSize.isEmpty()) {
-        updatePreferredColumnWidths(itemRanges);
+        m_columnWidthResolver->itemsChanged(itemRanges);
+        slotResolvePreferredColumnWidths();
     }
 
     foreach (const KItemRange& itemRange, itemRanges) {
@@ -1261,7 +1330,7 @@ void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
 
         if (updateSizeHints) {
             m_sizeHintResolver->itemsChanged(index, count, roles);
-            m_layouter->markAsDirty();
+            m_layouter->markItemsAsDirty(index, count);
 
             if (!m_layoutTimer->isActive()) {
                 m_layoutTimer->start();
@@ -1280,6 +1349,7 @@ void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
         if (m_grouped && roles.contains(m_model->sortRole())) {
             // The sort-role has been changed which might result
             // in modified group headers
+            m_layouter->markItemsAsDirty(index, count);
             updateVisibleGroupHeaders();
             doLayout(NoAnimation);
         }
@@ -1293,6 +1363,7 @@ void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
 
 void KItemListView::slotGroupsChanged()
 {
+    m_layouter->markAsDirty();
     updateVisibleGroupHeaders();
     doLayout(NoAnimation);
     updateSiblingsInformation();
@@ -1332,6 +1403,7 @@ void KItemListView::slotSortOrderChanged(Qt::SortOrder current, Qt::SortOrder pr
     Q_UNUSED(current);
     Q_UNUSED(previous);
     if (m_grouped) {
+        m_layouter->markAsDirty();
         updateVisibleGroupHeaders();
         doLayout(NoAnimation);
     }
@@ -1342,6 +1414,7 @@ void KItemListView::slotSortRoleChanged(const QByteArray& current, const QByteAr
     Q_UNUSED(current);
     Q_UNUSED(previous);
     if (m_grouped) {
+        m_layouter->markAsDirty();
         updateVisibleGroupHeaders();
         doLayout(NoAnimation);
     }
@@ -1426,6 +1499,54 @@ void KItemListView::slotLayoutTimerFinished()
     doLayout(Animation);
 }
 
+void KItemListView::slotResolveEstimatedSizeHints()
+{
+    if (!m_model) {
+        return;
+    }
+
+    const int firstVisible = firstVisibleIndex();
+    const QRectF previousFirstVisibleRect = itemRect(firstVisible);
+
+    const int firstChangedIndex = m_sizeHintResolver->resolveEstimatedSizeHints(firstVisible,
+                                                                                lastVisibleIndex(),
+                                                                                MaxEstimatedSizeHintsResolvingTime);
+    if (firstChangedIndex >= 0) {
+        m_layouter->markItemsAsDirty(firstChangedIndex);
+
+        if (firstChangedIndex < firstVisible) {
+            // Items in front of the visible area got another size: Adjust the
+            // scroll offset so that the visible items don't jump around.
+            const QRectF firstVisibleRect = itemRect(firstVisible);
+            const qreal offsetDiff = (scrollOrientation() == Qt::Vertical)
+                                     ? firstVisibleRect.top() - previousFirstVisibleRect.top()
+                                     : firstVisibleRect.left() - previousFirstVisibleRect.left();
+            setScrollOffset(scrollOffset() + offsetDiff);
+        }
+
+        doLayout(NoAnimation);
+    }
+
+    if (m_sizeHintResolver->hasEstimatedSizeHints()) {
+        m_estimatedSizeHintsTimer->start();
+    }
+}
+
+void KItemListView::slotResolvePreferredColumnWidths()
+{
+    if (!m_model || !m_itemSize.isEmpty()) {
+        return;
+    }
+
+    if (m_columnWidthResolver->resolve(MaxColumnWidthsResolvingTime) || !m_columnWidthResolver->hasUnresolvedItems()) {
+        applyPreferredColumnWidths();
+    }
+
+    if (m_columnWidthResolver->hasUnresolvedItems()) {
+        m_columnWidthsTimer->start();
+    }
+}
+
 void KItemListView::slotRubberBandPosChanged()
 {
     update();
@@ -1609,6 +1730,7 @@ void KItemListView::setModel(KItemModelBase* model)
                    this,    &KItemListView::slotSortRoleChanged);
 
         m_sizeHintResolver->itemsRemoved(KItemRangeList() << KItemRange(0, m_model->count()));
+        m_columnWidthResolver->itemsRemoved(KItemRangeList() << KItemRange(0, m_model->count()));
     }
 
     m_model = model;
@@ -1827,6 +1949,11 @@ void KItemListView::doLayout(LayoutAnimationHint hint, int changedIndex, int cha
         }
     }
 
+    if (m_sizeHintResolver->hasEstimatedSizeHints() && !m_estimatedSizeHintsTimer->isActive()) {
+        // Replace the estimated size hints of the items by exact ones in the background
+        m_estimatedSizeHintsTimer->start();
+    }
+
     emitOffsetChanges();
 }
 
@@ -1939,6 +2066,7 @@ KItemListWidget* KItemListView::createWidget(int index)
 {
     KItemListWidget* widget = widgetCreator()->create(this);
     widget->setFlag(QGraphicsItem::ItemStacksBehindParent);
+    widget->setCacheMode(m_cachedItemPainting ? QGraphicsItem::DeviceCoordinateCache : QGraphicsItem::NoCache);
 
     m_visibleItems.insert(index, widget);
     m_visibleCells.insert(index, Cell());
@@ -2044,6 +2172,7 @@ void KItemListView::updateGroupHeaderForWidget(KItemListWidget* widget)
     if (!groupHeader) {
         groupHeader = groupHeaderCreator()->create(this);
         groupHeader->setParentItem(widget);
+        groupHeader->setCacheMode(m_cachedItemPainting ? QGraphicsItem::DeviceCoordinateCache : QGraphicsItem::NoCache);
         m_visibleGroups.insert(widget, groupHeader);
         connect(widget, &KItemListWidget::geometryChanged, this, &KItemListView::slotGeometryOfGroupHeaderParentChanged);
     }
@@ -2099,7 +2228,6 @@ void KItemListView::recycleGroupHeaderForWidget(KItemListWidget* widget)
 void KItemListView::updateVisibleGroupHeaders()
 {
     Q_ASSERT(m_grouped);
-    m_layouter->markAsDirty();
 
     QHashIterator<int, KItemListWidget*> it(m_visibleItems);
     while (it.hasNext()) {
@@ -2171,11 +2299,8 @@ bool KItemListView::useAlternateBackgrounds() const
     return m_itemSize.isEmpty() && m_visibleRoles.count() > 1;
 }
 
-QHash<QByteArray, qreal> KItemListView::preferredColumnWidths(const KItemRangeList& itemRanges) const
+QHash<QByteArray, qreal> KItemListView::preferredColumnWidths() const
 {
-    QElapsedTimer timer;
-    timer.start();
-
     QHash<QByteArray, qreal> widths;
 
     // Calculate the minimum width for each column that is required
@@ -2186,38 +2311,11 @@ QHash<QByteArray, qreal> KItemListView::preferredColumnWidths(const KItemRangeLi
     foreach (const QByteArray& visibleRole, visibleRoles()) {
         const QString headerText = m_model->roleDescription(visibleRole);
         const qreal headerWidth = fontMetrics.width(headerText) + gripMargin + headerMargin * 2;
-        widths.insert(visibleRole, headerWidth);
-    }
 
-    // Calculate the preferred column withs for each item and ignore values
-    // smaller than the width for showing the headline unclipped.
-    const KItemListWidgetCreatorBase* creator = widgetCreator();
-    int calculatedItemCount = 0;
-    bool maxTimeExceeded = false;
-    foreach (const KItemRange& itemRange, itemRanges) {
-        const int startIndex = itemRange.index;
-        const int endIndex = startIndex + itemRange.count - 1;
-
-        for (int i = startIndex; i <= endIndex; ++i) {
-            foreach (const QByteArray& visibleRole, visibleRoles()) {
-                qreal maxWidth = widths.value(visibleRole, 0);
-                const qreal width = creator->preferredRoleColumnWidth(visibleRole, i, this);
-                maxWidth = qMax(width, maxWidth);
-                widths.insert(visibleRole, maxWidth);
-            }
-
-            if (calculatedItemCount > 100 && timer.elapsed() > 200) {
-                // When having several thousands of items calculating the sizes can get
-                // very expensive. We accept a possibly too small role-size in favour
-                // of having no blocking user interface.
-                maxTimeExceeded = true;
-                break;
-            }
-            ++calculatedItemCount;
-        }
-        if (maxTimeExceeded) {
-            break;
-        }
+        // Ignore preferred column widths of the items that are
+        // smaller than the width for showing the headline unclipped.
+        const qreal itemsWidth = m_columnWidthResolver->maximumColumnWidth(visibleRole);
+        widths.insert(visibleRole, qMax(headerWidth, itemsWidth));
     }
 
     return widths;
@@ -2246,57 +2344,41 @@ void KItemListView::updateWidgetColumnWidths(KItemListWidget* widget)
     }
 }
 
-void KItemListView::updatePreferredColumnWidths(const KItemRangeList& itemRanges)
+void KItemListView::applyPreferredColumnWidths()
 {
     Q_ASSERT(m_itemSize.isEmpty());
-    const int itemCount = m_model->count();
-    int rangesItemCount = 0;
-    foreach (const KItemRange& range, itemRanges) {
-        rangesItemCount += range.count;
-    }
 
-    if (itemCount == rangesItemCount) {
-        const QHash<QByteArray, qreal> preferredWidths = preferredColumnWidths(itemRanges);
-        foreach (const QByteArray& role, m_visibleRoles) {
-            m_headerWidget->setPreferredColumnWidth(role, preferredWidths.value(role));
-        }
-    } else {
-        // Only a sub range of the roles need to be determined.
-        // The chances are good that the widths of the sub ranges
-        // already fit into the available widths and hence no
-        // expensive update might be required.
-        bool changed = false;
-
-        const QHash<QByteArray, qreal> updatedWidths = preferredColumnWidths(itemRanges);
-        QHashIterator<QByteArray, qreal> it(updatedWidths);
-        while (it.hasNext()) {
-            it.next();
-            const QByteArray& role = it.key();
-            const qreal updatedWidth = it.value();
-            const qreal currentWidth = m_headerWidget->preferredColumnWidth(role);
-            if (updatedWidth > currentWidth) {
-                m_headerWidget->setPreferredColumnWidth(role, updatedWidth);
-                changed = true;
-            }
-        }
+    // As long as the widths of some items are unresolved, the columns only grow.
+    // This prevents a flickering when the widths of all items are recalculated.
+    const bool allowShrinking = !m_columnWidthResolver->hasUnresolvedItems();
 
-        if (!changed) {
-            // All the updated sizes are smaller than the current sizes and no change
-            // of the stretched roles-widths is required
-            return;
+    bool changed = false;
+    const QHash<QByteArray, qreal> preferredWidths = preferredColumnWidths();
+    foreach (const QByteArray& role, m_visibleRoles) {
+        const qreal preferredWidth = preferredWidths.value(role);
+        const qreal currentWidth = m_headerWidget->preferredColumnWidth(role);
+        if (preferredWidth > currentWidth || (allowShrinking && preferredWidth < currentWidth)) {
+            m_headerWidget->setPreferredColumnWidth(role, preferredWidth);
+            changed = true;
         }
     }
 
-    if (m_headerWidget->automaticColumnResizing()) {
+    if (changed && m_headerWidget->automaticColumnResizing()) {
         applyAutomaticColumnWidths();
     }
 }
 
 void KItemListView::updatePreferredColumnWidths()
 {
-    if (m_model) {
-        updatePreferredColumnWidths(KItemRangeList() << KItemRange(0, m_model->count()));
+    Q_ASSERT(m_itemSize.isEmpty());
+    if (!m_model) {
+        return;
     }
+
+    // Recalculate the widths of all items. The first portion is done synchronously,
+    // the remaining items are resolved by m_columnWidthsTimer.
+    m_columnWidthResolver->setRoles(m_visibleRoles);
+    slotResolvePreferredColumnWidths();
 }
 
 void KItemListView::applyAutomaticColumnWidths()
@@ -2509,6 +2591,7 @@ void KItemListView::updateGroupHeaderHeight()
     m_layouter->setGroupHeaderHeight(groupHeaderHeight);
     m_layouter->setGroupHeaderMargin(groupHeaderMargin);
 
+    m_layouter->markAsDirty();
     updateVisibleGroupHeaders();
 }
 
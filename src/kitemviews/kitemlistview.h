@@ -33,6 +33,7 @@
 #include <QGraphicsWidget>
 #include <QSet>
 
+class KItemListColumnWidthResolver;
 class KItemListController;
 class KItemListGroupHeaderCreatorBase;
 class KItemListHeader;
@@ -111,6 +112,18 @@ public:
     void setEnabledSelectionToggles(bool enabled);
     bool enabledSelectionToggles() const;
 
+    /**
+     * If set to true, each item widget and group header is painted into a
+     * pixmap in device coordinates, which is reused until the widget gets
+     * updated, e.g., because its data, selection or hover state has been
+     * changed. Scrolling only moves the cached pixmaps then, which is much
+     * cheaper than painting the widgets again if software rendering is used,
+     * e.g., on remote X11 or VNC sessions. Per default the cache is disabled.
+     * @see QGraphicsItem::DeviceCoordinateCache
+     */
+    void setCachedItemPainting(bool cached);
+    bool cachedItemPainting() const;
+
     /**
      * @return Controller of the item-list. The controller gets
      *         initialized by KItemListController::setView() and will
@@ -208,6 +221,20 @@ public:
      */
     void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint) const;
 
+    /**
+     * Calculates the size hints of the items with the indexes \a indexes only.
+     * @see KItemListWidgetInformant::calculateItemSizeHints()
+     */
+    void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint) const;
+
+    /**
+     * Estimates the size hints of the items that have no size hint yet
+     * without doing an expensive text layout. The estimated hints are
+     * stored as negative values.
+     * @see KItemListWidgetInformant::estimateItemSizeHints()
+     */
+    void estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint) const;
+
     /**
      * If set to true, items having child-items can be expanded to show the child-items as
      * part of the view. Per default the expanding of items is disabled. If expanding of
@@ -414,6 +441,20 @@ private slots:
                                KItemListViewAnimation::AnimationType type);
     void slotLayoutTimerFinished();
 
+    /**
+     * Replaces a batch of estimated size hints by exact ones, starting
+     * with the items around the visible area. Is invoked repeatedly
+     * by m_estimatedSizeHintsTimer until no estimated size hints are left.
+     */
+    void slotResolveEstimatedSizeHints();
+
+    /**
+     * Calculates the preferred column-widths of a portion of the items
+     * that have not been resolved yet and applies them. Is invoked repeatedly
+     * by m_columnWidthsTimer until the widths of all items are known.
+     */
+    void slotResolvePreferredColumnWidths();
+
     void slotRubberBandPosChanged();
     void slotRubberBandActivationChanged(bool active);
 
@@ -544,7 +585,8 @@ private:
     /**
      * Helper method for slotGroupedSortingChanged(), slotSortOrderChanged()
      * and slotSortRoleChanged(): Iterates through all visible items and updates
-     * the group-header widgets.
+     * the group-header widgets. The caller must mark the layout of the items
+     * whose groups might have been changed as dirty.
      */
     void updateVisibleGroupHeaders();
 
@@ -575,13 +617,12 @@ private:
     bool useAlternateBackgrounds() const;
 
     /**
-     * @param itemRanges Items that must be checked for getting the widths of columns.
-     * @return           The preferred width of the column of each visible role. The width will
-     *                   be respected if the width of the item size is <= 0 (see
-     *                   KItemListView::setItemSize()). Per default an empty hash
-     *                   is returned.
+     * @return The preferred width of the column of each visible role, based on the
+     *         widths of the items that have been resolved by m_columnWidthResolver.
+     *         The width will be respected if the width of the item size is <= 0 (see
+     *         KItemListView::setItemSize()).
      */
-    QHash<QByteArray, qreal> preferredColumnWidths(const KItemRangeList& itemRanges) const;
+    QHash<QByteArray, qreal> preferredColumnWidths() const;
 
     /**
      * Applies the column-widths from m_headerWidget to the layout
@@ -595,14 +636,16 @@ private:
     void updateWidgetColumnWidths(KItemListWidget* widget);
 
     /**
-     * Updates the preferred column-widths of m_groupHeaderWidget by
-     * invoking KItemListView::columnWidths().
+     * Applies the preferred column-widths from KItemListView::preferredColumnWidths()
+     * to m_headerWidget. While the widths of some items are still unresolved,
+     * the preferred column-widths are only increased.
      */
-    void updatePreferredColumnWidths(const KItemRangeList& itemRanges);
+    void applyPreferredColumnWidths();
 
     /**
-     * Convenience method for
-     * updatePreferredColumnWidths(KItemRangeList() << KItemRange(0, m_model->count()).
+     * Recalculates the preferred column-widths of all items. Only a first
+     * portion is calculated synchronously, the remaining items are resolved
+     * asynchronously by slotResolvePreferredColumnWidths().
      */
     void updatePreferredColumnWidths();
 
@@ -707,6 +750,7 @@ private:
 
 private:
     bool m_enabledSelectionToggles;
+    bool m_cachedItemPainting;
     bool m_grouped;
     bool m_supportsItemExpanding;
     bool m_editingRole;
@@ -735,10 +779,13 @@ private:
 
     int m_scrollBarExtent;
     KItemListSizeHintResolver* m_sizeHintResolver;
+    KItemListColumnWidthResolver* m_columnWidthResolver;
     KItemListViewLayouter* m_layouter;
     KItemListViewAnimation* m_animation;
 
     QTimer* m_layoutTimer; // Triggers an asynchronous doLayout() call.
+    QTimer* m_estimatedSizeHintsTimer; // Triggers slotResolveEstimatedSizeHints().
+    QTimer* m_columnWidthsTimer; // Triggers slotResolvePreferredColumnWidths().
     qreal m_oldScrollOffset;
     qreal m_oldMaximumScrollOffset;
     qreal m_oldItemOffset;
@@ -763,7 +810,7 @@ private:
     QRectF m_dropIndicator;
 
     friend class KItemListContainer; // Accesses scrollBarRequired()
-    friend class KItemListHeader;    // Accesses m_headerWidget
+    friend class KItemListHeader;    // Accesses m_headerWidget and m_columnWidthResolver
     friend class KItemListController;
     friend class KItemListControllerTest;
     friend class KItemListViewAccessible;
@@ -811,6 +858,10 @@ public:
 
     virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const = 0;
 
+    virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const = 0;
+
+    virtual void estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const = 0;
+
     virtual qreal preferredRoleColumnWidth(const QByteArray& role,
                                            int index,
                                            const KItemListView* view) const = 0;
@@ -830,6 +881,10 @@ public:
 
     void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const override;
 
+    void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const override;
+
+    void estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const override;
+
     qreal preferredRoleColumnWidth(const QByteArray& role,
                                            int index,
                                            const KItemListView* view) const override;
@@ -866,6 +921,18 @@ void KItemListWidgetCreator<T>::calculateItemSizeHints(QVector<qreal>& logicalHe
     return m_informant->calculateItemSizeHints(logicalHeightHints, logicalWidthHint, view);
 }
 
+template<class T>
+void KItemListWidgetCreator<T>::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    return m_informant->calculateItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, view);
+}
+
+template<class T>
+void KItemListWidgetCreator<T>::estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    return m_informant->estimateItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+}
+
 template<class T>
 qreal KItemListWidgetCreator<T>::preferredRoleColumnWidth(const QByteArray& role,
                                                           int index,
@@ -38,6 +38,17 @@ KItemListWidgetInformant::~KItemListWidgetInformant()
 {
 }
 
+void KItemListWidgetInformant::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    Q_UNUSED(indexes);
+    calculateItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+}
+
+void KItemListWidgetInformant::estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    calculateItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+}
+
 KItemListWidget::KItemListWidget(KItemListWidgetInformant* informant, QGraphicsItem* parent) :
     QGraphicsWidget(parent, nullptr),
     m_informant(informant),
@@ -78,6 +89,10 @@ void KItemListWidget::setIndex(int index)
         clearHoverCache();
 
         m_index = index;
+
+        // The hover state has been reset, which must also be
+        // visible if the painting of the widget is cached.
+        update();
     }
 }
 
@@ -48,8 +48,31 @@ public:
     KItemListWidgetInformant();
     virtual ~KItemListWidgetInformant();
 
+    /**
+     * Calculates the logical height hints for all items that have a
+     * logical height hint of 0.0. Items with a different hint are skipped.
+     */
     virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const = 0;
 
+    /**
+     * Calculates the logical height hints for the items with the indexes
+     * \a indexes only, which must have a logical height hint of 0.0. This
+     * allows to resolve a few items of a large model without checking the
+     * hints of all items. The default implementation invokes
+     * calculateItemSizeHints() for all items.
+     */
+    virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const;
+
+    /**
+     * Estimates the logical height hints for all items that have a logical
+     * height hint of 0.0 without doing an expensive text layout. Estimated
+     * hints are stored as negative values, so that the caller can replace
+     * them by exact hints later by resetting them to 0.0 and invoking
+     * calculateItemSizeHints(). The default implementation calculates the
+     * exact hints.
+     */
+    virtual void estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
+
     virtual qreal preferredRoleColumnWidth(const QByteArray& role,
                                            int index,
                                            const KItemListView* view) const = 0;
@@ -23,6 +23,15 @@
 
 #include <KIconLoader>
 
+#include <QPixmapCache>
+
+namespace {
+    // Minimum size of QPixmapCache in KiB. The icons and the pixmaps with
+    // effects are shared by all widgets via QPixmapCache, so it must be able
+    // to keep at least the pixmaps of all visible items.
+    const int MinimumPixmapCacheLimit = 64 * 1024;
+}
+
 KStandardItemListView::KStandardItemListView(QGraphicsWidget* parent) :
     KItemListView(parent),
     m_itemLayout(DetailsLayout)
@@ -30,6 +39,10 @@ KStandardItemListView::KStandardItemListView(QGraphicsWidget* parent) :
     setAcceptDrops(true);
     setScrollOrientation(Qt::Vertical);
     setVisibleRoles({"text"});
+
+    if (QPixmapCache::cacheLimit() < MinimumPixmapCacheLimit) {
+        QPixmapCache::setCacheLimit(MinimumPixmapCacheLimit);
+    }
 }
 
 KStandardItemListView::~KStandardItemListView()
@@ -28,7 +28,6 @@
 #include <KIconEffect>
 #include <KIconLoader>
 #include <KRatingPainter>
-#include <KStringHandler>
 
 #include <QGraphicsScene>
 #include <QGraphicsSceneResizeEvent>
@@ -36,11 +35,22 @@
 #include <QGuiApplication>
 #include <QPixmapCache>
 #include <QStyleOption>
+#include <QtMath>
 
 // #define KSTANDARDITEMLISTWIDGET_DEBUG
 
+namespace {
+    // Maximum number of texts whose widths are cached by
+    // KStandardItemListWidgetInformant::textWidth() per font
+    const int MaxCachedTextWidths = 1000;
+}
+
 KStandardItemListWidgetInformant::KStandardItemListWidgetInformant() :
-    KItemListWidgetInformant()
+    KItemListWidgetInformant(),
+    m_textWidthCache(MaxCachedTextWidths),
+    m_linkTextWidthCache(MaxCachedTextWidths),
+    m_textWidthCacheKey(),
+    m_textLayoutCache()
 {
 }
 
@@ -49,18 +59,52 @@ KStandardItemListWidgetInformant::~KStandardItemListWidgetInformant()
 }
 
 void KStandardItemListWidgetInformant::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    QVector<int> indexes;
+    for (int index = 0; index < logicalHeightHints.count(); ++index) {
+        if (logicalHeightHints.at(index) == 0.0) {
+            indexes.append(index);
+        }
+    }
+
+    calculateItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, view);
+}
+
+void KStandardItemListWidgetInformant::calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
 {
     switch (static_cast<const KStandardItemListView*>(view)->itemLayout()) {
     case KStandardItemListView::IconsLayout:
-        calculateIconsLayoutItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+        calculateIconsLayoutItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, view);
         break;
 
     case KStandardItemListView::CompactLayout:
-        calculateCompactLayoutItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+        calculateCompactLayoutItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, view);
         break;
 
     case KStandardItemListView::DetailsLayout:
-        calculateDetailsLayoutItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+        calculateDetailsLayoutItemSizeHints(logicalHeightHints, indexes, logicalWidthHint, view);
+        break;
+
+    default:
+        Q_ASSERT(false);
+        break;
+    }
+}
+
+void KStandardItemListWidgetInformant::estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    switch (static_cast<const KStandardItemListView*>(view)->itemLayout()) {
+    case KStandardItemListView::IconsLayout:
+        estimateIconsLayoutItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+        break;
+
+    case KStandardItemListView::CompactLayout:
+        estimateCompactLayoutItemSizeHints(logicalHeightHints, logicalWidthHint, view);
+        break;
+
+    case KStandardItemListView::DetailsLayout:
+        // The hints of the details layout are cheap, no estimation is necessary
+        calculateItemSizeHints(logicalHeightHints, logicalWidthHint, view);
         break;
 
     default:
@@ -86,9 +130,10 @@ qreal KStandardItemListWidgetInformant::preferredRoleColumnWidth(const QByteArra
         width += KStandardItemListWidget::preferredRatingSize(option).width();
     } else {
         // If current item is a link, we use the customized link font metrics instead of the normal font metrics.
-        const QFontMetrics& fontMetrics = itemIsLink(index, view) ? linkFontMetrics : normalFontMetrics;
+        const bool isLink = itemIsLink(index, view);
+        const QFontMetrics& fontMetrics = isLink ? linkFontMetrics : normalFontMetrics;
 
-        width += fontMetrics.width(text);
+        width += textWidth(text, role, option.font, fontMetrics, isLink);
 
         if (role == "text") {
             if (view->supportsItemExpanding()) {
@@ -133,7 +178,7 @@ QFont KStandardItemListWidgetInformant::customizedFontForLinks(const QFont& base
     return baseFont;
 }
 
-void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
 {
     const KItemListStyleOption& option = view->styleOption();
     const QFont& normalFont = option.font;
@@ -146,37 +191,12 @@ void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector
 
     const QFont linkFont = customizedFontForLinks(normalFont);
 
-    QTextOption textOption(Qt::AlignHCenter);
-    textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
-
-    for (int index = 0; index < logicalHeightHints.count(); ++index) {
-        if (logicalHeightHints.at(index) > 0.0) {
-            continue;
-        }
-
+    foreach (int index, indexes) {
         // If the current item is a link, we use the customized link font instead of the normal font.
-        const QFont& font = itemIsLink(index, view) ? linkFont : normalFont;
-
-        const QString& text = KStringHandler::preProcessWrap(itemText(index, view));
-
-        // Calculate the number of lines required for wrapping the name
-        qreal textHeight = 0;
-        QTextLayout layout(text, font);
-        layout.setTextOption(textOption);
-        layout.beginLayout();
-        QTextLine line;
-        int lineCount = 0;
-        while ((line = layout.createLine()).isValid()) {
-            line.setLineWidth(maxWidth);
-            line.naturalTextWidth();
-            textHeight += line.height();
-
-            ++lineCount;
-            if (lineCount == option.maxTextLines) {
-                break;
-            }
-        }
-        layout.endLayout();
+        const bool isLink = itemIsLink(index, view);
+        const QFont& font = isLink ? linkFont : normalFont;
+
+        qreal textHeight = wrappedTextHeight(itemText(index, view), font, maxWidth, option.maxTextLines);
 
         // Add one line for each additional information
         textHeight += additionalRolesSpacing;
@@ -187,7 +207,7 @@ void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector
     logicalWidthHint = itemWidth;
 }
 
-void KStandardItemListWidgetInformant::calculateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+void KStandardItemListWidgetInformant::calculateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
 {
     const KItemListStyleOption& option = view->styleOption();
     const QFontMetrics& normalFontMetrics = option.fontMetrics;
@@ -201,25 +221,22 @@ void KStandardItemListWidgetInformant::calculateCompactLayoutItemSizeHints(QVect
 
     const QFontMetrics linkFontMetrics(customizedFontForLinks(option.font));
 
-    for (int index = 0; index < logicalHeightHints.count(); ++index) {
-        if (logicalHeightHints.at(index) > 0.0) {
-            continue;
-        }
-
+    foreach (int index, indexes) {
         // If the current item is a link, we use the customized link font metrics instead of the normal font metrics.
-        const QFontMetrics& fontMetrics = itemIsLink(index, view) ? linkFontMetrics : normalFontMetrics;
+        const bool isLink = itemIsLink(index, view);
+        const QFontMetrics& fontMetrics = isLink ? linkFontMetrics : normalFontMetrics;
 
         // For each row exactly one role is shown. Calculate the maximum required width that is necessary
         // to show all roles without horizontal clipping.
         qreal maximumRequiredWidth = 0.0;
 
         if (showOnlyTextRole) {
-            maximumRequiredWidth = fontMetrics.width(itemText(index, view));
+            maximumRequiredWidth = textWidth(itemText(index, view), "text", option.font, fontMetrics, isLink);
         } else {
             const QHash<QByteArray, QVariant>& values = view->model()->data(index);
             foreach (const QByteArray& role, visibleRoles) {
                 const QString& text = roleText(role, values);
-                const qreal requiredWidth = fontMetrics.width(text);
+                const qreal requiredWidth = textWidth(text, role, option.font, fontMetrics, isLink);
                 maximumRequiredWidth = qMax(maximumRequiredWidth, requiredWidth);
             }
         }
@@ -235,14 +252,118 @@ void KStandardItemListWidgetInformant::calculateCompactLayoutItemSizeHints(QVect
     logicalWidthHint = height;
 }
 
-void KStandardItemListWidgetInformant::calculateDetailsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+void KStandardItemListWidgetInformant::calculateDetailsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const
 {
     const KItemListStyleOption& option = view->styleOption();
     const qreal height = option.padding * 2 + qMax(option.iconSize, option.fontMetrics.height());
-    logicalHeightHints.fill(height);
+    foreach (int index, indexes) {
+        logicalHeightHints[index] = height;
+    }
     logicalWidthHint = -1.0;
 }
 
+void KStandardItemListWidgetInformant::estimateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    const KItemListStyleOption& option = view->styleOption();
+    const QFontMetrics& fontMetrics = option.fontMetrics;
+    const int additionalRolesCount = qMax(view->visibleRoles().count() - 1, 0);
+
+    const qreal itemWidth = view->itemSize().width();
+    const qreal maxWidth = qMax(qreal(1), itemWidth - 2 * option.padding);
+    const qreal additionalRolesSpacing = additionalRolesCount * fontMetrics.lineSpacing();
+    const qreal spacingAndIconHeight = option.iconSize + option.padding * 3;
+    const qreal averageCharWidth = fontMetrics.averageCharWidth();
+
+    for (int index = 0; index < logicalHeightHints.count(); ++index) {
+        if (logicalHeightHints.at(index) != 0.0) {
+            continue;
+        }
+
+        // Assume that the characters of the text have an average width, which
+        // gives the number of lines without doing an expensive text layout.
+        const int textLength = itemText(index, view).length();
+        int lineCount = qMax(1, qCeil(textLength * averageCharWidth / maxWidth));
+        if (option.maxTextLines > 0) {
+            lineCount = qMin(lineCount, option.maxTextLines);
+        }
+
+        const qreal textHeight = lineCount * fontMetrics.height() + additionalRolesSpacing;
+        logicalHeightHints[index] = -(textHeight + spacingAndIconHeight);
+    }
+
+    logicalWidthHint = itemWidth;
+}
+
+void KStandardItemListWidgetInformant::estimateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
+{
+    const KItemListStyleOption& option = view->styleOption();
+    const QFontMetrics& fontMetrics = option.fontMetrics;
+    const int additionalRolesCount = qMax(view->visibleRoles().count() - 1, 0);
+
+    const qreal maxWidth = option.maxTextWidth;
+    const qreal paddingAndIconWidth = option.padding * 4 + option.iconSize;
+    const qreal height = option.padding * 2 + qMax(option.iconSize, (1 + additionalRolesCount) * fontMetrics.lineSpacing());
+    const qreal averageCharWidth = fontMetrics.averageCharWidth();
+
+    for (int index = 0; index < logicalHeightHints.count(); ++index) {
+        if (logicalHeightHints.at(index) != 0.0) {
+            continue;
+        }
+
+        // Only the name is taken into account for the estimation, the
+        // additional roles are usually shorter.
+        qreal width = paddingAndIconWidth + itemText(index, view).length() * averageCharWidth;
+        if (maxWidth > 0 && width > maxWidth) {
+            width = maxWidth;
+        }
+
+        logicalHeightHints[index] = -width;
+    }
+
+    logicalWidthHint = height;
+}
+
+qreal KStandardItemListWidgetInformant::wrappedTextHeight(const QString& text, const QFont& font, qreal maxWidth, int maxTextLines) const
+{
+    // The layout is shared with the widgets, which show the same
+    // text for the same font, width and maximum number of lines.
+    return m_textLayoutCache.layout(text, font, maxWidth,
+                                    KItemListTextLayoutCache::IconsLayoutName,
+                                    maxTextLines).height;
+}
+
+qreal KStandardItemListWidgetInformant::textWidth(const QString& text, const QByteArray& role, const QFont& baseFont, const QFontMetrics& fontMetrics, bool isLink) const
+{
+    // Only the texts of these roles are shared by many items. Names and
+    // other texts that are usually unique are not cached.
+    static const QSet<QByteArray> cachedRoles = {
+        "size", "modificationtime", "creationtime", "accesstime", "deletiontime",
+        "type", "permissions", "owner", "group"
+    };
+    if (!cachedRoles.contains(role)) {
+        return fontMetrics.width(text);
+    }
+
+    // The font of links is derived from the base font,
+    // so the key of the base font identifies both caches.
+    const QString cacheKey = baseFont.key();
+    if (cacheKey != m_textWidthCacheKey) {
+        m_textWidthCache.clear();
+        m_linkTextWidthCache.clear();
+        m_textWidthCacheKey = cacheKey;
+    }
+
+    QCache<QString, qreal>& cache = isLink ? m_linkTextWidthCache : m_textWidthCache;
+    const qreal* cachedWidth = cache.object(text);
+    if (cachedWidth) {
+        return *cachedWidth;
+    }
+
+    const qreal width = fontMetrics.width(text);
+    cache.insert(text, new qreal(width));
+    return width;
+}
+
 KStandardItemListWidget::KStandardItemListWidget(KItemListWidgetInformant* informant, QGraphicsItem* parent) :
     KItemListWidget(informant, parent),
     m_isCut(false),
@@ -662,6 +783,11 @@ QString KStandardItemListWidget::roleText(const QByteArray& role,
     return static_cast<const KStandardItemListWidgetInformant*>(informant())->roleText(role, values);
 }
 
+KItemListTextLayoutCache& KStandardItemListWidget::textLayoutCache() const
+{
+    return static_cast<const KStandardItemListWidgetInformant*>(informant())->m_textLayoutCache;
+}
+
 void KStandardItemListWidget::dataChanged(const QHash<QByteArray, QVariant>& current,
                                           const QSet<QByteArray>& roles)
 {
@@ -971,23 +1097,22 @@ void KStandardItemListWidget::updatePixmapCache()
         } else if (m_pixmap.width() / m_pixmap.devicePixelRatio() != maxIconWidth || m_pixmap.height() / m_pixmap.devicePixelRatio() != maxIconHeight) {
             // A custom pixmap has been applied. Assure that the pixmap
             // is scaled to the maximum available size.
-            KPixmapModifier::scale(m_pixmap, QSize(maxIconWidth, maxIconHeight) * qApp->devicePixelRatio());
+            m_pixmap = pixmapWithEffect(m_pixmap, ScaledEffect, QColor(), QSize(maxIconWidth, maxIconHeight) * qApp->devicePixelRatio());
         }
 
+        // The effects are shared by all widgets. Changing e.g. the selection
+        // of an item only swaps pixmaps that have been created already.
         if (m_isCut) {
-            KIconEffect* effect = KIconLoader::global()->iconEffect();
-            m_pixmap = effect->apply(m_pixmap, KIconLoader::Desktop, KIconLoader::DisabledState);
+            m_pixmap = pixmapWithEffect(m_pixmap, DisabledEffect);
         }
 
         if (m_isHidden) {
-            KIconEffect::semiTransparent(m_pixmap);
+            m_pixmap = pixmapWithEffect(m_pixmap, SemiTransparentEffect);
         }
 
         if (m_layout == IconsLayout && isSelected()) {
             const QColor color = palette().brush(QPalette::Normal, QPalette::Highlight).color();
-            QImage image = m_pixmap.toImage();
-            KIconEffect::colorize(image, color, 0.8f);
-            m_pixmap = QPixmap::fromImage(image);
+            m_pixmap = pixmapWithEffect(m_pixmap, SelectedEffect, color);
         }
     }
 
@@ -1037,14 +1162,7 @@ void KStandardItemListWidget::updatePixmapCache()
 
     // Prepare the pixmap that is used when the item gets hovered
     if (isHovered()) {
-        m_hoverPixmap = m_pixmap;
-        KIconEffect* effect = KIconLoader::global()->iconEffect();
-        // In the KIconLoader terminology, active = hover.
-        if (effect->hasEffect(KIconLoader::Desktop, KIconLoader::ActiveState)) {
-            m_hoverPixmap = effect->apply(m_pixmap, KIconLoader::Desktop, KIconLoader::ActiveState);
-        } else {
-            m_hoverPixmap = m_pixmap;
-        }
+        m_hoverPixmap = pixmapWithEffect(m_pixmap, HoverEffect);
     } else if (hoverOpacity() <= 0.0) {
         // No hover animation is ongoing. Clear m_hoverPixmap to save memory.
         m_hoverPixmap = QPixmap();
@@ -1136,58 +1254,15 @@ void KStandardItemListWidget::updateIconsLayoutTextCache()
     // Initialize properties for the "text" role. It will be used as anchor
     // for initializing the position of the other roles.
     TextInfo* nameTextInfo = m_textInfo.value("text");
-    const QString nameText = KStringHandler::preProcessWrap(values["text"].toString());
-    nameTextInfo->staticText.setText(nameText);
-
-    // Calculate the number of lines required for the name and the required width
-    qreal nameWidth = 0;
-    qreal nameHeight = 0;
-    QTextLine line;
-
-    QTextLayout layout(nameTextInfo->staticText.text(), m_customizedFont);
-    layout.setTextOption(nameTextInfo->staticText.textOption());
-    layout.beginLayout();
-    int nameLineIndex = 0;
-    while ((line = layout.createLine()).isValid()) {
-        line.setLineWidth(maxWidth);
-        nameWidth = qMax(nameWidth, line.naturalTextWidth());
-        nameHeight += line.height();
-
-        ++nameLineIndex;
-        if (nameLineIndex == option.maxTextLines) {
-            // The maximum number of textlines has been reached. If this is
-            // the case provide an elided text if necessary.
-            const int textLength = line.textStart() + line.textLength();
-            if (textLength < nameText.length()) {
-                // Elide the last line of the text
-                qreal elidingWidth = maxWidth;
-                qreal lastLineWidth;
-                do {
-                    QString lastTextLine = nameText.mid(line.textStart());
-                    lastTextLine = m_customizedFontMetrics.elidedText(lastTextLine,
-                                                                      Qt::ElideRight,
-                                                                      elidingWidth);
-                    const QString elidedText = nameText.left(line.textStart()) + lastTextLine;
-                    nameTextInfo->staticText.setText(elidedText);
-
-                    lastLineWidth = m_customizedFontMetrics.boundingRect(lastTextLine).width();
-
-                    // We do the text eliding in a loop with decreasing width (1 px / iteration)
-                    // to avoid problems related to different width calculation code paths
-                    // within Qt. (see bug 337104)
-                    elidingWidth -= 1.0;
-                } while (lastLineWidth > maxWidth);
-
-                nameWidth = qMax(nameWidth, lastLineWidth);
-            }
-            break;
-        }
-    }
-    layout.endLayout();
+    const KItemListTextLayoutCache::TextLayout nameLayout =
+        textLayoutCache().layout(values["text"].toString(), m_customizedFont, maxWidth,
+                                 KItemListTextLayoutCache::IconsLayoutName, option.maxTextLines);
+    nameTextInfo->staticText = nameLayout.staticText;
+    const qreal nameWidth = nameLayout.width;
+    const qreal nameHeight = nameLayout.height;
 
     // Use one line for each additional information
     const int additionalRolesCount = qMax(visibleRoles().count() - 1, 0);
-    nameTextInfo->staticText.setTextWidth(maxWidth);
     nameTextInfo->pos = QPointF(padding, widgetHeight -
                                          nameHeight -
                                          additionalRolesCount * lineSpacing -
@@ -1204,35 +1279,19 @@ void KStandardItemListWidget::updateIconsLayoutTextCache()
             continue;
         }
 
-        const QString text = roleText(role, values);
+        const KItemListTextLayoutCache::TextLayout layout =
+            textLayoutCache().layout(roleText(role, values), m_customizedFont, maxWidth,
+                                     KItemListTextLayoutCache::IconsLayoutRole);
         TextInfo* textInfo = m_textInfo.value(role);
-        textInfo->staticText.setText(text);
-
-        qreal requiredWidth = 0;
+        textInfo->staticText = layout.staticText;
 
-        QTextLayout layout(text, m_customizedFont);
-        QTextOption textOption;
-        textOption.setWrapMode(QTextOption::NoWrap);
-        layout.setTextOption(textOption);
-
-        layout.beginLayout();
-        QTextLine textLine = layout.createLine();
-        if (textLine.isValid()) {
-            textLine.setLineWidth(maxWidth);
-            requiredWidth = textLine.naturalTextWidth();
-            if (requiredWidth > maxWidth) {
-                const QString elidedText = m_customizedFontMetrics.elidedText(text, Qt::ElideRight, maxWidth);
-                textInfo->staticText.setText(elidedText);
-                requiredWidth = m_customizedFontMetrics.width(elidedText);
-            } else if (role == "rating") {
-		// Use the width of the rating pixmap, because the rating text is empty.
-                requiredWidth = m_rating.width();
-            }
+        qreal requiredWidth = layout.width;
+        if (role == "rating" && !layout.elided) {
+            // Use the width of the rating pixmap, because the rating text is empty.
+            requiredWidth = m_rating.width();
         }
-        layout.endLayout();
 
         textInfo->pos = QPointF(padding, y);
-        textInfo->staticText.setTextWidth(maxWidth);
 
         const QRectF textRect(padding + (maxWidth - requiredWidth) / 2, y, requiredWidth, lineSpacing);
         m_textRect |= textRect;
@@ -1263,19 +1322,15 @@ void KStandardItemListWidget::updateCompactLayoutTextCache()
     qreal y = qRound((widgetHeight - textLinesHeight) / 2);
     const qreal maxWidth = size().width() - x - option.padding;
     foreach (const QByteArray& role, m_sortedVisibleRoles) {
-        const QString text = roleText(role, values);
+        const KItemListTextLayoutCache::TextLayout layout =
+            textLayoutCache().layout(roleText(role, values), m_customizedFont, maxWidth,
+                                     KItemListTextLayoutCache::CompactLayoutRole);
         TextInfo* textInfo = m_textInfo.value(role);
-        textInfo->staticText.setText(text);
+        textInfo->staticText = layout.staticText;
 
-        qreal requiredWidth = m_customizedFontMetrics.width(text);
-        if (requiredWidth > maxWidth) {
-            requiredWidth = maxWidth;
-            const QString elidedText = m_customizedFontMetrics.elidedText(text, Qt::ElideRight, maxWidth);
-            textInfo->staticText.setText(elidedText);
-        }
+        const qreal requiredWidth = layout.elided ? maxWidth : layout.width;
 
         textInfo->pos = QPointF(x, y);
-        textInfo->staticText.setTextWidth(maxWidth);
 
         maximumRequiredTextWidth = qMax(maximumRequiredTextWidth, requiredWidth);
 
@@ -1314,10 +1369,6 @@ void KStandardItemListWidget::updateDetailsLayoutTextCache()
     const qreal y = qMax(qreal(option.padding), (widgetHeight - fontHeight) / 2);
 
     foreach (const QByteArray& role, m_sortedVisibleRoles) {
-        QString text = roleText(role, values);
-
-        // Elide the text in case it does not fit into the available column-width
-        qreal requiredWidth = m_customizedFontMetrics.width(text);
         const qreal roleWidth = columnWidth(role);
         qreal availableTextWidth = roleWidth - columnWidthInc;
 
@@ -1326,13 +1377,14 @@ void KStandardItemListWidget::updateDetailsLayoutTextCache()
             availableTextWidth -= firstColumnInc;
         }
 
-        if (requiredWidth > availableTextWidth) {
-            text = m_customizedFontMetrics.elidedText(text, Qt::ElideRight, availableTextWidth);
-            requiredWidth = m_customizedFontMetrics.width(text);
-        }
+        // The text is elided in case it does not fit into the available column-width
+        const KItemListTextLayoutCache::TextLayout layout =
+            textLayoutCache().layout(roleText(role, values), m_customizedFont, availableTextWidth,
+                                     KItemListTextLayoutCache::DetailsLayoutRole);
+        const qreal requiredWidth = layout.width;
 
         TextInfo* textInfo = m_textInfo.value(role);
-        textInfo->staticText.setText(text);
+        textInfo->staticText = layout.staticText;
         textInfo->pos = QPointF(x + columnWidthInc / 2, y);
         x += roleWidth;
 
@@ -1523,13 +1575,71 @@ QPixmap KStandardItemListWidget::pixmapForIcon(const QString& name, const QStrin
             }
         }
 
+        // The device pixel ratio is set before inserting the pixmap. Otherwise
+        // setting it would detach each copy and change its cache key, which
+        // is used by pixmapWithEffect().
+        pixmap.setDevicePixelRatio(qApp->devicePixelRatio());
         QPixmapCache::insert(key, pixmap);
     }
-    pixmap.setDevicePixelRatio(qApp->devicePixelRatio());
 
     return pixmap;
 }
 
+QPixmap KStandardItemListWidget::pixmapWithEffect(const QPixmap& pixmap, PixmapEffect effect,
+                                                  const QColor& color, const QSize& size)
+{
+    if (pixmap.isNull()) {
+        return pixmap;
+    }
+
+    // QPixmap::cacheKey() is the same for all copies of a pixmap and
+    // changes if a pixmap is modified.
+    const QString key = "KStandardItemListWidget:effect:" % QString::number(pixmap.cacheKey()) % ":"
+                        % QString::number(effect) % ":" % QString::number(color.rgba()) % ":"
+                        % QString::number(size.width()) % "x" % QString::number(size.height());
+    QPixmap result;
+
+    if (!QPixmapCache::find(key, result)) {
+        switch (effect) {
+        case ScaledEffect:
+            result = pixmap;
+            KPixmapModifier::scale(result, size);
+            break;
+
+        case DisabledEffect:
+            result = KIconLoader::global()->iconEffect()->apply(pixmap, KIconLoader::Desktop, KIconLoader::DisabledState);
+            break;
+
+        case SemiTransparentEffect:
+            result = pixmap;
+            KIconEffect::semiTransparent(result);
+            break;
+
+        case SelectedEffect: {
+            QImage image = pixmap.toImage();
+            KIconEffect::colorize(image, color, 0.8f);
+            result = QPixmap::fromImage(image);
+            break;
+        }
+
+        case HoverEffect: {
+            KIconEffect* iconEffect = KIconLoader::global()->iconEffect();
+            // In the KIconLoader terminology, active = hover.
+            if (iconEffect->hasEffect(KIconLoader::Desktop, KIconLoader::ActiveState)) {
+                result = iconEffect->apply(pixmap, KIconLoader::Desktop, KIconLoader::ActiveState);
+            } else {
+                result = pixmap;
+            }
+            break;
+        }
+        }
+
+        QPixmapCache::insert(key, result);
+    }
+
+    return result;
+}
+
 QSizeF KStandardItemListWidget::preferredRatingSize(const KItemListStyleOption& option)
 {
     const qreal height = option.fontMetrics.ascent();
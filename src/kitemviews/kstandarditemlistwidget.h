@@ -22,7 +22,9 @@
 
 #include "dolphin_export.h"
 #include "kitemviews/kitemlistwidget.h"
+#include "kitemviews/private/kitemlisttextlayoutcache.h"
 
+#include <QCache>
 #include <QPixmap>
 #include <QPointF>
 #include <QStaticText>
@@ -39,6 +41,10 @@ public:
 
     void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const override;
 
+    void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const override;
+
+    void estimateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const override;
+
     qreal preferredRoleColumnWidth(const QByteArray& role,
                                            int index,
                                            const KItemListView* view) const override;
@@ -72,11 +78,40 @@ protected:
     */
     virtual QFont customizedFontForLinks(const QFont& baseFont) const;
 
-    void calculateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
-    void calculateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
-    void calculateDetailsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
+    void calculateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const;
+    void calculateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const;
+    void calculateDetailsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, const QVector<int>& indexes, qreal& logicalWidthHint, const KItemListView* view) const;
+
+    void estimateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
+    void estimateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
+
+private:
+    /**
+     * @return Height of the text \a text if it is wrapped into lines of
+     *         the width \a maxWidth. The layout is taken from m_textLayoutCache,
+     *         so that items with identical names share one text layout.
+     */
+    qreal wrappedTextHeight(const QString& text, const QFont& font, qreal maxWidth, int maxTextLines) const;
+
+    /**
+     * @return Width of the text \a text of the role \a role for the font metrics
+     *         \a fontMetrics, which belong to \a baseFont or to the customized link
+     *         font derived from it. Results are cached for roles like the size,
+     *         the date or the type, as many items share the same texts for them.
+     */
+    qreal textWidth(const QString& text, const QByteArray& role, const QFont& baseFont, const QFontMetrics& fontMetrics, bool isLink) const;
+
+private:
+    // Cached results of textWidth(), keyed by the text. The caches are
+    // cleared if the font changes.
+    mutable QCache<QString, qreal> m_textWidthCache;
+    mutable QCache<QString, qreal> m_linkTextWidthCache;
+    mutable QString m_textWidthCacheKey;
+
+    // Laid out texts that are shared by all widgets of the view
+    mutable KItemListTextLayoutCache m_textLayoutCache;
 
-    friend class KStandardItemListWidget; // Accesses roleText()
+    friend class KStandardItemListWidget; // Accesses roleText() and m_textLayoutCache
 };
 
 /**
@@ -215,8 +250,33 @@ private:
      */
     void closeRoleEditor();
 
+    /**
+     * @return Cache for the laid out texts, which is shared by all
+     *         widgets of the view and by the informant.
+     */
+    KItemListTextLayoutCache& textLayoutCache() const;
+
     static QPixmap pixmapForIcon(const QString& name, const QStringList& overlays, int size, QIcon::Mode mode);
 
+    enum PixmapEffect
+    {
+        ScaledEffect,
+        DisabledEffect,
+        SemiTransparentEffect,
+        SelectedEffect,
+        HoverEffect
+    };
+
+    /**
+     * @return Copy of \a pixmap with the effect \a effect applied. The color
+     *         \a color is used by SelectedEffect, and \a size is the size in
+     *         device pixels for ScaledEffect. The results are shared by all
+     *         widgets via QPixmapCache and are identified by the cache key of
+     *         \a pixmap.
+     */
+    static QPixmap pixmapWithEffect(const QPixmap& pixmap, PixmapEffect effect,
+                                    const QColor& color = QColor(), const QSize& size = QSize());
+
     /**
      * @return Preferred size of the rating-image based on the given
      *         style-option. The height of the font is taken as
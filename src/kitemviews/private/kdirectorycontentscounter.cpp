@@ -22,65 +22,112 @@
 #include "kitemviews/kfileitemmodel.h"
 
 #include <KDirWatch>
+#include <KMountPoint>
+#include <Solid/DeviceNotifier>
 
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+    // Maximum number of directories on the same file system that are
+    // counted at the same time by all KDirectoryContentsCounters.
+    const int MaxCountingJobsPerFileSystem = 4;
+
+    // Maximum time in ms after which the mount points are read again,
+    // even if Solid has not reported added or removed devices.
+    const int MaxMountPointsAge = 10000;
+
+    // Counting the contents of directories on network file systems blocks
+    // for most of the time. A separate thread pool prevents that these
+    // jobs occupy the global thread pool, which is used for sorting.
+    // Besides the threads, the pool keeps the state that is shared by all
+    // counters. Except for the threads, it is only accessed by the GUI thread.
+    class CountingThreadPool : public QThreadPool
+    {
+    public:
+        CountingThreadPool() :
+            counters(),
+            runningJobsPerFileSystem(),
+            m_mountPoints(),
+            m_mountPointsAge(),
+            m_mountPointsDirty(true)
+        {
+            setMaxThreadCount(qMax(2 * MaxCountingJobsPerFileSystem, QThread::idealThreadCount()));
+
+            const Solid::DeviceNotifier* notifier = Solid::DeviceNotifier::instance();
+            connect(notifier, &Solid::DeviceNotifier::deviceAdded, this, [this]() { m_mountPointsDirty = true; });
+            connect(notifier, &Solid::DeviceNotifier::deviceRemoved, this, [this]() { m_mountPointsDirty = true; });
+        }
+
+        /**
+         * @return The current mount points. They are read again if devices
+         *         have been added or removed, or if they are outdated.
+         */
+        const KMountPoint::List& mountPoints()
+        {
+            if (m_mountPointsDirty || m_mountPointsAge.hasExpired(MaxMountPointsAge)) {
+                // KMountPoint::List::findByPath() might block on network file systems,
+                // as it resolves symbolic links. fileSystem() only compares the paths.
+                m_mountPoints = KMountPoint::currentMountPoints();
+                m_mountPointsAge.start();
+                m_mountPointsDirty = false;
+            }
+            return m_mountPoints;
+        }
+
+        // Counters that might wait for a job on a file system to finish
+        QList<KDirectoryContentsCounter*> counters;
+
+        // Number of running jobs of all counters for each file system
+        QHash<QString, int> runningJobsPerFileSystem;
+
+    private:
+        KMountPoint::List m_mountPoints;
+        QElapsedTimer m_mountPointsAge;
+        bool m_mountPointsDirty;
+    };
+
+    Q_GLOBAL_STATIC(CountingThreadPool, s_countingThreadPool)
+}
 
 KDirectoryContentsCounter::KDirectoryContentsCounter(KFileItemModel* model, QObject* parent) :
     QObject(parent),
     m_model(model),
-    m_queue(),
-    m_worker(nullptr),
-    m_workerIsBusy(false),
+    m_queues(),
+    m_queuedPaths(),
+    m_runningPaths(),
+    m_firstVisibleIndex(0),
+    m_lastVisibleIndex(-1),
     m_dirWatcher(nullptr),
     m_watchedDirs()
 {
     connect(m_model, &KFileItemModel::itemsRemoved,
             this,    &KDirectoryContentsCounter::slotItemsRemoved);
 
-    if (!m_workerThread) {
-        m_workerThread = new QThread();
-        m_workerThread->start();
-    }
-
-    m_worker = new KDirectoryContentsCounterWorker();
-    m_worker->moveToThread(m_workerThread);
-    ++m_workersCount;
-
-    connect(this,     &KDirectoryContentsCounter::requestDirectoryContentsCount,
-            m_worker, &KDirectoryContentsCounterWorker::countDirectoryContents);
-    connect(m_worker, &KDirectoryContentsCounterWorker::result,
-            this,     &KDirectoryContentsCounter::slotResult);
-
     m_dirWatcher = new KDirWatch(this);
     connect(m_dirWatcher, &KDirWatch::dirty, this, &KDirectoryContentsCounter::slotDirWatchDirty);
+
+    s_countingThreadPool()->counters.append(this);
 }
 
 KDirectoryContentsCounter::~KDirectoryContentsCounter()
 {
-    --m_workersCount;
-
-    if (m_workersCount > 0) {
-        // The worker thread will continue running. It could even be running
-        // a method of m_worker at the moment, so we delete it using
-        // deleteLater() to prevent a crash.
-        m_worker->deleteLater();
-    } else {
-        // There are no remaining workers -> stop the worker thread.
-        m_workerThread->quit();
-        m_workerThread->wait();
-        delete m_workerThread;
-        m_workerThread = nullptr;
-
-        // The worker thread has finished running now, so it's safe to delete
-        // m_worker. deleteLater() would not work at all because the event loop
-        // which would deliver the event to m_worker is not running any more.
-        delete m_worker;
+    if (!s_countingThreadPool.isDestroyed()) {
+        s_countingThreadPool()->counters.removeOne(this);
     }
 }
 
 void KDirectoryContentsCounter::addDirectory(const QString& path)
 {
-    startWorker(path);
+    enqueue(path, false);
+    startWorkers();
 }
 
 int KDirectoryContentsCounter::countDirectoryContentsSynchronously(const QString& path)
@@ -90,32 +137,38 @@ int KDirectoryContentsCounter::countDirectoryContentsSynchronously(const QString
         m_watchedDirs.insert(path);
     }
 
-    KDirectoryContentsCounterWorker::Options options;
+    return KDirectoryContentsCounterWorker::subItemsCount(path, workerOptions());
+}
 
-    if (m_model->showHiddenFiles()) {
-        options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
-    }
+void KDirectoryContentsCounter::setVisibleIndexRange(int index, int count)
+{
+    m_firstVisibleIndex = index;
+    m_lastVisibleIndex = index + count - 1;
 
-    if (m_model->showDirectoriesOnly()) {
-        options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
-    }
+    for (QList<QString>& queue : m_queues) {
+        if (queue.count() > 1) {
+            QHash<QString, int> distances;
+            distances.reserve(queue.count());
+            foreach (const QString& path, queue) {
+                distances.insert(path, distanceToVisibleRange(path));
+            }
 
-    return KDirectoryContentsCounterWorker::subItemsCount(path, options);
+            std::stable_sort(queue.begin(), queue.end(), [&distances](const QString& a, const QString& b) {
+                return distances.value(a) < distances.value(b);
+            });
+        }
+    }
 }
 
 void KDirectoryContentsCounter::slotResult(const QString& path, int count)
 {
-    m_workerIsBusy = false;
+    m_runningPaths.remove(path);
 
     if (!m_dirWatcher->contains(path)) {
         m_dirWatcher->addDir(path);
         m_watchedDirs.insert(path);
     }
 
-    if (!m_queue.isEmpty()) {
-        startWorker(m_queue.dequeue());
-    }
-
     emit result(path, count);
 }
 
@@ -130,7 +183,9 @@ void KDirectoryContentsCounter::slotDirWatchDirty(const QString& path)
             return;
         }
 
-        startWorker(path);
+        // A running job might have missed the change.
+        enqueue(path, true);
+        startWorkers();
     }
 }
 
@@ -138,6 +193,29 @@ void KDirectoryContentsCounter::slotItemsRemoved()
 {
     const bool allItemsRemoved = (m_model->count() == 0);
 
+    // Don't count directories which are not part of the model anymore,
+    // e.g., because the user has navigated away.
+    if (allItemsRemoved) {
+        m_queues.clear();
+        m_queuedPaths.clear();
+    } else {
+        QMutableHashIterator<QString, QList<QString> > queueIt(m_queues);
+        while (queueIt.hasNext()) {
+            QMutableListIterator<QString> it(queueIt.next().value());
+            while (it.hasNext()) {
+                const QString& path = it.next();
+                if (m_model->index(QUrl::fromLocalFile(path)) < 0) {
+                    m_queuedPaths.remove(path);
+                    it.remove();
+                }
+            }
+
+            if (queueIt.value().isEmpty()) {
+                queueIt.remove();
+            }
+        }
+    }
+
     if (!m_watchedDirs.isEmpty()) {
         // Don't let KDirWatch watch for removed items
         if (allItemsRemoved) {
@@ -145,7 +223,6 @@ void KDirectoryContentsCounter::slotItemsRemoved()
                 m_dirWatcher->removeDir(path);
             }
             m_watchedDirs.clear();
-            m_queue.clear();
         } else {
             QMutableSetIterator<QString> it(m_watchedDirs);
             while (it.hasNext()) {
@@ -159,25 +236,118 @@ void KDirectoryContentsCounter::slotItemsRemoved()
     }
 }
 
-void KDirectoryContentsCounter::startWorker(const QString& path)
+void KDirectoryContentsCounter::enqueue(const QString& path, bool recountIfRunning)
 {
-    if (m_workerIsBusy) {
-        m_queue.enqueue(path);
-    } else {
-        KDirectoryContentsCounterWorker::Options options;
+    if (m_queuedPaths.contains(path) || (!recountIfRunning && m_runningPaths.contains(path))) {
+        return;
+    }
 
-        if (m_model->showHiddenFiles()) {
-            options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
-        }
+    // The file system is determined only once for each queued directory,
+    // so that starting the next jobs does not need to look at the mount points.
+    m_queues[fileSystem(path)].append(path);
+    m_queuedPaths.insert(path);
+}
+
+void KDirectoryContentsCounter::startWorkers()
+{
+    // startWorkers(fileSystem) might remove the queue of the file system.
+    foreach (const QString& fileSystem, m_queues.keys()) {
+        startWorkers(fileSystem);
+    }
+}
 
-        if (m_model->showDirectoriesOnly()) {
-            options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
+void KDirectoryContentsCounter::startWorkers(const QString& fileSystem)
+{
+    QHash<QString, QList<QString> >::iterator queueIt = m_queues.find(fileSystem);
+    if (queueIt == m_queues.end()) {
+        return;
+    }
+
+    CountingThreadPool* pool = s_countingThreadPool();
+    const KDirectoryContentsCounterWorker::Options options = workerOptions();
+
+    QList<QString>& queue = queueIt.value();
+    while (!queue.isEmpty() && pool->runningJobsPerFileSystem.value(fileSystem) < MaxCountingJobsPerFileSystem) {
+        const QString path = queue.takeFirst();
+        m_queuedPaths.remove(path);
+
+        if (m_model->index(QUrl::fromLocalFile(path)) < 0) {
+            // The directory has been removed from the model in the meantime.
+            continue;
         }
 
-        emit requestDirectoryContentsCount(path, options);
-        m_workerIsBusy = true;
+        m_runningPaths.insert(path);
+        ++pool->runningJobsPerFileSystem[fileSystem];
+
+        // The job only works on copies of its arguments, so it may finish after
+        // the counter has been deleted. The watcher belongs to the pool, so that
+        // the job is still taken into account until then. Only the directories
+        // of all counters that are queued for the same file system might be
+        // waiting for the job to finish.
+        auto watcher = new QFutureWatcher<int>(pool);
+        connect(watcher, &QFutureWatcher<int>::finished, pool, [pool, watcher, fileSystem]() {
+            watcher->deleteLater();
+            if (--pool->runningJobsPerFileSystem[fileSystem] <= 0) {
+                pool->runningJobsPerFileSystem.remove(fileSystem);
+            }
+
+            foreach (KDirectoryContentsCounter* counter, pool->counters) {
+                counter->startWorkers(fileSystem);
+            }
+        });
+        connect(watcher, &QFutureWatcher<int>::finished, this, [this, watcher, path]() {
+            slotResult(path, watcher->result());
+        });
+        watcher->setFuture(QtConcurrent::run(pool,
+                                             &KDirectoryContentsCounterWorker::subItemsCount,
+                                             path, options));
+    }
+
+    if (queue.isEmpty()) {
+        m_queues.erase(queueIt);
     }
 }
 
-QThread* KDirectoryContentsCounter::m_workerThread = nullptr;
-int KDirectoryContentsCounter::m_workersCount = 0;
+KDirectoryContentsCounterWorker::Options KDirectoryContentsCounter::workerOptions() const
+{
+    KDirectoryContentsCounterWorker::Options options;
+
+    if (m_model->showHiddenFiles()) {
+        options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
+    }
+
+    if (m_model->showDirectoriesOnly()) {
+        options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
+    }
+
+    return options;
+}
+
+QString KDirectoryContentsCounter::fileSystem(const QString& path) const
+{
+    QString result;
+    foreach (const KMountPoint::Ptr& mountPoint, s_countingThreadPool()->mountPoints()) {
+        const QString mountPointPath = mountPoint->mountPoint();
+        if (mountPointPath.length() > result.length()
+            && path.startsWith(mountPointPath)
+            && (path.length() == mountPointPath.length()
+                || mountPointPath.endsWith(QLatin1Char('/'))
+                || path.at(mountPointPath.length()) == QLatin1Char('/'))) {
+            result = mountPointPath;
+        }
+    }
+    return result;
+}
+
+int KDirectoryContentsCounter::distanceToVisibleRange(const QString& path) const
+{
+    const int index = m_model->index(QUrl::fromLocalFile(path));
+    if (index < 0) {
+        return INT_MAX;
+    } else if (index < m_firstVisibleIndex) {
+        return m_firstVisibleIndex - index;
+    } else if (index > m_lastVisibleIndex) {
+        return index - m_lastVisibleIndex;
+    }
+    return 0;
+}
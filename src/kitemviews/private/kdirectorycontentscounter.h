@@ -23,13 +23,26 @@
 
 #include "kdirectorycontentscounterworker.h"
 
-#include <QQueue>
+#include <QHash>
+#include <QList>
+#include <QObject>
 #include <QSet>
 
 class KDirWatch;
 class KFileItemModel;
 class QString;
 
+/**
+ * @brief Counts the items inside directories asynchronously.
+ *
+ * The directories are counted in a thread pool that is shared by all
+ * instances. All instances together count at most MaxCountingJobsPerFileSystem
+ * directories on the same file system at the same time, so that slow
+ * network file systems do not get flooded with requests. Queued
+ * directories which are in or close to the visible range are counted
+ * first, duplicate requests are ignored, and directories which have
+ * been removed from the model are not counted at all.
+ */
 class KDirectoryContentsCounter : public QObject
 {
     Q_OBJECT
@@ -57,32 +70,71 @@ public:
      */
     int countDirectoryContentsSynchronously(const QString& path);
 
+    /**
+     * Sets the range of items that are visible currently. Queued
+     * directories are counted in the order of their distance to this range.
+     */
+    void setVisibleIndexRange(int index, int count);
+
 signals:
     /**
      * Signals that the directory \a path contains \a count items.
      */
     void result(const QString& path, int count);
 
-    void requestDirectoryContentsCount(const QString& path, KDirectoryContentsCounterWorker::Options options);
-
 private slots:
-    void slotResult(const QString& path, int count);
     void slotDirWatchDirty(const QString& path);
     void slotItemsRemoved();
 
 private:
-    void startWorker(const QString& path);
+    /**
+     * Adds \a path to the queue unless it is queued already. If
+     * \a recountIfRunning is false, \a path is also ignored if it is
+     * being counted at the moment.
+     */
+    void enqueue(const QString& path, bool recountIfRunning);
+
+    /**
+     * Starts counting queued directories until the maximum number of
+     * jobs of all counters is running for each file system.
+     */
+    void startWorkers();
+
+    /**
+     * Starts counting the directories queued for the file system
+     * \a fileSystem until the maximum number of jobs of all counters
+     * is running for it.
+     */
+    void startWorkers(const QString& fileSystem);
+
+    void slotResult(const QString& path, int count);
+
+    KDirectoryContentsCounterWorker::Options workerOptions() const;
+
+    /**
+     * @return The mount point of the file system \a path belongs to. The
+     *         mount points are shared by all counters and are updated if
+     *         devices are added or removed.
+     */
+    QString fileSystem(const QString& path) const;
+
+    /**
+     * @return The distance of the item for \a path to the visible range,
+     *         or INT_MAX if \a path is not part of the model.
+     */
+    int distanceToVisibleRange(const QString& path) const;
 
 private:
     KFileItemModel* m_model;
 
-    QQueue<QString> m_queue;
-
-    static QThread* m_workerThread;
-    static int m_workersCount;
+    // Queued directories for each file system (see fileSystem()),
+    // sorted by their distance to the visible range
+    QHash<QString, QList<QString> > m_queues;
+    QSet<QString> m_queuedPaths;
+    QSet<QString> m_runningPaths;
 
-    KDirectoryContentsCounterWorker* m_worker;
-    bool m_workerIsBusy;
+    int m_firstVisibleIndex;
+    int m_lastVisibleIndex;
 
     KDirWatch* m_dirWatcher;
     QSet<QString> m_watchedDirs;    // Required as sadly KDirWatch does not offer a getter method
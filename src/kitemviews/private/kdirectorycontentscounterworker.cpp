@@ -28,12 +28,6 @@
     #include <qplatformdefs.h>
 #endif
 
-KDirectoryContentsCounterWorker::KDirectoryContentsCounterWorker(QObject* parent) :
-    QObject(parent)
-{
-    qRegisterMetaType<KDirectoryContentsCounterWorker::Options>();
-}
-
 int KDirectoryContentsCounterWorker::subItemsCount(const QString& path, Options options)
 {
     const bool countHiddenFiles = options & CountHiddenFiles;
@@ -88,8 +82,3 @@ int KDirectoryContentsCounterWorker::subItemsCount(const QString& path, Options
     return count;
 #endif
 }
-
-void KDirectoryContentsCounterWorker::countDirectoryContents(const QString& path, Options options)
-{
-    emit result(path, subItemsCount(path, options));
-}
@@ -20,15 +20,18 @@
 #ifndef KDIRECTORYCONTENTSCOUNTERWORKER_H
 #define KDIRECTORYCONTENTSCOUNTERWORKER_H
 
-#include <QMetaType>
-#include <QObject>
+#include <QFlags>
 
 class QString;
 
-class KDirectoryContentsCounterWorker : public QObject
+/**
+ * @brief Counts the items inside a directory.
+ *
+ * KDirectoryContentsCounter runs subItemsCount() in a thread pool, so
+ * that several directories can be counted at the same time.
+ */
+class KDirectoryContentsCounterWorker
 {
-    Q_OBJECT
-
 public:
     enum Option {
         NoOptions = 0x0,
@@ -37,8 +40,6 @@ public:
     };
     Q_DECLARE_FLAGS(Options, Option)
 
-    explicit KDirectoryContentsCounterWorker(QObject* parent = nullptr);
-
     /**
      * Counts the items inside the directory \a path using the options
      * \a options.
@@ -46,25 +47,8 @@ public:
      * @return The number of items.
      */
     static int subItemsCount(const QString& path, Options options);
-
-signals:
-    /**
-     * Signals that the directory \a path contains \a count items.
-     */
-    void result(const QString& path, int count);
-
-public slots:
-    /**
-     * Requests the number of items inside the directory \a path using the
-     * options \a options. The result is announced via the signal \a result.
-     */
-    // Note that the full type name KDirectoryContentsCounterWorker::Options
-    // is needed here. Just using 'Options' is OK for the compiler, but
-    // confuses moc.
-    void countDirectoryContents(const QString& path, KDirectoryContentsCounterWorker::Options options);
 };
 
-Q_DECLARE_METATYPE(KDirectoryContentsCounterWorker::Options)
 Q_DECLARE_OPERATORS_FOR_FLAGS(KDirectoryContentsCounterWorker::Options)
 
 #endif
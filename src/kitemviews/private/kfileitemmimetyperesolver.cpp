@@ -0,0 +1,198 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitemmimetyperesolver.h"
+
+#include <QFutureWatcher>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+namespace {
+    // Maximum time in ms that new items are held back until their MIME types are known
+    const int MaxResolvingDelay = 500;
+
+    // Minimum number of items whose MIME types are determined by one worker thread
+    const int MinItemsPerChunk = 50;
+
+    // Maximum number of threads that determine MIME types at the same time
+    const int MaxResolvingThreads = 4;
+
+    // Determining MIME types might block for a long time on network file
+    // systems. A separate thread pool prevents that these jobs occupy the
+    // global thread pool, which is used for sorting and filtering.
+    class MimeTypeThreadPool : public QThreadPool
+    {
+    public:
+        MimeTypeThreadPool()
+        {
+            setMaxThreadCount(qBound(1, QThread::idealThreadCount(), MaxResolvingThreads));
+        }
+    };
+
+    Q_GLOBAL_STATIC(MimeTypeThreadPool, s_mimeTypeThreadPool)
+}
+
+KFileItemMimeTypeResolver::KFileItemMimeTypeResolver(QObject* parent) :
+    QObject(parent),
+    m_batches(),
+    m_timer(nullptr)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(MaxResolvingDelay);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &KFileItemMimeTypeResolver::flush);
+}
+
+KFileItemMimeTypeResolver::~KFileItemMimeTypeResolver()
+{
+    clear();
+}
+
+void KFileItemMimeTypeResolver::resolve(const QUrl& directoryUrl, const KFileItemList& items)
+{
+    Batch batch;
+    batch.directoryUrl = directoryUrl;
+
+    KFileItemList unresolvedItems;
+    foreach (const KFileItem& item, items) {
+        // KFileItem::determineMimeType() reads the .directory file of directories
+        // to load the icon, which is not needed for the type. The type of
+        // directories is set by KFileItemModel::retrieveData().
+        if (item.isDir() || item.isMimeTypeKnown()) {
+            batch.items.append(item);
+        } else {
+            unresolvedItems.append(item);
+        }
+    }
+
+    if (!unresolvedItems.isEmpty()) {
+        const int itemCount = unresolvedItems.count();
+        const int chunkCount = qBound(1, itemCount / MinItemsPerChunk, s_mimeTypeThreadPool()->maxThreadCount());
+        const int chunkSize = (itemCount + chunkCount - 1) / chunkCount;
+
+        for (int first = 0; first < itemCount; first += chunkSize) {
+            const KFileItemList chunk = unresolvedItems.mid(first, chunkSize);
+
+            // refreshMimeType() detaches the copies from the items that are
+            // used by the GUI thread, e.g. in KDirLister.
+            KFileItemList copies = chunk;
+            for (int i = 0; i < copies.count(); ++i) {
+                copies[i].refreshMimeType();
+            }
+
+            auto watcher = new QFutureWatcher<KFileItemList>(this);
+            connect(watcher, &QFutureWatcher<KFileItemList>::finished,
+                    this, &KFileItemMimeTypeResolver::emitResolvedBatches);
+            watcher->setFuture(QtConcurrent::run(s_mimeTypeThreadPool(), determineMimeTypes, copies));
+
+            batch.chunks.append(chunk);
+            batch.watchers.append(watcher);
+        }
+
+        if (!m_timer->isActive()) {
+            m_timer->start();
+        }
+    }
+
+    m_batches.append(batch);
+    emitResolvedBatches();
+}
+
+bool KFileItemMimeTypeResolver::isBusy() const
+{
+    return !m_batches.isEmpty();
+}
+
+void KFileItemMimeTypeResolver::flush()
+{
+    m_timer->stop();
+    while (!m_batches.isEmpty()) {
+        emitBatch(m_batches.takeFirst());
+    }
+}
+
+void KFileItemMimeTypeResolver::clear()
+{
+    m_timer->stop();
+
+    // The worker threads cannot be interrupted. Their results are ignored.
+    foreach (const Batch& batch, m_batches) {
+        foreach (QFutureWatcher<KFileItemList>* watcher, batch.watchers) {
+            disconnect(watcher, nullptr, this, nullptr);
+            watcher->deleteLater();
+        }
+    }
+    m_batches.clear();
+}
+
+void KFileItemMimeTypeResolver::emitResolvedBatches()
+{
+    bool hasEmittedBatches = false;
+    while (!m_batches.isEmpty() && isResolved(m_batches.first())) {
+        emitBatch(m_batches.takeFirst());
+        hasEmittedBatches = true;
+    }
+
+    if (m_batches.isEmpty()) {
+        m_timer->stop();
+    } else if (hasEmittedBatches) {
+        // The delay starts again for the next batch
+        m_timer->start();
+    }
+}
+
+bool KFileItemMimeTypeResolver::isResolved(const Batch& batch) const
+{
+    foreach (const QFutureWatcher<KFileItemList>* watcher, batch.watchers) {
+        if (!watcher->isFinished()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KFileItemMimeTypeResolver::emitBatch(const Batch& batch)
+{
+    KFileItemList items = batch.items;
+    for (int i = 0; i < batch.chunks.count(); ++i) {
+        QFutureWatcher<KFileItemList>* watcher = batch.watchers.at(i);
+        if (watcher->isFinished()) {
+            items.append(watcher->result());
+        } else {
+            items.append(batch.chunks.at(i));
+        }
+
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->deleteLater();
+    }
+
+    emit itemsResolved(batch.directoryUrl, items);
+}
+
+KFileItemList KFileItemMimeTypeResolver::determineMimeTypes(const KFileItemList& items)
+{
+    // QMimeDatabase only sniffs the contents of a file if its
+    // name does not determine the MIME type unambiguously.
+    foreach (const KFileItem& item, items) {
+        item.determineMimeType();
+    }
+    return items;
+}
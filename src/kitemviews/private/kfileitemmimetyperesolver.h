@@ -0,0 +1,123 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMMIMETYPERESOLVER_H
+#define KFILEITEMMIMETYPERESOLVER_H
+
+#include "dolphin_export.h"
+
+#include <KFileItem>
+
+#include <QList>
+#include <QObject>
+#include <QUrl>
+
+template<typename T> class QFutureWatcher;
+class QTimer;
+
+/**
+ * @brief Determines the MIME types of new items in worker threads.
+ *
+ * If the items are sorted by type, KFileItemModel passes new items to
+ * resolve() before inserting them, so that they can be sorted correctly
+ * right away. The items are split into chunks, which are handled in
+ * parallel by a separate thread pool with a small number of threads.
+ * The items are announced by the signal itemsResolved() in the order
+ * in which they have been passed to resolve().
+ *
+ * Determining the MIME type may block for a long time, e.g. on slow
+ * network file systems. If the MIME types of a batch of items are not
+ * known after MaxResolvingDelay milliseconds, all queued items are
+ * announced anyway. The remaining MIME types are determined later by
+ * KFileItemModelRolesUpdater then.
+ */
+class DOLPHIN_EXPORT KFileItemMimeTypeResolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KFileItemMimeTypeResolver(QObject* parent = nullptr);
+    ~KFileItemMimeTypeResolver() override;
+
+    /**
+     * Determines the MIME types of \a items, which have been added to the
+     * directory \a directoryUrl. Directories and items whose MIME type is
+     * known already are not touched.
+     */
+    void resolve(const QUrl& directoryUrl, const KFileItemList& items);
+
+    /**
+     * @return True if items have been passed to resolve() that have not
+     *         been announced yet.
+     */
+    bool isBusy() const;
+
+    /**
+     * Announces all queued items immediately, even if their MIME
+     * types have not been determined yet.
+     */
+    void flush();
+
+    /**
+     * Forgets all queued items without announcing them.
+     */
+    void clear();
+
+signals:
+    /**
+     * Is emitted for each call of resolve(). The MIME types of \a items are
+     * known, unless the items have been announced early by flush().
+     */
+    void itemsResolved(const QUrl& directoryUrl, const KFileItemList& items);
+
+private slots:
+    /**
+     * Announces all batches at the beginning of the queue whose
+     * MIME types have been determined completely.
+     */
+    void emitResolvedBatches();
+
+private:
+    struct Batch
+    {
+        QUrl directoryUrl;
+        // Items which do not need to be resolved
+        KFileItemList items;
+        // Items which are resolved by the watchers. The worker threads operate
+        // on detached copies, so that these items are never accessed by two
+        // threads at the same time.
+        QList<KFileItemList> chunks;
+        QList<QFutureWatcher<KFileItemList>*> watchers;
+    };
+
+    bool isResolved(const Batch& batch) const;
+
+    /**
+     * Emits itemsResolved() for \a batch and deletes its watchers. Chunks that
+     * have not been resolved yet are announced with the original items.
+     */
+    void emitBatch(const Batch& batch);
+
+    static KFileItemList determineMimeTypes(const KFileItemList& items);
+
+    QList<Batch> m_batches;
+    QTimer* m_timer;
+};
+
+#endif
@@ -24,35 +24,27 @@
 
 
 KFileItemModelFilter::KFileItemModelFilter() :
-    m_useRegExp(false),
-    m_regExp(nullptr),
-    m_lowerCasePattern(),
+    m_useWildcards(false),
+    m_wildcardTokens(),
+    m_foldedPattern(),
     m_pattern()
 {
 }
 
 KFileItemModelFilter::~KFileItemModelFilter()
 {
-    delete m_regExp;
-    m_regExp = nullptr;
 }
 
 void KFileItemModelFilter::setPattern(const QString& filter)
 {
     m_pattern = filter;
-    m_lowerCasePattern = filter.toLower();
-
-    if (filter.contains('*') || filter.contains('?') || filter.contains('[')) {
-        if (!m_regExp) {
-            m_regExp = new QRegExp();
-            m_regExp->setCaseSensitivity(Qt::CaseInsensitive);
-            m_regExp->setMinimal(false);
-            m_regExp->setPatternSyntax(QRegExp::WildcardUnix);
-        }
-        m_regExp->setPattern(filter);
-        m_useRegExp = m_regExp->isValid();
-    } else {
-        m_useRegExp = false;
+    m_foldedPattern = foldedText(filter);
+
+    // Patterns that are no valid wildcard expression, like "[abc",
+    // are used as sub-string patterns.
+    m_useWildcards = isWildcardPattern(filter) && parseWildcardPattern(m_foldedPattern);
+    if (!m_useWildcards) {
+        m_wildcardTokens.clear();
     }
 }
 
@@ -78,6 +70,14 @@ bool KFileItemModelFilter::hasSetFilters() const
 
 
 bool KFileItemModelFilter::matches(const KFileItem& item) const
+{
+    if (m_pattern.isEmpty()) {
+        return matches(item, QString());
+    }
+    return matches(item, foldedText(item.text()));
+}
+
+bool KFileItemModelFilter::matches(const KFileItem& item, const QString& foldedText) const
 {
     const bool hasPatternFilter = !m_pattern.isEmpty();
     const bool hasMimeTypesFilter = !m_mimeTypes.isEmpty();
@@ -89,23 +89,166 @@ bool KFileItemModelFilter::matches(const KFileItem& item) const
 
     // If both filters are set, return true when both filters are matched
     if (hasPatternFilter && hasMimeTypesFilter) {
-        return (matchesPattern(item) && matchesType(item));
+        return (matchesPattern(foldedText) && matchesType(item));
     }
 
     // If only one filter is set, return true when that filter is matched
     if (hasPatternFilter) {
-        return matchesPattern(item);
+        return matchesPattern(foldedText);
     }
 
     return matchesType(item);
 }
 
-bool KFileItemModelFilter::matchesPattern(const KFileItem& item) const
+QString KFileItemModelFilter::foldedText(const QString& text)
+{
+    return text.toCaseFolded();
+}
+
+bool KFileItemModelFilter::isNarrowing(const QString& previousPattern, const QString& pattern)
+{
+    if (isWildcardPattern(previousPattern) || isWildcardPattern(pattern)) {
+        return false;
+    }
+    return foldedText(pattern).contains(foldedText(previousPattern));
+}
+
+bool KFileItemModelFilter::isWildcardPattern(const QString& pattern)
+{
+    return pattern.contains('*') || pattern.contains('?') || pattern.contains('[');
+}
+
+bool KFileItemModelFilter::parseWildcardPattern(const QString& pattern)
+{
+    // Supports the same syntax as QRegExp::WildcardUnix: '*', '?', sets
+    // like "[a-z]" or "[!0-9]" and escaping special characters by '\'.
+    QVector<WildcardToken> tokens;
+
+    const int length = pattern.length();
+    int i = 0;
+    while (i < length) {
+        WildcardToken token;
+        token.type = WildcardToken::Character;
+        token.negated = false;
+
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < length) {
+            token.character = pattern.at(i + 1);
+            i += 2;
+        } else if (c == QLatin1Char('*')) {
+            token.type = WildcardToken::AnyString;
+            ++i;
+        } else if (c == QLatin1Char('?')) {
+            token.type = WildcardToken::AnyCharacter;
+            ++i;
+        } else if (c == QLatin1Char('[')) {
+            token.type = WildcardToken::CharacterSet;
+            ++i;
+            if (i < length && (pattern.at(i) == QLatin1Char('!') || pattern.at(i) == QLatin1Char('^'))) {
+                token.negated = true;
+                ++i;
+            }
+
+            // A ']' directly after the opening bracket is part of the set
+            bool isFirst = true;
+            while (i < length && (isFirst || pattern.at(i) != QLatin1Char(']'))) {
+                isFirst = false;
+                QChar from = pattern.at(i);
+                if (from == QLatin1Char('\\') && i + 1 < length) {
+                    ++i;
+                    from = pattern.at(i);
+                }
+                ++i;
+
+                QChar to = from;
+                if (i + 1 < length && pattern.at(i) == QLatin1Char('-') && pattern.at(i + 1) != QLatin1Char(']')) {
+                    to = pattern.at(i + 1);
+                    i += 2;
+                }
+                token.ranges.append(qMakePair(from, to));
+            }
+
+            if (i >= length) {
+                // The set is not closed
+                return false;
+            }
+            ++i;
+        } else {
+            token.character = c;
+            ++i;
+        }
+
+        tokens.append(token);
+    }
+
+    m_wildcardTokens = tokens;
+    return true;
+}
+
+bool KFileItemModelFilter::matchesWildcardPattern(const QString& text) const
+{
+    // Only '*' requires backtracking. It is sufficient to remember the
+    // last '*', as a later '*' can match everything an earlier one could.
+    const int tokenCount = m_wildcardTokens.count();
+    const int length = text.length();
+    int tokenIndex = 0;
+    int textIndex = 0;
+    int starTokenIndex = -1;
+    int starTextIndex = 0;
+
+    while (textIndex < length) {
+        if (tokenIndex < tokenCount && m_wildcardTokens.at(tokenIndex).type == WildcardToken::AnyString) {
+            ++tokenIndex;
+            starTokenIndex = tokenIndex;
+            starTextIndex = textIndex;
+        } else if (tokenIndex < tokenCount && matchesToken(m_wildcardTokens.at(tokenIndex), text.at(textIndex))) {
+            ++tokenIndex;
+            ++textIndex;
+        } else if (starTokenIndex >= 0) {
+            // Let the last '*' consume one more character
+            tokenIndex = starTokenIndex;
+            ++starTextIndex;
+            textIndex = starTextIndex;
+        } else {
+            return false;
+        }
+    }
+
+    while (tokenIndex < tokenCount && m_wildcardTokens.at(tokenIndex).type == WildcardToken::AnyString) {
+        ++tokenIndex;
+    }
+    return tokenIndex == tokenCount;
+}
+
+bool KFileItemModelFilter::matchesToken(const WildcardToken& token, QChar c)
+{
+    switch (token.type) {
+    case WildcardToken::Character:
+        return token.character == c;
+    case WildcardToken::AnyCharacter:
+        return true;
+    case WildcardToken::CharacterSet: {
+        bool inSet = false;
+        foreach (const auto& range, token.ranges) {
+            if (c >= range.first && c <= range.second) {
+                inSet = true;
+                break;
+            }
+        }
+        return inSet != token.negated;
+    }
+    default:
+        break;
+    }
+    return false;
+}
+
+bool KFileItemModelFilter::matchesPattern(const QString& foldedText) const
 {
-    if (m_useRegExp) {
-        return m_regExp->exactMatch(item.text());
+    if (m_useWildcards) {
+        return matchesWildcardPattern(foldedText);
     } else {
-        return item.text().toLower().contains(m_lowerCasePattern);
+        return foldedText.contains(m_foldedPattern);
     }
 }
 
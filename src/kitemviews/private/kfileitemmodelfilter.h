@@ -23,10 +23,11 @@
 
 #include "dolphin_export.h"
 
+#include <QPair>
 #include <QStringList>
+#include <QVector>
 
 class KFileItem;
-class QRegExp;
 
 /**
  * @brief Allows to check whether an item of the KFileItemModel
@@ -47,7 +48,7 @@ public:
      * Sets the pattern that is used for a comparison with the item
      * in KFileItemModelFilter::matches(). Per default the pattern
      * defines a sub-string. As soon as the pattern contains at least
-     * a '*', '?' or '[' the pattern represents a regular expression.
+     * a '*', '?' or '[' the pattern represents a wildcard expression.
      */
     void setPattern(const QString& pattern);
     QString pattern() const;
@@ -70,21 +71,75 @@ public:
      */
     bool matches(const KFileItem& item) const;
 
+    /**
+     * Like matches(const KFileItem&), but uses the already case folded
+     * text \a foldedText of the item (see foldedText()). As long as no
+     * mimetype filters are set, the method may be invoked from several
+     * threads at the same time.
+     */
+    bool matches(const KFileItem& item, const QString& foldedText) const;
+
+    /**
+     * @return Case folded version of \a text as expected by matches().
+     */
+    static QString foldedText(const QString& text);
+
+    /**
+     * @return True if each item that matches the pattern \a pattern also
+     *         matches the pattern \a previousPattern. This is the case if
+     *         both are sub-string patterns and \a pattern contains
+     *         \a previousPattern, e.g. after appending a character.
+     */
+    static bool isNarrowing(const QString& previousPattern, const QString& pattern);
+
 private:
+    struct WildcardToken
+    {
+        enum Type {
+            Character,
+            AnyCharacter,   // '?'
+            AnyString,      // '*'
+            CharacterSet    // '[...]'
+        };
+
+        Type type;
+        QChar character;
+        QVector<QPair<QChar, QChar> > ranges;
+        bool negated;
+    };
+
+    /**
+     * @return True if \a pattern contains a wildcard character.
+     */
+    static bool isWildcardPattern(const QString& pattern);
+
+    /**
+     * Splits the case folded \a pattern into m_wildcardTokens.
+     * @return False if the pattern is not a valid wildcard expression.
+     */
+    bool parseWildcardPattern(const QString& pattern);
+
+    /**
+     * @return True if the case folded \a text matches m_wildcardTokens.
+     */
+    bool matchesWildcardPattern(const QString& text) const;
+
+    static bool matchesToken(const WildcardToken& token, QChar c);
+
     /**
      * @return True if item matches pattern set by @ref setPattern.
      */
-    bool matchesPattern(const KFileItem& item) const;
+    bool matchesPattern(const QString& foldedText) const;
 
     /**
      * @return True if item matches mimetypes set by @ref setMimeTypes.
      */
     bool matchesType(const KFileItem& item) const;
 
-    bool m_useRegExp;           // If true, m_regExp is used for filtering,
-                                // otherwise m_lowerCaseFilter is used.
-    QRegExp* m_regExp;
-    QString m_lowerCasePattern; // Lowercase version of m_filter for
+    bool m_useWildcards;        // If true, m_wildcardTokens is used for filtering,
+                                // otherwise m_foldedPattern is used.
+    QVector<WildcardToken> m_wildcardTokens;
+    QString m_foldedPattern;    // Case folded version of m_pattern for
                                 // faster comparison in matches().
     QString m_pattern;          // Property set by setPattern().
     QStringList m_mimeTypes;    // Property set by setMimeTypes()
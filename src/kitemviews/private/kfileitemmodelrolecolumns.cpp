@@ -0,0 +1,121 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitemmodelrolecolumns.h"
+
+KFileItemModelRoleColumns::KFileItemModelRoleColumns() :
+    m_columns(),
+    m_freeSlots(),
+    m_slotCount(0)
+{
+}
+
+int KFileItemModelRoleColumns::allocateSlot()
+{
+    if (!m_freeSlots.isEmpty()) {
+        const int slot = m_freeSlots.last();
+        m_freeSlots.removeLast();
+        return slot;
+    }
+
+    return m_slotCount++;
+}
+
+void KFileItemModelRoleColumns::releaseSlot(int slot)
+{
+    Q_ASSERT(slot >= 0 && slot < m_slotCount);
+
+    for (Column& column : m_columns) {
+        if (slot < column.numbers.count()) {
+            column.numbers[slot] = 0;
+        }
+        if (slot < column.strings.count()) {
+            column.strings[slot] = QString();
+        }
+    }
+
+    m_freeSlots.append(slot);
+}
+
+int KFileItemModelRoleColumns::slotCount() const
+{
+    return m_slotCount;
+}
+
+void KFileItemModelRoleColumns::clear()
+{
+    for (Column& column : m_columns) {
+        column.type = UnknownColumn;
+        column.numbers.clear();
+        column.strings.clear();
+    }
+
+    m_freeSlots.clear();
+    m_slotCount = 0;
+}
+
+void KFileItemModelRoleColumns::removeColumn(int column)
+{
+    if (column < m_columns.count()) {
+        m_columns[column].type = UnknownColumn;
+        m_columns[column].numbers = QVector<qint64>();
+        m_columns[column].strings = QVector<QString>();
+    }
+}
+
+void KFileItemModelRoleColumns::setNumber(int column, int slot, qint64 value)
+{
+    Q_ASSERT(slot >= 0 && slot < m_slotCount);
+
+    reserveColumn(column);
+    Column& numberColumn = m_columns[column];
+    Q_ASSERT(numberColumn.type != StringColumn);
+    numberColumn.type = NumberColumn;
+
+    QVector<qint64>& numbers = numberColumn.numbers;
+    if (slot >= numbers.count()) {
+        // Grow the column for all slots at once to prevent
+        // reallocations when filling the column item by item.
+        numbers.resize(m_slotCount);
+    }
+    numbers[slot] = value;
+}
+
+void KFileItemModelRoleColumns::setString(int column, int slot, const QString& value)
+{
+    Q_ASSERT(slot >= 0 && slot < m_slotCount);
+
+    reserveColumn(column);
+    Column& stringColumn = m_columns[column];
+    Q_ASSERT(stringColumn.type != NumberColumn);
+    stringColumn.type = StringColumn;
+
+    QVector<QString>& strings = stringColumn.strings;
+    if (slot >= strings.count()) {
+        strings.resize(m_slotCount);
+    }
+    strings[slot] = value;
+}
+
+void KFileItemModelRoleColumns::reserveColumn(int column)
+{
+    if (column >= m_columns.count()) {
+        m_columns.resize(column + 1);
+    }
+}
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMMODELROLECOLUMNS_H
+#define KFILEITEMMODELROLECOLUMNS_H
+
+#include "dolphin_export.h"
+
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Typed, column based storage of role values for KFileItemModel.
+ *
+ * Each item of the model gets a slot, which stays valid until the item
+ * is deleted, see allocateSlot() and releaseSlot(). The values of a role
+ * are stored in one contiguous array (the "column") per role that is
+ * indexed by the slot. Comparing two items by a role does not require
+ * any hash lookups or QVariant conversions that way.
+ *
+ * A column can either store numbers or strings. The type is defined by
+ * the first call of setNumber() or setString() for the column and is kept
+ * until the column is removed by removeColumn() or clear(). Storing a value
+ * of the other type in the column is an error, which is caught by an
+ * assertion.
+ *
+ * KFileItemModel only stores the values of the current sort role in the
+ * columns. They are a typed copy of the values in KFileItemModel::ItemData,
+ * which is still used by grouping, filtering and KFileItemModel::data().
+ */
+class DOLPHIN_EXPORT KFileItemModelRoleColumns
+{
+public:
+    KFileItemModelRoleColumns();
+
+    /**
+     * @return Slot for a new item. Slots of items that have been
+     *         released by releaseSlot() are reused.
+     */
+    int allocateSlot();
+
+    /**
+     * Marks the slot \a slot as unused. The values of all columns
+     * for the slot are reset.
+     */
+    void releaseSlot(int slot);
+
+    /**
+     * @return Number of slots that have been allocated, including
+     *         the released slots that have not been reused yet.
+     */
+    int slotCount() const;
+
+    /**
+     * Removes all values and releases all slots.
+     */
+    void clear();
+
+    /**
+     * Removes all values of the column \a column and frees its memory.
+     */
+    void removeColumn(int column);
+
+    void setNumber(int column, int slot, qint64 value);
+    qint64 number(int column, int slot) const;
+
+    void setString(int column, int slot, const QString& value);
+    const QString& string(int column, int slot) const;
+
+private:
+    enum ColumnType {
+        UnknownColumn,
+        NumberColumn,
+        StringColumn
+    };
+
+    struct Column
+    {
+        Column() : type(UnknownColumn) {}
+
+        ColumnType type;
+        QVector<qint64> numbers;
+        QVector<QString> strings;
+    };
+
+    void reserveColumn(int column);
+
+    QVector<Column> m_columns;
+    QVector<int> m_freeSlots;
+    int m_slotCount;
+};
+
+inline qint64 KFileItemModelRoleColumns::number(int column, int slot) const
+{
+    if (column < m_columns.count()) {
+        const QVector<qint64>& numbers = m_columns.at(column).numbers;
+        if (slot < numbers.count()) {
+            return numbers.at(slot);
+        }
+    }
+    return 0;
+}
+
+inline const QString& KFileItemModelRoleColumns::string(int column, int slot) const
+{
+    if (column < m_columns.count()) {
+        const QVector<QString>& strings = m_columns.at(column).strings;
+        if (slot < strings.count()) {
+            return strings.at(slot);
+        }
+    }
+
+    static const QString emptyString;
+    return emptyString;
+}
+
+#endif
@@ -22,9 +22,11 @@
 #ifndef KFILEITEMMODELSORTALGORITHM_H
 #define KFILEITEMMODELSORTALGORITHM_H
 
-#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QVector>
 
 #include <algorithm>
+#include <iterator>
 
 /**
  * Sorts the items using the merge sort algorithm is used to assure a
@@ -53,11 +55,89 @@ static void mergeSort(RandomAccessIterator begin,
     merge(begin, middle, end, lessThan);
 }
 
+/**
+ * Helper for parallelMergeSort(): Describes a part of a merge of two adjacent
+ * sorted runs. The elements [first1, last1) and [first2, last2) are merged
+ * to the position \a target. All indexes are relative to the beginning of
+ * the sorted range.
+ */
+struct MergeTask
+{
+    int first1;
+    int last1;
+    int first2;
+    int last2;
+    int target;
+};
+
+/**
+ * Helper for parallelMergeSort(): Appends the tasks that are required to
+ * merge the sorted runs [first1, last1) and [last1, last2) of \a source to
+ * \a tasks. The merge is split into up to \a pieces independent tasks, so
+ * that also merging the last two runs can be done by several threads.
+ */
+template <typename RandomAccessIterator, typename LessThan>
+static void appendMergeTasks(RandomAccessIterator source,
+                             int first1,
+                             int last1,
+                             int last2,
+                             int pieces,
+                             const LessThan& lessThan,
+                             QVector<MergeTask>& tasks)
+{
+    const int first2 = last1;
+    const int len1 = last1 - first1;
+    const int len2 = last2 - first2;
+
+    int previous1 = first1;
+    int previous2 = first2;
+    for (int piece = 1; piece < pieces; ++piece) {
+        // Split the longer run at an equidistant position and search the
+        // split position in the other run. To keep the merge stable, elements
+        // of the second run that are equal to the pivot must be placed after
+        // the elements of the first run.
+        int split1;
+        int split2;
+        if (len1 >= len2) {
+            split1 = first1 + static_cast<int>(static_cast<qint64>(len1) * piece / pieces);
+            split2 = std::lower_bound(source + first2, source + last2, *(source + split1), lessThan) - source;
+        } else {
+            split2 = first2 + static_cast<int>(static_cast<qint64>(len2) * piece / pieces);
+            split1 = std::upper_bound(source + first1, source + last1, *(source + split2), lessThan) - source;
+        }
+
+        split1 = qMax(split1, previous1);
+        split2 = qMax(split2, previous2);
+
+        const MergeTask task = { previous1, split1, previous2, split2, previous1 + previous2 - first2 };
+        tasks.append(task);
+
+        previous1 = split1;
+        previous2 = split2;
+    }
+
+    const MergeTask task = { previous1, last1, previous2, last2, previous1 + previous2 - first2 };
+    tasks.append(task);
+}
+
 /**
  * Uses up to \a numberOfThreads threads to sort the items between
- * \a begin and \a end. Only item ranges longer than
- * \a parallelMergeSortingThreshold are split to be sorted by two different
- * threads.
+ * \a begin and \a end. The algorithm is a stable merge sort that
+ * consists of the following phases:
+ *
+ * 1. The range is split into considerably more runs than threads, and
+ *    the runs are sorted independently with mergeSort(). The runs are
+ *    handed out to the threads of QThreadPool::globalInstance() one by one
+ *    as soon as a thread is idle, so that a thread that finishes early
+ *    takes over the work that is left instead of waiting for the others.
+ *    The calling thread participates in the sorting.
+ *
+ * 2. Adjacent runs are merged pairwise into a buffer until only one run is
+ *    left. Each merge is split into independent parts by binary searches,
+ *    so that all threads are busy even when only two runs are left.
+ *
+ * Ranges that are not longer than \a parallelMergeSortingThreshold are
+ * sorted by the calling thread only.
  *
  * The comparison function \a lessThan must be reentrant.
  */
@@ -69,20 +149,93 @@ static void parallelMergeSort(RandomAccessIterator begin,
                               int numberOfThreads,
                               int parallelMergeSortingThreshold = 100)
 {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type ValueType;
+
+    // Number of tasks per thread for each phase. Having more tasks than
+    // threads balances the load if comparing some items is more expensive
+    // than comparing others.
+    const int tasksPerThread = 4;
+
     const int span = end - begin;
+    if (numberOfThreads < 2 || span <= parallelMergeSortingThreshold) {
+        mergeSort(begin, end, lessThan);
+        return;
+    }
 
-    if (numberOfThreads > 1 && span > parallelMergeSortingThreshold) {
-        const int newNumberOfThreads = numberOfThreads / 2;
-        const RandomAccessIterator middle = begin + span / 2;
+    const int runCount = qBound(2, span / parallelMergeSortingThreshold, numberOfThreads * tasksPerThread);
 
-        QFuture<void> future = QtConcurrent::run(parallelMergeSort<RandomAccessIterator, LessThan>, begin, middle, lessThan, newNumberOfThreads, parallelMergeSortingThreshold);
-        parallelMergeSort(middle, end, lessThan, newNumberOfThreads, parallelMergeSortingThreshold);
+    // The run with the index i is [runBounds[i], runBounds[i + 1]).
+    QVector<int> runBounds;
+    runBounds.reserve(runCount + 1);
+    for (int i = 0; i <= runCount; ++i) {
+        runBounds.append(static_cast<int>(static_cast<qint64>(span) * i / runCount));
+    }
 
-        future.waitForFinished();
+    // Phase 1: Sort the runs.
+    QVector<int> runs;
+    runs.reserve(runCount);
+    for (int i = 0; i < runCount; ++i) {
+        runs.append(i);
+    }
 
-        merge(begin, middle, end, lessThan);
-    } else {
-        mergeSort(begin, end, lessThan);
+    QtConcurrent::blockingMap(runs, [&](int run) {
+        mergeSort(begin + runBounds.at(run), begin + runBounds.at(run + 1), lessThan);
+    });
+
+    // Phase 2: Merge adjacent runs until only one run is left. The items are
+    // moved between the sorted range and the buffer in each round.
+    QVector<ValueType> buffer(span);
+    ValueType* const bufferBegin = buffer.data();
+    bool sourceIsBuffer = false;
+
+    QVector<MergeTask> tasks;
+    while (runBounds.count() > 2) {
+        const int currentRunCount = runBounds.count() - 1;
+        const int pairCount = currentRunCount / 2;
+        const int piecesPerPair = qMax(1, numberOfThreads * tasksPerThread / pairCount);
+
+        tasks.clear();
+        QVector<int> mergedRunBounds;
+        mergedRunBounds.reserve(pairCount + 2);
+
+        for (int run = 0; run + 1 < currentRunCount; run += 2) {
+            if (sourceIsBuffer) {
+                appendMergeTasks(bufferBegin, runBounds.at(run), runBounds.at(run + 1), runBounds.at(run + 2),
+                                 piecesPerPair, lessThan, tasks);
+            } else {
+                appendMergeTasks(begin, runBounds.at(run), runBounds.at(run + 1), runBounds.at(run + 2),
+                                 piecesPerPair, lessThan, tasks);
+            }
+            mergedRunBounds.append(runBounds.at(run));
+        }
+
+        if (currentRunCount % 2 == 1) {
+            // The last run has no partner. Just copy it to the target.
+            const int first = runBounds.at(currentRunCount - 1);
+            const MergeTask task = { first, span, span, span, first };
+            tasks.append(task);
+            mergedRunBounds.append(first);
+        }
+        mergedRunBounds.append(span);
+
+        QtConcurrent::blockingMap(tasks, [&](const MergeTask& task) {
+            if (sourceIsBuffer) {
+                std::merge(bufferBegin + task.first1, bufferBegin + task.last1,
+                           bufferBegin + task.first2, bufferBegin + task.last2,
+                           begin + task.target, lessThan);
+            } else {
+                std::merge(begin + task.first1, begin + task.last1,
+                           begin + task.first2, begin + task.last2,
+                           bufferBegin + task.target, lessThan);
+            }
+        });
+
+        runBounds = mergedRunBounds;
+        sourceIsBuffer = !sourceIsBuffer;
+    }
+
+    if (sourceIsBuffer) {
+        std::copy(bufferBegin, bufferBegin + span, begin);
     }
 }
 
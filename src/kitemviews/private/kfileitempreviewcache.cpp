@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitempreviewcache.h"
+
+#include <KFileItem>
+
+#include <QSize>
+
+#include <limits>
+
+namespace {
+    // Default maximum size of all previews in bytes
+    const qint64 DefaultMaximumSize = 64 * 1024 * 1024;
+}
+
+class KFileItemPreviewCacheSingleton
+{
+public:
+    KFileItemPreviewCache instance;
+};
+Q_GLOBAL_STATIC(KFileItemPreviewCacheSingleton, s_KFileItemPreviewCache)
+
+
+KFileItemPreviewCache* KFileItemPreviewCache::instance()
+{
+    return &s_KFileItemPreviewCache->instance;
+}
+
+int KFileItemPreviewCache::sizeClass(const QSize& iconSize)
+{
+    return (iconSize.width() > 128) || (iconSize.height() > 128) ? 256 : 128;
+}
+
+void KFileItemPreviewCache::insert(const KFileItem& item, int sizeClass, const QImage& image)
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    const QDateTime modificationTime = item.time(KFileItem::ModificationTime);
+
+    Entry* entry = new Entry();
+    const Entry* oldEntry = m_entries.object(item.url());
+    if (oldEntry && oldEntry->modificationTime == modificationTime) {
+        entry->images = oldEntry->images;
+    }
+    entry->modificationTime = modificationTime;
+    entry->images.insert(sizeClass, image);
+
+    // Replaces and deletes the old entry
+    m_entries.insert(item.url(), entry, cost(*entry));
+}
+
+QImage KFileItemPreviewCache::image(const KFileItem& item, int sizeClass)
+{
+    const Entry* entry = m_entries.object(item.url());
+    if (!entry) {
+        return QImage();
+    }
+
+    if (entry->modificationTime != item.time(KFileItem::ModificationTime)) {
+        m_entries.remove(item.url());
+        return QImage();
+    }
+
+    // Use the preview for the requested size class or the
+    // next larger one, which can be scaled down
+    auto it = entry->images.lowerBound(sizeClass);
+    if (it == entry->images.constEnd()) {
+        return QImage();
+    }
+    return it.value();
+}
+
+void KFileItemPreviewCache::clear()
+{
+    m_entries.clear();
+}
+
+void KFileItemPreviewCache::setMaximumSize(qint64 bytes)
+{
+    // The costs of the entries are stored in KiB
+    m_entries.setMaxCost(int(qBound(qint64(1), bytes / 1024, qint64(std::numeric_limits<int>::max()))));
+}
+
+qint64 KFileItemPreviewCache::maximumSize() const
+{
+    return qint64(m_entries.maxCost()) * 1024;
+}
+
+qint64 KFileItemPreviewCache::size() const
+{
+    return qint64(m_entries.totalCost()) * 1024;
+}
+
+KFileItemPreviewCache::KFileItemPreviewCache() :
+    m_entries(int(DefaultMaximumSize / 1024))
+{
+}
+
+int KFileItemPreviewCache::cost(const Entry& entry)
+{
+    int bytes = 0;
+    foreach (const QImage& image, entry.images) {
+        bytes += image.byteCount();
+    }
+    return qMax(1, bytes / 1024);
+}
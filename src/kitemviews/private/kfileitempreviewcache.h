@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMPREVIEWCACHE_H
+#define KFILEITEMPREVIEWCACHE_H
+
+#include "dolphin_export.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QMap>
+#include <QUrl>
+
+class KFileItem;
+class QSize;
+
+/**
+ * @brief Keeps the previews that have been created by KIO::PreviewJob in memory.
+ *
+ * The previews are stored unmodified, i.e., without a frame and without
+ * overlays, for each size class that has been requested. This allows to
+ * derive previews for other icon sizes without starting a new preview job,
+ * e.g., when zooming in and out.
+ *
+ * A preview is only returned if the modification time of the item matches
+ * the modification time at the point when the preview has been inserted.
+ * If the cache gets too large, the least recently used items are removed.
+ *
+ * The cache is shared by all views of the process and must only be accessed
+ * from the GUI thread. The returned images may be passed to worker threads.
+ */
+class DOLPHIN_EXPORT KFileItemPreviewCache
+{
+public:
+    static KFileItemPreviewCache* instance();
+
+    /**
+     * @return Size of the previews that are requested from KIO::PreviewJob
+     *         for icons of the size \a iconSize. KIO::PreviewJob caches
+     *         thumbnails with 128 x 128 or 256 x 256 pixels internally.
+     */
+    static int sizeClass(const QSize& iconSize);
+
+    /**
+     * Stores the preview \a image of \a item, which has been
+     * requested for the size class \a sizeClass.
+     */
+    void insert(const KFileItem& item, int sizeClass, const QImage& image);
+
+    /**
+     * @return Preview of \a item for the size class \a sizeClass. If only
+     *         a preview for a larger size class is available, it is returned
+     *         instead and must be scaled by the caller. A null image is
+     *         returned if no up-to-date preview is available.
+     */
+    QImage image(const KFileItem& item, int sizeClass);
+
+    /**
+     * Removes all previews. Must be invoked if the previews might have
+     * changed, e.g., because the enabled preview plugins have been changed.
+     */
+    void clear();
+
+    /**
+     * Sets the maximum memory in bytes that is used by the previews.
+     * Per default 64 MiB are used.
+     */
+    void setMaximumSize(qint64 bytes);
+    qint64 maximumSize() const;
+
+    /**
+     * @return Memory in bytes that is used by the previews at the moment.
+     */
+    qint64 size() const;
+
+private:
+    KFileItemPreviewCache();
+
+    struct Entry
+    {
+        QDateTime modificationTime;
+        QMap<int, QImage> images;
+    };
+
+    static int cost(const Entry& entry);
+
+    QCache<QUrl, Entry> m_entries;
+
+    friend class KFileItemPreviewCacheSingleton;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitemrolesresolverworker.h"
+
+#include <config-baloo.h>
+
+#ifdef HAVE_BALOO
+#include "kbaloorolesprovider.h"
+#include <Baloo/File>
+#endif
+
+KFileItemRolesResolverWorker::KFileItemRolesResolverWorker(QObject* parent) :
+    QObject(parent)
+{
+    qRegisterMetaType<KFileItemList>();
+    qRegisterMetaType<QSet<QByteArray> >();
+    qRegisterMetaType<QList<QHash<QByteArray, QVariant> > >();
+    qRegisterMetaType<KFileItemRolesResolverWorker::Options>();
+}
+
+QHash<QByteArray, QVariant> KFileItemRolesResolverWorker::rolesData(const KFileItem& item,
+                                                                    const QSet<QByteArray>& roles,
+                                                                    Options options)
+{
+    QHash<QByteArray, QVariant> data;
+
+    if (roles.contains("size") && item.isDir() && !item.isLocalFile()) {
+        data.insert("size", -1); // -1 indicates an unknown number of items
+    }
+
+    if (roles.contains("type")) {
+        data.insert("type", item.mimeComment());
+    }
+
+    data.insert("iconOverlays", item.overlays());
+
+    if (options & ResolveBalooRoles) {
+        QHashIterator<QByteArray, QVariant> it(balooRolesData(item, roles));
+        while (it.hasNext()) {
+            it.next();
+            data.insert(it.key(), it.value());
+        }
+    }
+
+    return data;
+}
+
+QHash<QByteArray, QVariant> KFileItemRolesResolverWorker::balooRolesData(const KFileItem& item,
+                                                                         const QSet<QByteArray>& roles)
+{
+    QHash<QByteArray, QVariant> data;
+
+#ifdef HAVE_BALOO
+    Baloo::File file(item.localPath());
+    file.load();
+
+    const KBalooRolesProvider& rolesProvider = KBalooRolesProvider::instance();
+    foreach (const QByteArray& role, rolesProvider.roles()) {
+        // Overwrite all the role values with an empty QVariant, because the roles
+        // provider doesn't overwrite it when the property value list is empty.
+        // See bug 322348
+        data.insert(role, QVariant());
+    }
+
+    QHashIterator<QByteArray, QVariant> it(rolesProvider.roleValues(file, roles));
+    while (it.hasNext()) {
+        it.next();
+        data.insert(it.key(), it.value());
+    }
+#else
+    Q_UNUSED(item);
+    Q_UNUSED(roles);
+#endif
+
+    return data;
+}
+
+void KFileItemRolesResolverWorker::resolveRoles(const KFileItemList& items, const QSet<QByteArray>& roles,
+                                                Options options)
+{
+    QList<QHash<QByteArray, QVariant> > values;
+    values.reserve(items.count());
+
+    foreach (const KFileItem& item, items) {
+        if (!item.isMimeTypeKnown()) {
+            item.determineMimeType();
+        }
+        values.append(rolesData(item, roles, options));
+    }
+
+    emit result(items, values);
+}
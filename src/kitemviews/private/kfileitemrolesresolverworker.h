@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMROLESRESOLVERWORKER_H
+#define KFILEITEMROLESRESOLVERWORKER_H
+
+#include <KFileItem>
+
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QSet>
+#include <QVariant>
+
+/**
+ * @brief Resolves the expensive roles of file items in a worker thread.
+ *
+ * Determining the MIME type, the MIME comment, the overlays and the Baloo
+ * meta data of an item may block for a long time on slow devices.
+ * KFileItemModelRolesUpdater moves an instance of this class to a worker
+ * thread and passes batches of items to it. The GUI thread only has to
+ * apply the results to the model.
+ *
+ * The passed items may not share their data with items that are used in
+ * the GUI thread, because determining the MIME type modifies the item.
+ */
+class KFileItemRolesResolverWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Option {
+        NoOptions = 0x0,
+        ResolveBalooRoles = 0x1
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    explicit KFileItemRolesResolverWorker(QObject* parent = nullptr);
+
+    /**
+     * @return The values of the roles \a roles for the item \a item. Roles
+     *         that can only be determined in the GUI thread, like the number
+     *         of items inside a local directory or the overlays provided by
+     *         a KOverlayIconPlugin, are not part of the result.
+     */
+    static QHash<QByteArray, QVariant> rolesData(const KFileItem& item,
+                                                 const QSet<QByteArray>& roles,
+                                                 Options options);
+
+    /**
+     * @return The values of the Baloo roles \a roles for the local item \a item.
+     *         All Baloo roles are contained, roles without value are set to an
+     *         invalid QVariant.
+     */
+    static QHash<QByteArray, QVariant> balooRolesData(const KFileItem& item,
+                                                      const QSet<QByteArray>& roles);
+
+signals:
+    /**
+     * Signals that the roles of \a items have been resolved. The MIME types
+     * of \a items are known, \a values contains the role values for each item.
+     */
+    void result(const KFileItemList& items, const QList<QHash<QByteArray, QVariant> >& values);
+
+public slots:
+    /**
+     * Determines the MIME types and the roles \a roles of \a items using the
+     * options \a options. The result is announced via the signal \a result.
+     */
+    // Note that the full type name KFileItemRolesResolverWorker::Options
+    // is needed here. Just using 'Options' is OK for the compiler, but
+    // confuses moc.
+    void resolveRoles(const KFileItemList& items, const QSet<QByteArray>& roles,
+                      KFileItemRolesResolverWorker::Options options);
+};
+
+Q_DECLARE_METATYPE(KFileItemRolesResolverWorker::Options)
+Q_DECLARE_OPERATORS_FOR_FLAGS(KFileItemRolesResolverWorker::Options)
+
+#endif
@@ -0,0 +1,298 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemlistcolumnwidthresolver.h"
+
+#include "kitemviews/kitemlistview.h"
+
+#include <QElapsedTimer>
+
+namespace {
+    const qreal UnresolvedWidth = -1.0;
+}
+
+KItemListColumnWidthResolver::KItemListColumnWidthResolver(const KItemListView* itemListView) :
+    m_itemListView(itemListView),
+    m_roles(),
+    m_columnWidths(),
+    m_maximumColumnWidths(),
+    m_maximumColumnWidthsDirty(false),
+    m_hasUnresolvedItems(false),
+    m_nextUnresolvedIndex(0)
+{
+}
+
+KItemListColumnWidthResolver::~KItemListColumnWidthResolver()
+{
+}
+
+void KItemListColumnWidthResolver::setRoles(const QList<QByteArray>& roles)
+{
+    m_roles = roles;
+    m_columnWidths.clear();
+    m_columnWidths.resize(roles.count());
+    m_maximumColumnWidths.clear();
+    m_maximumColumnWidths.resize(roles.count());
+    clearCache();
+}
+
+QList<QByteArray> KItemListColumnWidthResolver::roles() const
+{
+    return m_roles;
+}
+
+void KItemListColumnWidthResolver::itemsInserted(const KItemRangeList& itemRanges)
+{
+    if (m_roles.isEmpty()) {
+        return;
+    }
+
+    int insertedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        insertedCount += range.count;
+    }
+
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        QVector<qreal>& widths = m_columnWidths[role];
+        const int currentCount = widths.count();
+
+        // We build the new list from the end to the beginning to mimize the
+        // number of moves.
+        widths.insert(widths.end(), insertedCount, UnresolvedWidth);
+
+        int sourceIndex = currentCount - 1;
+        int targetIndex = widths.count() - 1;
+        int itemsToInsertBeforeCurrentRange = insertedCount;
+
+        for (int rangeIndex = itemRanges.count() - 1; rangeIndex >= 0; --rangeIndex) {
+            const KItemRange& range = itemRanges.at(rangeIndex);
+            itemsToInsertBeforeCurrentRange -= range.count;
+
+            // First: move all existing items that must be put behind 'range'.
+            while (targetIndex >= itemsToInsertBeforeCurrentRange + range.index + range.count) {
+                widths[targetIndex] = widths[sourceIndex];
+                --sourceIndex;
+                --targetIndex;
+            }
+
+            // Then: mark the items which are inserted into 'range' as unresolved.
+            while (targetIndex >= itemsToInsertBeforeCurrentRange + range.index) {
+                widths[targetIndex] = UnresolvedWidth;
+                --targetIndex;
+            }
+        }
+    }
+
+    m_hasUnresolvedItems = true;
+}
+
+void KItemListColumnWidthResolver::itemsRemoved(const KItemRangeList& itemRanges)
+{
+    if (m_roles.isEmpty() || itemRanges.isEmpty()) {
+        return;
+    }
+
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        QVector<qreal>& widths = m_columnWidths[role];
+        const qreal maximumWidth = m_maximumColumnWidths.at(role);
+
+        const QVector<qreal>::iterator begin = widths.begin();
+        const QVector<qreal>::iterator end = widths.end();
+
+        // If an item having the maximum width gets removed, the
+        // maximum must be determined again from the remaining items.
+        foreach (const KItemRange& range, itemRanges) {
+            for (int i = range.index; i < range.index + range.count && !m_maximumColumnWidthsDirty; ++i) {
+                if (widths.at(i) >= maximumWidth) {
+                    m_maximumColumnWidthsDirty = true;
+                }
+            }
+        }
+
+        KItemRangeList::const_iterator rangeIt = itemRanges.constBegin();
+        const KItemRangeList::const_iterator rangeEnd = itemRanges.constEnd();
+
+        QVector<qreal>::iterator destIt = begin + rangeIt->index;
+        QVector<qreal>::iterator srcIt = destIt + rangeIt->count;
+
+        ++rangeIt;
+
+        while (srcIt != end) {
+            *destIt = *srcIt;
+            ++destIt;
+            ++srcIt;
+
+            if (rangeIt != rangeEnd && srcIt == begin + rangeIt->index) {
+                // Skip the items in the next removed range.
+                srcIt += rangeIt->count;
+                ++rangeIt;
+            }
+        }
+
+        widths.erase(destIt, end);
+    }
+
+    if (m_maximumColumnWidthsDirty) {
+        updateMaximumColumnWidths();
+    }
+}
+
+void KItemListColumnWidthResolver::itemsMoved(const KItemRange& range, const QList<int>& movedToIndexes)
+{
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        const QVector<qreal> widths = m_columnWidths.at(role);
+        QVector<qreal>& newWidths = m_columnWidths[role];
+
+        const int movedRangeEnd = range.index + range.count;
+        for (int i = range.index; i < movedRangeEnd; ++i) {
+            const int newIndex = movedToIndexes.at(i - range.index);
+            newWidths[newIndex] = widths.at(i);
+        }
+    }
+}
+
+void KItemListColumnWidthResolver::itemsChanged(const KItemRangeList& itemRanges)
+{
+    if (m_roles.isEmpty()) {
+        return;
+    }
+
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        QVector<qreal>& widths = m_columnWidths[role];
+        const qreal maximumWidth = m_maximumColumnWidths.at(role);
+
+        foreach (const KItemRange& range, itemRanges) {
+            for (int i = range.index; i < range.index + range.count; ++i) {
+                if (widths.at(i) >= maximumWidth) {
+                    // The changed item might get smaller
+                    m_maximumColumnWidthsDirty = true;
+                }
+                widths[i] = UnresolvedWidth;
+            }
+        }
+    }
+
+    m_hasUnresolvedItems = true;
+}
+
+void KItemListColumnWidthResolver::clearCache()
+{
+    const KItemModelBase* model = m_itemListView->model();
+    const int count = model ? model->count() : 0;
+
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        m_columnWidths[role].fill(UnresolvedWidth, count);
+    }
+    m_maximumColumnWidths.fill(0.0);
+    m_maximumColumnWidthsDirty = false;
+
+    m_hasUnresolvedItems = !m_roles.isEmpty() && count > 0;
+    m_nextUnresolvedIndex = 0;
+}
+
+bool KItemListColumnWidthResolver::hasUnresolvedItems() const
+{
+    return m_hasUnresolvedItems;
+}
+
+bool KItemListColumnWidthResolver::resolve(int timeout)
+{
+    bool changed = false;
+
+    if (m_maximumColumnWidthsDirty) {
+        updateMaximumColumnWidths();
+        changed = true;
+    }
+
+    if (!m_hasUnresolvedItems) {
+        return changed;
+    }
+
+    const KItemModelBase* model = m_itemListView->model();
+    const int count = model ? model->count() : 0;
+    if (m_columnWidths.isEmpty() || m_columnWidths.first().count() != count) {
+        // Assure that the cache never gets out of sync with the model
+        clearCache();
+        changed = true;
+    }
+
+    const KItemListWidgetCreatorBase* creator = m_itemListView->widgetCreator();
+    if (!creator) {
+        return changed;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Continue with the item following the last resolved item. As items might
+    // have been inserted or moved in front of m_nextUnresolvedIndex, the search
+    // wraps around once before giving up.
+    QVector<qreal>& firstRoleWidths = m_columnWidths.first();
+    int checkedCount = 0;
+    while (checkedCount < count) {
+        if (m_nextUnresolvedIndex >= count) {
+            m_nextUnresolvedIndex = 0;
+        }
+
+        const int index = m_nextUnresolvedIndex;
+        ++m_nextUnresolvedIndex;
+        ++checkedCount;
+
+        if (firstRoleWidths.at(index) >= 0.0) {
+            continue;
+        }
+
+        for (int role = 0; role < m_roles.count(); ++role) {
+            const qreal width = creator->preferredRoleColumnWidth(m_roles.at(role), index, m_itemListView);
+            m_columnWidths[role][index] = width;
+            if (width > m_maximumColumnWidths.at(role)) {
+                m_maximumColumnWidths[role] = width;
+                changed = true;
+            }
+        }
+
+        // The search ends only after a full cycle without unresolved items
+        checkedCount = 0;
+
+        if (timer.hasExpired(timeout)) {
+            return changed;
+        }
+    }
+
+    m_hasUnresolvedItems = false;
+    return changed;
+}
+
+qreal KItemListColumnWidthResolver::maximumColumnWidth(const QByteArray& role) const
+{
+    const int index = m_roles.indexOf(role);
+    return index >= 0 ? m_maximumColumnWidths.at(index) : 0.0;
+}
+
+void KItemListColumnWidthResolver::updateMaximumColumnWidths()
+{
+    for (int role = 0; role < m_columnWidths.count(); ++role) {
+        qreal maximumWidth = 0.0;
+        foreach (qreal width, m_columnWidths.at(role)) {
+            maximumWidth = qMax(maximumWidth, width);
+        }
+        m_maximumColumnWidths[role] = maximumWidth;
+    }
+    m_maximumColumnWidthsDirty = false;
+}
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KITEMLISTCOLUMNWIDTHRESOLVER_H
+#define KITEMLISTCOLUMNWIDTHRESOLVER_H
+
+#include "dolphin_export.h"
+#include "kitemviews/kitemmodelbase.h"
+
+#include <QList>
+#include <QVector>
+
+class KItemListView;
+
+/**
+ * @brief Calculates and caches the preferred column widths of the items in KItemListView.
+ *
+ * The preferred width of each role is remembered for each item, so that the
+ * maximum width of a column can be updated incrementally if items are
+ * inserted, removed or changed. Calculating the widths of new or changed
+ * items is done in portions by resolve(), which allows to spread the work
+ * over several iterations of the event loop.
+ */
+class DOLPHIN_EXPORT KItemListColumnWidthResolver
+{
+public:
+    explicit KItemListColumnWidthResolver(const KItemListView* itemListView);
+    virtual ~KItemListColumnWidthResolver();
+
+    /**
+     * Sets the roles whose preferred column widths should be calculated.
+     * The widths of all items get marked as unresolved.
+     */
+    void setRoles(const QList<QByteArray>& roles);
+    QList<QByteArray> roles() const;
+
+    void itemsInserted(const KItemRangeList& itemRanges);
+    void itemsRemoved(const KItemRangeList& itemRanges);
+    void itemsMoved(const KItemRange& range, const QList<int>& movedToIndexes);
+    void itemsChanged(const KItemRangeList& itemRanges);
+
+    /**
+     * Marks the widths of all items as unresolved.
+     */
+    void clearCache();
+
+    /**
+     * @return True if the widths of some items have not been calculated yet.
+     */
+    bool hasUnresolvedItems() const;
+
+    /**
+     * Calculates the widths of unresolved items until no unresolved
+     * items are left or \a timeout milliseconds have been exceeded.
+     * @return True if the maximum width of at least one role has been changed.
+     */
+    bool resolve(int timeout);
+
+    /**
+     * @return Maximum preferred width of the column for \a role
+     *         of all resolved items.
+     */
+    qreal maximumColumnWidth(const QByteArray& role) const;
+
+private:
+    void updateMaximumColumnWidths();
+
+private:
+    const KItemListView* m_itemListView;
+    QList<QByteArray> m_roles;
+
+    // Preferred width for each role and item. A negative
+    // width indicates that the width is unresolved.
+    QVector<QVector<qreal> > m_columnWidths;
+    QVector<qreal> m_maximumColumnWidths;
+    bool m_maximumColumnWidthsDirty;
+
+    bool m_hasUnresolvedItems;
+    int m_nextUnresolvedIndex;
+};
+
+#endif
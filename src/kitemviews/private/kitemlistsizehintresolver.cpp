@@ -20,13 +20,36 @@
 #include "kitemlistsizehintresolver.h"
 #include "kitemviews/kitemlistview.h"
 
+#include <QElapsedTimer>
+
+namespace {
+    // If more than this number of items must be resolved, only the items
+    // around the visible area get exact size hints synchronously
+    const int MaxSynchronouslyResolvedItems = 500;
+
+    // Number of items in front of and behind the visible area
+    // that get exact size hints synchronously
+    const int VisibleAreaMargin = 100;
+
+    // Number of items whose estimated size hints are replaced at once
+    const int ResolveBatchSize = 200;
+}
+
 KItemListSizeHintResolver::KItemListSizeHintResolver(const KItemListView* itemListView) :
     m_itemListView(itemListView),
     m_logicalHeightHintCache(),
     m_logicalWidthHint(0.0),
     m_logicalHeightHint(0.0),
     m_minHeightHint(0.0),
-    m_needsResolving(false)
+    m_heightHintCounts(),
+    m_unresolvedCount(0),
+    m_unresolvedIndexes(),
+    m_unresolvedIndexesValid(true),
+    m_needsResolving(false),
+    m_hasEstimatedSizeHints(false),
+    m_firstVisibleIndex(0),
+    m_lastVisibleIndex(-1),
+    m_nextEstimatedIndex(0)
 {
 }
 
@@ -49,7 +72,7 @@ QSizeF KItemListSizeHintResolver::minSizeHint()
 QSizeF KItemListSizeHintResolver::sizeHint(int index)
 {
     updateCache();
-    return QSizeF(m_logicalWidthHint, m_logicalHeightHintCache.at(index));
+    return QSizeF(m_logicalWidthHint, qAbs(m_logicalHeightHintCache.at(index)));
 }
 
 void KItemListSizeHintResolver::itemsInserted(const KItemRangeList& itemRanges)
@@ -88,6 +111,9 @@ void KItemListSizeHintResolver::itemsInserted(const KItemRangeList& itemRanges)
         }
     }
 
+    m_unresolvedCount += insertedCount;
+    m_unresolvedIndexes.clear();
+    m_unresolvedIndexesValid = false;
     m_needsResolving = true;
 
     Q_ASSERT(m_logicalHeightHintCache.count() == m_itemListView->model()->count());
@@ -95,6 +121,19 @@ void KItemListSizeHintResolver::itemsInserted(const KItemRangeList& itemRanges)
 
 void KItemListSizeHintResolver::itemsRemoved(const KItemRangeList& itemRanges)
 {
+    foreach (const KItemRange& range, itemRanges) {
+        for (int index = range.index; index < range.index + range.count; ++index) {
+            const qreal hint = m_logicalHeightHintCache.at(index);
+            if (hint == 0.0) {
+                --m_unresolvedCount;
+            } else {
+                countHeightHint(hint, -1);
+            }
+        }
+    }
+    m_unresolvedIndexes.clear();
+    m_unresolvedIndexesValid = false;
+
     const QVector<qreal>::iterator begin = m_logicalHeightHintCache.begin();
     const QVector<qreal>::iterator end = m_logicalHeightHintCache.end();
 
@@ -119,6 +158,7 @@ void KItemListSizeHintResolver::itemsRemoved(const KItemRangeList& itemRanges)
     }
 
     m_logicalHeightHintCache.erase(destIt, end);
+    updateMinMaxHeightHints();
 
     // Note that the cache size might temporarily not match the model size if
     // this function is called from KItemListView::setModel() to empty the cache.
@@ -138,13 +178,26 @@ void KItemListSizeHintResolver::itemsMoved(const KItemRange& range, const QList<
     }
 
     m_logicalHeightHintCache = newLogicalHeightHintCache;
+
+    if (m_unresolvedCount > 0) {
+        m_unresolvedIndexes.clear();
+        m_unresolvedIndexesValid = false;
+    }
 }
 
 void KItemListSizeHintResolver::itemsChanged(int index, int count, const QSet<QByteArray>& roles)
 {
     Q_UNUSED(roles);
     while (count) {
-        m_logicalHeightHintCache[index] = 0.0;
+        const qreal hint = m_logicalHeightHintCache.at(index);
+        if (hint != 0.0) {
+            countHeightHint(hint, -1);
+            m_logicalHeightHintCache[index] = 0.0;
+            ++m_unresolvedCount;
+            if (m_unresolvedIndexesValid) {
+                m_unresolvedIndexes.append(index);
+            }
+        }
         ++index;
         --count;
     }
@@ -155,20 +208,192 @@ void KItemListSizeHintResolver::itemsChanged(int index, int count, const QSet<QB
 void KItemListSizeHintResolver::clearCache()
 {
     m_logicalHeightHintCache.fill(0.0);
+    m_heightHintCounts.clear();
+    m_unresolvedCount = m_logicalHeightHintCache.count();
+    m_unresolvedIndexes.clear();
+    m_unresolvedIndexesValid = false;
     m_needsResolving = true;
 }
 
 void KItemListSizeHintResolver::updateCache()
 {
     if (m_needsResolving) {
-        m_itemListView->calculateItemSizeHints(m_logicalHeightHintCache, m_logicalWidthHint);
-        // Set logical height as the max cached height (if the cache is not empty).
-        if (m_logicalHeightHintCache.isEmpty()) {
-            m_logicalHeightHint = 0.0;
-        } else {
-            m_logicalHeightHint = *std::max_element(m_logicalHeightHintCache.begin(), m_logicalHeightHintCache.end());
-            m_minHeightHint = *std::min_element(m_logicalHeightHintCache.begin(), m_logicalHeightHintCache.end());
+        QVector<int> indexes = unresolvedIndexes();
+        if (indexes.count() > MaxSynchronouslyResolvedItems) {
+            // Calculating the exact size hints of all items might block the UI for a long
+            // time. Estimate the size hints and calculate only the size hints of the items
+            // around the visible area exactly. The remaining estimated size hints get
+            // replaced by resolveEstimatedSizeHints().
+            m_itemListView->estimateItemSizeHints(m_logicalHeightHintCache, m_logicalWidthHint);
+            foreach (int index, indexes) {
+                countHeightHint(m_logicalHeightHintCache.at(index), 1);
+            }
+
+            indexes.clear();
+            const int first = qMax(0, m_firstVisibleIndex - VisibleAreaMargin);
+            const int last = qMin(m_logicalHeightHintCache.count() - 1,
+                                  qMax(m_lastVisibleIndex, m_firstVisibleIndex) + VisibleAreaMargin);
+            for (int i = first; i <= last; ++i) {
+                const qreal hint = m_logicalHeightHintCache.at(i);
+                if (hint < 0.0) {
+                    countHeightHint(hint, -1);
+                    m_logicalHeightHintCache[i] = 0.0;
+                    indexes.append(i);
+                }
+            }
+
+            m_hasEstimatedSizeHints = true;
+            m_nextEstimatedIndex = 0;
         }
+
+        m_itemListView->calculateItemSizeHints(m_logicalHeightHintCache, indexes, m_logicalWidthHint);
+        foreach (int index, indexes) {
+            countHeightHint(m_logicalHeightHintCache.at(index), 1);
+        }
+
+        m_unresolvedCount = 0;
+        m_unresolvedIndexes.clear();
+        m_unresolvedIndexesValid = true;
+
+        updateMinMaxHeightHints();
         m_needsResolving = false;
     }
 }
+
+bool KItemListSizeHintResolver::hasEstimatedSizeHints() const
+{
+    return m_hasEstimatedSizeHints;
+}
+
+int KItemListSizeHintResolver::resolveEstimatedSizeHints(int firstVisibleIndex, int lastVisibleIndex, int timeout)
+{
+    m_firstVisibleIndex = qMax(0, firstVisibleIndex);
+    m_lastVisibleIndex = lastVisibleIndex;
+
+    updateCache();
+
+    int firstChangedIndex = -1;
+    if (!m_hasEstimatedSizeHints) {
+        return firstChangedIndex;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    do {
+        const QVector<int> indexes = estimatedIndexes(ResolveBatchSize);
+        if (indexes.isEmpty()) {
+            m_hasEstimatedSizeHints = false;
+            break;
+        }
+
+        // Only the hints of the batch are passed to the view, so resolving
+        // all items does not check the hints of all items for each batch.
+        QVector<qreal> estimatedHints;
+        estimatedHints.reserve(indexes.count());
+        foreach (int index, indexes) {
+            const qreal estimatedHint = m_logicalHeightHintCache.at(index);
+            estimatedHints.append(-estimatedHint);
+            countHeightHint(estimatedHint, -1);
+            m_logicalHeightHintCache[index] = 0.0;
+        }
+
+        m_itemListView->calculateItemSizeHints(m_logicalHeightHintCache, indexes, m_logicalWidthHint);
+
+        for (int i = 0; i < indexes.count(); ++i) {
+            const int index = indexes.at(i);
+            countHeightHint(m_logicalHeightHintCache.at(index), 1);
+            if (m_logicalHeightHintCache.at(index) != estimatedHints.at(i)
+                && (firstChangedIndex < 0 || index < firstChangedIndex)) {
+                firstChangedIndex = index;
+            }
+        }
+    } while (!timer.hasExpired(timeout));
+
+    if (firstChangedIndex >= 0) {
+        updateMinMaxHeightHints();
+    }
+
+    return firstChangedIndex;
+}
+
+QVector<int> KItemListSizeHintResolver::estimatedIndexes(int maxCount)
+{
+    QVector<int> indexes;
+    const int count = m_logicalHeightHintCache.count();
+
+    const int first = qMax(0, m_firstVisibleIndex - VisibleAreaMargin);
+    const int last = qMin(count - 1, qMax(m_lastVisibleIndex, m_firstVisibleIndex) + VisibleAreaMargin);
+    for (int i = first; i <= last && indexes.count() < maxCount; ++i) {
+        if (m_logicalHeightHintCache.at(i) < 0.0) {
+            indexes.append(i);
+        }
+    }
+
+    // Continue with the remaining items in the order of their indexes. As items
+    // might have been inserted or moved in front of m_nextEstimatedIndex, the
+    // search wraps around once before giving up.
+    int checkedCount = 0;
+    while (indexes.count() < maxCount && checkedCount < count) {
+        if (m_nextEstimatedIndex >= count) {
+            m_nextEstimatedIndex = 0;
+        }
+
+        const int index = m_nextEstimatedIndex;
+        if (m_logicalHeightHintCache.at(index) < 0.0 && (index < first || index > last)) {
+            indexes.append(index);
+        }
+
+        ++m_nextEstimatedIndex;
+        ++checkedCount;
+    }
+
+    return indexes;
+}
+
+QVector<int> KItemListSizeHintResolver::unresolvedIndexes() const
+{
+    if (m_unresolvedIndexesValid || m_unresolvedCount == 0) {
+        return m_unresolvedIndexes;
+    }
+
+    QVector<int> indexes;
+    indexes.reserve(m_unresolvedCount);
+    for (int index = 0; index < m_logicalHeightHintCache.count(); ++index) {
+        if (m_logicalHeightHintCache.at(index) == 0.0) {
+            indexes.append(index);
+        }
+    }
+    return indexes;
+}
+
+void KItemListSizeHintResolver::countHeightHint(qreal hint, int count)
+{
+    if (hint == 0.0) {
+        return;
+    }
+
+    const QMap<qreal, int>::iterator it = m_heightHintCounts.find(qAbs(hint));
+    if (it == m_heightHintCounts.end()) {
+        if (count > 0) {
+            m_heightHintCounts.insert(qAbs(hint), count);
+        }
+    } else {
+        it.value() += count;
+        if (it.value() <= 0) {
+            m_heightHintCounts.erase(it);
+        }
+    }
+}
+
+void KItemListSizeHintResolver::updateMinMaxHeightHints()
+{
+    if (m_heightHintCounts.isEmpty()) {
+        m_logicalHeightHint = 0.0;
+        m_minHeightHint = 0.0;
+        return;
+    }
+
+    m_minHeightHint = m_heightHintCounts.firstKey();
+    m_logicalHeightHint = m_heightHintCounts.lastKey();
+}
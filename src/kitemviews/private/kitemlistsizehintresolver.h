@@ -23,6 +23,7 @@
 #include "dolphin_export.h"
 #include "kitemviews/kitemmodelbase.h"
 
+#include <QMap>
 #include <QSizeF>
 #include <QVector>
 
@@ -30,6 +31,11 @@ class KItemListView;
 
 /**
  * @brief Calculates and caches the sizehints of items in KItemListView.
+ *
+ * If the size hints of many items must be calculated, only the items around
+ * the visible area get exact size hints. The other items get cheap estimated
+ * size hints, which are replaced by exact ones with
+ * resolveEstimatedSizeHints() in the background.
  */
 class DOLPHIN_EXPORT KItemListSizeHintResolver
 {
@@ -48,13 +54,66 @@ public:
     void clearCache();
     void updateCache();
 
+    /**
+     * @return True if at least one item has an estimated size hint.
+     */
+    bool hasEstimatedSizeHints() const;
+
+    /**
+     * Replaces estimated size hints by exact ones. The items around the range
+     * \a firstVisibleIndex to \a lastVisibleIndex are resolved first. The
+     * resolving is stopped after \a timeout milliseconds.
+     * @return Index of the first item whose size hint has been changed,
+     *         or -1 if no size hint has been changed.
+     */
+    int resolveEstimatedSizeHints(int firstVisibleIndex, int lastVisibleIndex, int timeout);
+
+private:
+    /**
+     * @return Up to \a maxCount indexes of items that have an estimated size
+     *         hint. Items around the visible range are preferred.
+     */
+    QVector<int> estimatedIndexes(int maxCount);
+
+    /**
+     * @return Indexes of all items with an unresolved size hint.
+     */
+    QVector<int> unresolvedIndexes() const;
+
+    /**
+     * Adds the logical height hint \a hint to m_heightHintCounts,
+     * or removes it if \a count is -1. Unresolved hints are ignored.
+     */
+    void countHeightHint(qreal hint, int count);
+
+    void updateMinMaxHeightHints();
+
 private:
     const KItemListView* m_itemListView;
+    // Estimated logical height hints are stored as negative values,
+    // unresolved ones as 0.0.
     mutable QVector<qreal> m_logicalHeightHintCache;
     mutable qreal m_logicalWidthHint;
     mutable qreal m_logicalHeightHint;
     mutable qreal m_minHeightHint;
+
+    // Number of items for each absolute value of the resolved and estimated
+    // logical height hints. Keeps the minimum and the maximum hint up to date
+    // without checking all items.
+    QMap<qreal, int> m_heightHintCounts;
+
+    // Number of items with an unresolved size hint. If m_unresolvedIndexesValid
+    // is true, m_unresolvedIndexes contains their indexes. Inserting, removing or
+    // moving items invalidates the indexes, which requires checking all items.
+    int m_unresolvedCount;
+    QVector<int> m_unresolvedIndexes;
+    bool m_unresolvedIndexesValid;
+
     bool m_needsResolving;
+    bool m_hasEstimatedSizeHints;
+    int m_firstVisibleIndex;
+    int m_lastVisibleIndex;
+    int m_nextEstimatedIndex;
 };
 
 #endif
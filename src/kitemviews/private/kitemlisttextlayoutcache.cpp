@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemlisttextlayoutcache.h"
+
+#include <KStringHandler>
+
+#include <QFontMetrics>
+#include <QStringBuilder>
+#include <QTextLayout>
+
+namespace {
+    // Maximum number of cached text layouts
+    const int MaxCachedLayouts = 10000;
+}
+
+KItemListTextLayoutCache::TextLayout::TextLayout() :
+    staticText(),
+    width(0),
+    height(0),
+    elided(false)
+{
+}
+
+KItemListTextLayoutCache::KItemListTextLayoutCache() :
+    m_layouts(MaxCachedLayouts)
+{
+}
+
+KItemListTextLayoutCache::TextLayout KItemListTextLayoutCache::layout(const QString& text, const QFont& font, qreal width, Mode mode, int maxLines)
+{
+    if (mode != IconsLayoutName) {
+        maxLines = 1;
+    }
+
+    const QString key = font.key() % QLatin1Char('|') % QString::number(width) % QLatin1Char('|')
+                        % QString::number(mode) % QLatin1Char('|') % QString::number(maxLines) % QLatin1Char('|')
+                        % text;
+
+    const TextLayout* cachedLayout = m_layouts.object(key);
+    if (cachedLayout) {
+        return *cachedLayout;
+    }
+
+    TextLayout* layout = new TextLayout(mode == IconsLayoutName
+                                        ? createWrappedLayout(text, font, width, maxLines)
+                                        : createSingleLineLayout(text, font, width));
+    layout->staticText = createStaticText(layout->staticText.text(), mode, width);
+
+    const TextLayout result = *layout;
+    m_layouts.insert(key, layout);
+    return result;
+}
+
+void KItemListTextLayoutCache::clear()
+{
+    m_layouts.clear();
+}
+
+KItemListTextLayoutCache::TextLayout KItemListTextLayoutCache::createWrappedLayout(const QString& text, const QFont& font, qreal width, int maxLines)
+{
+    TextLayout result;
+
+    const QFontMetrics fontMetrics(font);
+    const QString wrappedText = KStringHandler::preProcessWrap(text);
+    QString shownText = wrappedText;
+
+    QTextOption textOption(Qt::AlignHCenter);
+    textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+
+    // Calculate the number of lines required for the text and the required width
+    QTextLayout layout(wrappedText, font);
+    layout.setTextOption(textOption);
+    layout.beginLayout();
+    QTextLine line;
+    int lineIndex = 0;
+    while ((line = layout.createLine()).isValid()) {
+        line.setLineWidth(width);
+        result.width = qMax(result.width, line.naturalTextWidth());
+        result.height += line.height();
+
+        ++lineIndex;
+        if (lineIndex == maxLines) {
+            // The maximum number of textlines has been reached. If this is
+            // the case provide an elided text if necessary.
+            const int textLength = line.textStart() + line.textLength();
+            if (textLength < wrappedText.length()) {
+                // Elide the last line of the text
+                qreal elidingWidth = width;
+                qreal lastLineWidth;
+                do {
+                    QString lastTextLine = wrappedText.mid(line.textStart());
+                    lastTextLine = fontMetrics.elidedText(lastTextLine,
+                                                          Qt::ElideRight,
+                                                          elidingWidth);
+                    shownText = wrappedText.left(line.textStart()) + lastTextLine;
+
+                    lastLineWidth = fontMetrics.boundingRect(lastTextLine).width();
+
+                    // We do the text eliding in a loop with decreasing width (1 px / iteration)
+                    // to avoid problems related to different width calculation code paths
+                    // within Qt. (see bug 337104)
+                    elidingWidth -= 1.0;
+                } while (lastLineWidth > width);
+
+                result.width = qMax(result.width, lastLineWidth);
+                result.elided = true;
+            }
+            break;
+        }
+    }
+    layout.endLayout();
+
+    result.staticText.setText(shownText);
+    return result;
+}
+
+KItemListTextLayoutCache::TextLayout KItemListTextLayoutCache::createSingleLineLayout(const QString& text, const QFont& font, qreal width)
+{
+    TextLayout result;
+
+    const QFontMetrics fontMetrics(font);
+    result.width = fontMetrics.width(text);
+    if (result.width > width) {
+        const QString elidedText = fontMetrics.elidedText(text, Qt::ElideRight, width);
+        result.staticText.setText(elidedText);
+        result.width = fontMetrics.width(elidedText);
+        result.elided = true;
+    } else {
+        result.staticText.setText(text);
+    }
+
+    return result;
+}
+
+QStaticText KItemListTextLayoutCache::createStaticText(const QString& text, Mode mode, qreal width)
+{
+    // Use the same options as KStandardItemListWidget::updateTextsCache()
+    QTextOption textOption;
+    switch (mode) {
+    case IconsLayoutName:
+    case IconsLayoutRole:
+        textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+        textOption.setAlignment(Qt::AlignHCenter);
+        break;
+    case CompactLayoutRole:
+    case DetailsLayoutRole:
+        textOption.setAlignment(Qt::AlignLeft);
+        textOption.setWrapMode(QTextOption::NoWrap);
+        break;
+    }
+
+    QStaticText staticText(text);
+    staticText.setTextFormat(Qt::PlainText);
+    staticText.setPerformanceHint(QStaticText::AggressiveCaching);
+    staticText.setTextOption(textOption);
+    if (mode != DetailsLayoutRole) {
+        staticText.setTextWidth(width);
+    }
+    return staticText;
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KITEMLISTTEXTLAYOUTCACHE_H
+#define KITEMLISTTEXTLAYOUTCACHE_H
+
+#include "dolphin_export.h"
+
+#include <QCache>
+#include <QStaticText>
+#include <QString>
+
+class QFont;
+
+/**
+ * @brief Caches the wrapped and elided texts of KStandardItemListWidget.
+ *
+ * Laying out a text is expensive, and the widgets of a view are recycled
+ * for other items while scrolling. The cache keeps the results for the
+ * most recently used texts. The key is made of the text, the font, the
+ * available width, the layout mode and the maximum number of lines.
+ *
+ * The returned QStaticText instances are implicitly shared. If a widget
+ * shows a text that has been shown before, the glyph layout that has been
+ * prepared when painting the text is reused, too.
+ *
+ * One cache is shared by all widgets of a view and by the size hint
+ * calculations of KStandardItemListWidgetInformant.
+ */
+class DOLPHIN_EXPORT KItemListTextLayoutCache
+{
+public:
+    enum Mode
+    {
+        /**
+         * The name in the Icons layout. It is wrapped into up to maxLines
+         * centered lines, and the last line is elided if required.
+         */
+        IconsLayoutName,
+        /** An additional role in the Icons layout, which is a centered line. */
+        IconsLayoutRole,
+        /** A role in the Compact layout, which is a left-aligned line. */
+        CompactLayoutRole,
+        /**
+         * A role in the Details layout, which is a left-aligned line. The
+         * width is only used for eliding, so that the size of the static
+         * text is the size of the shown text.
+         */
+        DetailsLayoutRole
+    };
+
+    struct TextLayout
+    {
+        TextLayout();
+
+        /** Text that should be shown, which uses the text width of the layout. */
+        QStaticText staticText;
+        /** Width of the shown text. */
+        qreal width;
+        /** Height of the wrapped text. Only set for IconsLayoutName. */
+        qreal height;
+        /** True if the text did not fit into the available width and has been elided. */
+        bool elided;
+    };
+
+    KItemListTextLayoutCache();
+
+    /**
+     * @return Layout of \a text for the font \a font, the available width \a width
+     *         and the mode \a mode. \a maxLines is only used by IconsLayoutName,
+     *         a value of 0 means that the number of lines is not limited.
+     */
+    TextLayout layout(const QString& text, const QFont& font, qreal width, Mode mode, int maxLines = 1);
+
+    void clear();
+
+private:
+    static TextLayout createWrappedLayout(const QString& text, const QFont& font, qreal width, int maxLines);
+    static TextLayout createSingleLineLayout(const QString& text, const QFont& font, qreal width);
+
+    static QStaticText createStaticText(const QString& text, Mode mode, qreal width);
+
+private:
+    QCache<QString, TextLayout> m_layouts;
+};
+
+#endif
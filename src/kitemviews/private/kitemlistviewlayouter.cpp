@@ -22,12 +22,18 @@
 #include "kitemlistsizehintresolver.h"
 #include "kitemviews/kitemmodelbase.h"
 
+#include <limits>
+
 // #define KITEMLISTVIEWLAYOUTER_DEBUG
 
 KItemListViewLayouter::KItemListViewLayouter(KItemListSizeHintResolver* sizeHintResolver, QObject* parent) :
     QObject(parent),
     m_dirty(true),
     m_visibleIndexesDirty(true),
+    m_firstDirtyIndex(-1),
+    m_lastDirtyIndex(-1),
+    m_itemCount(0),
+    m_grouped(false),
     m_scrollOrientation(Qt::Vertical),
     m_size(),
     m_itemSize(128, 128),
@@ -223,14 +229,15 @@ int KItemListViewLayouter::lastVisibleIndex() const
 QRectF KItemListViewLayouter::itemRect(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return QRectF();
     }
 
     QSizeF sizeHint = m_sizeHintResolver->sizeHint(index);
 
-    const qreal x = m_columnOffsets.at(m_itemInfos.at(index).column);
-    const qreal y = m_rowOffsets.at(m_itemInfos.at(index).row);
+    const ItemInfo info = itemInfo(index);
+    const qreal x = m_columnOffsets.at(info.column);
+    const qreal y = m_rowOffsets.at(info.row);
 
     if (m_scrollOrientation == Qt::Horizontal) {
         // Rotate the logical direction which is always vertical by 90°
@@ -274,10 +281,10 @@ QRectF KItemListViewLayouter::groupHeaderRect(int index) const
         // directly, the logical height represents the visual width, and
         // the logical row represents the column.
         qreal headerWidth = minimumGroupHeaderWidth();
-        const int row = m_itemInfos[index].row;
-        const int maxIndex = m_itemInfos.count() - 1;
+        const int row = itemInfo(index).row;
+        const int maxIndex = m_itemCount - 1;
         while (index <= maxIndex) {
-            if (m_itemInfos[index].row != row) {
+            if (itemInfo(index).row != row) {
                 break;
             }
 
@@ -300,25 +307,23 @@ QRectF KItemListViewLayouter::groupHeaderRect(int index) const
 int KItemListViewLayouter::itemColumn(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return -1;
     }
 
-    return (m_scrollOrientation == Qt::Vertical)
-            ? m_itemInfos[index].column
-            : m_itemInfos[index].row;
+    const ItemInfo info = itemInfo(index);
+    return (m_scrollOrientation == Qt::Vertical) ? info.column : info.row;
 }
 
 int KItemListViewLayouter::itemRow(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return -1;
     }
 
-    return (m_scrollOrientation == Qt::Vertical)
-            ? m_itemInfos[index].row
-            : m_itemInfos[index].column;
+    const ItemInfo info = itemInfo(index);
+    return (m_scrollOrientation == Qt::Vertical) ? info.row : info.column;
 }
 
 int KItemListViewLayouter::maximumVisibleItems() const
@@ -346,17 +351,34 @@ void KItemListViewLayouter::markAsDirty()
     m_dirty = true;
 }
 
+void KItemListViewLayouter::markItemsAsDirty(int index)
+{
+    markItemsAsDirty(index, std::numeric_limits<int>::max() - qMax(0, index));
+}
+
+void KItemListViewLayouter::markItemsAsDirty(int index, int count)
+{
+    index = qMax(0, index);
+    if (m_firstDirtyIndex < 0 || index < m_firstDirtyIndex) {
+        m_firstDirtyIndex = index;
+    }
+
+    const int lastIndex = index + qMax(0, count - 1);
+    if (lastIndex > m_lastDirtyIndex) {
+        m_lastDirtyIndex = lastIndex;
+    }
+}
 
 #ifndef QT_NO_DEBUG
     bool KItemListViewLayouter::isDirty()
     {
-        return m_dirty;
+        return m_dirty || m_firstDirtyIndex >= 0;
     }
 #endif
 
 void KItemListViewLayouter::doLayout()
 {
-    if (m_dirty) {
+    if (m_dirty || m_firstDirtyIndex >= 0) {
 #ifdef KITEMLISTVIEWLAYOUTER_DEBUG
         QElapsedTimer timer;
         timer.start();
@@ -369,6 +391,11 @@ void KItemListViewLayouter::doLayout()
 
         const bool grouped = createGroupHeaders();
 
+        // The rows before the first dirty item can only be kept if the
+        // layout properties and the grouping mode have not been changed.
+        const bool layoutAllItems = m_dirty || (grouped != m_grouped);
+        m_grouped = grouped;
+
         const bool horizontalScrolling = (m_scrollOrientation == Qt::Horizontal);
         if (horizontalScrolling) {
             // Flip everything so that the layout logically can work like having
@@ -390,6 +417,7 @@ void KItemListViewLayouter::doLayout()
         m_columnCount = qMax(1, int(widthForColumns / m_columnWidth));
         m_xPosInc = itemMargin.width();
 
+        const int previousItemCount = m_itemCount;
         const int itemCount = m_model->count();
         if (itemCount > m_columnCount && m_columnWidth >= 32) {
             // Apply the unused width equally to each column
@@ -401,7 +429,11 @@ void KItemListViewLayouter::doLayout()
             }
         }
 
-        m_itemInfos.resize(itemCount);
+        if (grouped) {
+            m_itemInfos.resize(itemCount);
+        } else {
+            m_itemInfos.clear();
+        }
 
         // Calculate the offset of each column, i.e., the x-coordinate where the column starts.
         m_columnOffsets.resize(m_columnCount);
@@ -430,79 +462,128 @@ void KItemListViewLayouter::doLayout()
         m_rowOffsets.resize(numberOfRows);
 
         qreal y = m_headerHeight + itemMargin.height();
-        int row = 0;
-
-        int index = 0;
-        while (index < itemCount) {
-            qreal maxItemHeight = itemSize.height();
 
-            if (grouped) {
-                if (m_groupItemIndexes.contains(index)) {
-                    // The item is the first item of a group.
-                    // Increase the y-position to provide space
-                    // for the group header.
-                    if (index > 0) {
-                        // Only add a margin if there has been added another
-                        // group already before
-                        y += m_groupHeaderMargin;
-                    } else if (!horizontalScrolling) {
-                        // The first group header should be aligned on top
-                        y -= itemMargin.height();
-                    }
+        // Without grouping, the row of an item only depends on its index. If all
+        // items require the same height, the row offsets can be calculated without
+        // checking the items. Otherwise, if only the size hints of some items have
+        // been changed, only their rows are laid out again, and the following rows
+        // are moved by the height difference.
+        const qreal minRowHeight = grouped ? 0 : qMax(itemSize.height(), m_sizeHintResolver->minSizeHint().height());
+        const qreal maxRowHeight = grouped ? 0 : qMax(itemSize.height(), m_sizeHintResolver->maxSizeHint().height());
+        const int firstDirtyIndex = layoutAllItems ? 0 : qMin(m_firstDirtyIndex, qMin(previousItemCount, itemCount));
+
+        if (!grouped && minRowHeight == maxRowHeight) {
+            const qreal rowInc = maxRowHeight + itemMargin.height();
+            const int firstRow = firstDirtyIndex / m_columnCount;
+            if (firstRow > 0) {
+                y = m_rowOffsets.at(firstRow - 1) + rowInc;
+            }
 
-                    if (!horizontalScrolling) {
-                        y += m_groupHeaderHeight;
-                    }
+            for (int row = firstRow; row < numberOfRows; ++row) {
+                m_rowOffsets[row] = y;
+                y += rowInc;
+            }
+        } else if (!grouped && !layoutAllItems && itemCount == previousItemCount && m_lastDirtyIndex < itemCount) {
+            const int firstRow = firstDirtyIndex / m_columnCount;
+            const int lastRow = m_lastDirtyIndex / m_columnCount;
+            const qreal nextRowOffset = (lastRow + 1 < numberOfRows) ? m_rowOffsets.at(lastRow + 1) : m_maximumScrollOffset;
+
+            y = m_rowOffsets.at(firstRow);
+            for (int row = firstRow; row <= lastRow; ++row) {
+                m_rowOffsets[row] = y;
+
+                qreal maxItemHeight = itemSize.height();
+                const int endIndex = qMin(itemCount, (row + 1) * m_columnCount);
+                for (int index = row * m_columnCount; index < endIndex; ++index) {
+                    maxItemHeight = qMax(maxItemHeight, requiredItemHeight(index, itemSize.height(), false));
                 }
+
+                y += maxItemHeight + itemMargin.height();
             }
 
-            m_rowOffsets[row] = y;
+            const qreal heightDiff = y - nextRowOffset;
+            if (heightDiff != 0) {
+                for (int row = lastRow + 1; row < numberOfRows; ++row) {
+                    m_rowOffsets[row] += heightDiff;
+                }
+            }
+            y = m_maximumScrollOffset + heightDiff;
+        } else {
+            int row = 0;
+            int index = 0;
+
+            // The last item whose position is still valid. The relayout starts with its
+            // row, because items after it might have to be moved into this row, e.g., if
+            // the first item of a group has been removed.
+            const int lastValidIndex = firstDirtyIndex - 1;
+            if (lastValidIndex >= 0) {
+                row = itemInfo(lastValidIndex).row;
+                index = lastValidIndex;
+                while (index > 0 && itemInfo(index - 1).row == row) {
+                    --index;
+                }
 
-            int column = 0;
-            while (index < itemCount && column < m_columnCount) {
-                qreal requiredItemHeight = itemSize.height();
-                const QSizeF sizeHint = m_sizeHintResolver->sizeHint(index);
-                const qreal sizeHintHeight = sizeHint.height();
-                if (sizeHintHeight > requiredItemHeight) {
-                    requiredItemHeight = sizeHintHeight;
+                if (row > 0) {
+                    // Continue below the previous row, which is not changed.
+                    const bool horizontalGroups = grouped && horizontalScrolling;
+                    qreal maxItemHeight = itemSize.height();
+                    for (int i = index - 1; i >= 0 && itemInfo(i).row == row - 1; --i) {
+                        maxItemHeight = qMax(maxItemHeight, requiredItemHeight(i, itemSize.height(), horizontalGroups));
+                    }
+                    y = m_rowOffsets.at(row - 1) + maxItemHeight + itemMargin.height();
                 }
+            }
 
-                ItemInfo& itemInfo = m_itemInfos[index];
-                itemInfo.column = column;
-                itemInfo.row = row;
-
-                if (grouped && horizontalScrolling) {
-                    // When grouping is enabled in the horizontal mode, the header alignment
-                    // looks like this:
-                    //   Header-1 Header-2 Header-3
-                    //   Item 1   Item 4   Item 7
-                    //   Item 2   Item 5   Item 8
-                    //   Item 3   Item 6   Item 9
-                    // In this case 'requiredItemHeight' represents the column-width. We don't
-                    // check the content of the header in the layouter to determine the required
-                    // width, hence assure that at least a minimal width of 15 characters is given
-                    // (in average a character requires the halve width of the font height).
-                    //
-                    // TODO: Let the group headers provide a minimum width and respect this width here
-                    const qreal headerWidth = minimumGroupHeaderWidth();
-                    if (requiredItemHeight < headerWidth) {
-                        requiredItemHeight = headerWidth;
+            while (index < itemCount) {
+                qreal maxItemHeight = itemSize.height();
+
+                if (grouped) {
+                    if (m_groupItemIndexes.contains(index)) {
+                        // The item is the first item of a group.
+                        // Increase the y-position to provide space
+                        // for the group header.
+                        if (index > 0) {
+                            // Only add a margin if there has been added another
+                            // group already before
+                            y += m_groupHeaderMargin;
+                        } else if (!horizontalScrolling) {
+                            // The first group header should be aligned on top
+                            y -= itemMargin.height();
+                        }
+
+                        if (!horizontalScrolling) {
+                            y += m_groupHeaderHeight;
+                        }
                     }
                 }
 
-                maxItemHeight = qMax(maxItemHeight, requiredItemHeight);
-                ++index;
-                ++column;
+                m_rowOffsets[row] = y;
 
-                if (grouped && m_groupItemIndexes.contains(index)) {
-                    // The item represents the first index of a group
-                    // and must aligned in the first column
-                    break;
+                int column = 0;
+                while (index < itemCount && column < m_columnCount) {
+                    const qreal requiredHeight = requiredItemHeight(index, itemSize.height(),
+                                                                    grouped && horizontalScrolling);
+
+                    if (grouped) {
+                        ItemInfo& info = m_itemInfos[index];
+                        info.column = column;
+                        info.row = row;
+                    }
+
+                    maxItemHeight = qMax(maxItemHeight, requiredHeight);
+                    ++index;
+                    ++column;
+
+                    if (grouped && m_groupItemIndexes.contains(index)) {
+                        // The item represents the first index of a group
+                        // and must aligned in the first column
+                        break;
+                    }
                 }
-            }
 
-            y += maxItemHeight + itemMargin.height();
-            ++row;
+                y += maxItemHeight + itemMargin.height();
+                ++row;
+            }
         }
 
         if (itemCount > 0) {
@@ -513,10 +594,14 @@ void KItemListViewLayouter::doLayout()
             m_maximumItemOffset = 0;
         }
 
+        m_itemCount = itemCount;
+
 #ifdef KITEMLISTVIEWLAYOUTER_DEBUG
         qCDebug(DolphinDebug) << "[TIME] doLayout() for " << m_model->count() << "items:" << timer.elapsed();
 #endif
         m_dirty = false;
+        m_firstDirtyIndex = -1;
+        m_lastDirtyIndex = -1;
     }
 
     updateVisibleIndexes();
@@ -545,7 +630,7 @@ void KItemListViewLayouter::updateVisibleIndexes()
     int mid = 0;
     do {
         mid = (min + max) / 2;
-        if (m_rowOffsets.at(m_itemInfos[mid].row) < m_scrollOffset) {
+        if (m_rowOffsets.at(itemInfo(mid).row) < m_scrollOffset) {
             min = mid + 1;
         } else {
             max = mid - 1;
@@ -555,13 +640,13 @@ void KItemListViewLayouter::updateVisibleIndexes()
     if (mid > 0) {
         // Include the row before the first fully visible index, as it might
         // be partly visible
-        if (m_rowOffsets.at(m_itemInfos[mid].row) >= m_scrollOffset) {
+        if (m_rowOffsets.at(itemInfo(mid).row) >= m_scrollOffset) {
             --mid;
-            Q_ASSERT(m_rowOffsets.at(m_itemInfos[mid].row) < m_scrollOffset);
+            Q_ASSERT(m_rowOffsets.at(itemInfo(mid).row) < m_scrollOffset);
         }
 
-        const int firstVisibleRow = m_itemInfos[mid].row;
-        while (mid > 0 && m_itemInfos[mid - 1].row == firstVisibleRow) {
+        const int firstVisibleRow = itemInfo(mid).row;
+        while (mid > 0 && itemInfo(mid - 1).row == firstVisibleRow) {
             --mid;
         }
     }
@@ -578,14 +663,14 @@ void KItemListViewLayouter::updateVisibleIndexes()
     max = maxIndex;
     do {
         mid = (min + max) / 2;
-        if (m_rowOffsets.at(m_itemInfos[mid].row) <= bottom) {
+        if (m_rowOffsets.at(itemInfo(mid).row) <= bottom) {
             min = mid + 1;
         } else {
             max = mid - 1;
         }
     } while (min <= max);
 
-    while (mid > 0 && m_rowOffsets.at(m_itemInfos[mid].row) > bottom) {
+    while (mid > 0 && m_rowOffsets.at(itemInfo(mid).row) > bottom) {
         --mid;
     }
     m_lastVisibleIndex = mid;
@@ -614,6 +699,41 @@ bool KItemListViewLayouter::createGroupHeaders()
     return true;
 }
 
+KItemListViewLayouter::ItemInfo KItemListViewLayouter::itemInfo(int index) const
+{
+    if (m_grouped) {
+        return m_itemInfos.at(index);
+    }
+
+    ItemInfo info;
+    info.column = index % m_columnCount;
+    info.row = index / m_columnCount;
+    return info;
+}
+
+qreal KItemListViewLayouter::requiredItemHeight(int index, qreal itemHeight, bool horizontalGroups) const
+{
+    qreal requiredHeight = qMax(itemHeight, m_sizeHintResolver->sizeHint(index).height());
+
+    if (horizontalGroups) {
+        // When grouping is enabled in the horizontal mode, the header alignment
+        // looks like this:
+        //   Header-1 Header-2 Header-3
+        //   Item 1   Item 4   Item 7
+        //   Item 2   Item 5   Item 8
+        //   Item 3   Item 6   Item 9
+        // In this case 'requiredHeight' represents the column-width. We don't
+        // check the content of the header in the layouter to determine the required
+        // width, hence assure that at least a minimal width of 15 characters is given
+        // (in average a character requires the halve width of the font height).
+        //
+        // TODO: Let the group headers provide a minimum width and respect this width here
+        requiredHeight = qMax(requiredHeight, minimumGroupHeaderWidth());
+    }
+
+    return requiredHeight;
+}
+
 qreal KItemListViewLayouter::minimumGroupHeaderWidth() const
 {
     return 100;
@@ -44,6 +44,12 @@ class KItemListSizeHintResolver;
  * marking the layouter as dirty (see markAsDirty()). This means that
  * changing properties of the layouter is not expensive, only the
  * first read of a property can get expensive.
+ *
+ * If only some items have been changed, inserted or removed, the layout
+ * of the preceding rows stays valid (see markItemsAsDirty()), and only the
+ * following rows are laid out again. If grouping is disabled, the row and
+ * column of an item are calculated from its index, so that no per-item
+ * data has to be stored.
  */
 class DOLPHIN_EXPORT KItemListViewLayouter : public QObject
 {
@@ -162,6 +168,22 @@ public:
      */
     void markAsDirty();
 
+    /**
+     * Marks the layout of the items starting at the index \a index as dirty,
+     * e.g., because items have been inserted, removed or changed at this
+     * index. When a property of the layouter gets read, only the rows starting
+     * with the row of the item before \a index are laid out again.
+     */
+    void markItemsAsDirty(int index);
+
+    /**
+     * Marks the layout of the \a count items starting at the index \a index
+     * as dirty, e.g., because their size hints have been changed. Without
+     * grouping, only the rows of these items are laid out again if the number
+     * of items has not been changed, and the following rows are moved.
+     */
+    void markItemsAsDirty(int index, int count);
+
     inline int columnCount() const
     {
         return m_columnCount;
@@ -181,6 +203,22 @@ private:
     void updateVisibleIndexes();
     bool createGroupHeaders();
 
+    struct ItemInfo {
+        int column;
+        int row;
+    };
+
+    /**
+     * @return The column and row of the item with the index \a index.
+     */
+    ItemInfo itemInfo(int index) const;
+
+    /**
+     * @return The height that is required for the item with the index
+     *         \a index in the logical (vertical) layout.
+     */
+    qreal requiredItemHeight(int index, qreal itemHeight, bool horizontalGroups) const;
+
     /**
      * @return Minimum width of group headers when grouping is enabled in the horizontal
      *         alignment mode. The header alignment is done like this:
@@ -195,6 +233,15 @@ private:
     bool m_dirty;
     bool m_visibleIndexesDirty;
 
+    // Indexes of the first and the last item whose layout must be updated,
+    // or -1 if the layout of all items is valid.
+    int m_firstDirtyIndex;
+    int m_lastDirtyIndex;
+
+    // Number of items and grouping mode of the last layout.
+    int m_itemCount;
+    bool m_grouped;
+
     Qt::Orientation m_scrollOrientation;
     QSizeF m_size;
 
@@ -226,10 +273,8 @@ private:
     qreal m_groupHeaderHeight;
     qreal m_groupHeaderMargin;
 
-    struct ItemInfo {
-        int column;
-        int row;
-    };
+    // Only used if grouping is enabled. Otherwise, the row and the
+    // column of an item are calculated by itemInfo().
     QVector<ItemInfo> m_itemInfos;
 
     friend class KItemListControllerTest;
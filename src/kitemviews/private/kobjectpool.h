@@ -0,0 +1,203 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KOBJECTPOOL_H
+#define KOBJECTPOOL_H
+
+#include <QVector>
+
+#include <new>
+#include <type_traits>
+
+/**
+ * @brief Allocates objects of the type T from slabs of SlabSize objects.
+ *
+ * Creating many small objects one by one with new and delete churns the
+ * heap, and objects that are created one after another might end up far
+ * apart from each other in memory. The objects of a pool are stored next
+ * to each other in the order of their creation instead, which makes
+ * scanning them cache friendly.
+ *
+ * The memory of objects that have been destroyed is reused by the next
+ * call of create(). If all objects have been destroyed, clear() hands
+ * out the memory of the slabs in order again. It only keeps the slabs
+ * that have been used since the previous call of clear(), so the pool
+ * never holds more memory than needed by the last set of objects.
+ */
+template<typename T, int SlabSize = 1024>
+class KObjectPool
+{
+public:
+    KObjectPool();
+    ~KObjectPool();
+
+    /**
+     * @return New default constructed object. It must be
+     *         deleted with destroy() instead of delete.
+     */
+    T* create();
+
+    /**
+     * Destructs the object \a object, which has been created by create().
+     */
+    void destroy(T* object);
+
+    /**
+     * Makes the memory of the slabs available in order again. Slabs that
+     * have not been used since the previous call of clear() are freed.
+     * All objects must have been destroyed before.
+     */
+    void clear();
+
+    /**
+     * @return Number of objects that have been created and not destroyed yet.
+     */
+    int count() const;
+
+    /**
+     * @return Number of objects that have been created since the pool
+     *         has been created. Useful for benchmarks.
+     */
+    int creationCount() const;
+
+    /**
+     * @return Number of slabs that have been allocated since the pool
+     *         has been created. Useful for benchmarks.
+     */
+    int slabAllocationCount() const;
+
+private:
+    struct Slab
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type objects[SlabSize];
+    };
+
+    // Destroyed objects are reused as nodes of a linked list of free memory.
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    static_assert(sizeof(T) >= sizeof(FreeNode), "The objects must be able to store a FreeNode");
+
+    Q_DISABLE_COPY(KObjectPool)
+
+    QVector<Slab*> m_slabs;
+    int m_currentSlab;
+    int m_nextInSlab;
+    FreeNode* m_freeNodes;
+    int m_count;
+    int m_creationCount;
+    int m_slabAllocationCount;
+};
+
+template<typename T, int SlabSize>
+KObjectPool<T, SlabSize>::KObjectPool() :
+    m_slabs(),
+    m_currentSlab(0),
+    m_nextInSlab(0),
+    m_freeNodes(nullptr),
+    m_count(0),
+    m_creationCount(0),
+    m_slabAllocationCount(0)
+{
+}
+
+template<typename T, int SlabSize>
+KObjectPool<T, SlabSize>::~KObjectPool()
+{
+    Q_ASSERT(m_count == 0);
+    qDeleteAll(m_slabs);
+}
+
+template<typename T, int SlabSize>
+T* KObjectPool<T, SlabSize>::create()
+{
+    void* memory;
+    if (m_freeNodes) {
+        memory = m_freeNodes;
+        m_freeNodes = m_freeNodes->next;
+    } else {
+        if (m_nextInSlab == SlabSize) {
+            ++m_currentSlab;
+            m_nextInSlab = 0;
+        }
+        if (m_currentSlab == m_slabs.count()) {
+            m_slabs.append(new Slab);
+            ++m_slabAllocationCount;
+        }
+        memory = &m_slabs.at(m_currentSlab)->objects[m_nextInSlab];
+        ++m_nextInSlab;
+    }
+
+    ++m_count;
+    ++m_creationCount;
+    return new (memory) T();
+}
+
+template<typename T, int SlabSize>
+void KObjectPool<T, SlabSize>::destroy(T* object)
+{
+    if (!object) {
+        return;
+    }
+
+    object->~T();
+
+    FreeNode* node = reinterpret_cast<FreeNode*>(object);
+    node->next = m_freeNodes;
+    m_freeNodes = node;
+    --m_count;
+}
+
+template<typename T, int SlabSize>
+void KObjectPool<T, SlabSize>::clear()
+{
+    Q_ASSERT(m_count == 0);
+
+    const int usedSlabCount = (m_nextInSlab == 0) ? m_currentSlab : m_currentSlab + 1;
+    for (int i = usedSlabCount; i < m_slabs.count(); ++i) {
+        delete m_slabs.at(i);
+    }
+    m_slabs.resize(usedSlabCount);
+
+    m_freeNodes = nullptr;
+    m_currentSlab = 0;
+    m_nextInSlab = 0;
+}
+
+template<typename T, int SlabSize>
+int KObjectPool<T, SlabSize>::count() const
+{
+    return m_count;
+}
+
+template<typename T, int SlabSize>
+int KObjectPool<T, SlabSize>::creationCount() const
+{
+    return m_creationCount;
+}
+
+template<typename T, int SlabSize>
+int KObjectPool<T, SlabSize>::slabAllocationCount() const
+{
+    return m_slabAllocationCount;
+}
+
+#endif
@@ -22,6 +22,9 @@
 
 #include "dolphin_export.h"
 
+#include <QtGlobal>
+
+class QImage;
 class QPixmap;
 class QSize;
 
@@ -35,6 +38,11 @@ public:
      */
     static void scale(QPixmap& pixmap, const QSize& scaledSize);
 
+    /**
+     * Like scale(QPixmap&, const QSize&), but can be used in worker threads.
+     */
+    static void scale(QImage& image, const QSize& scaledSize);
+
     /**
      * Resize and paint a frame round an icon
      * @arg scaledSize is in device-independent pixels
@@ -42,6 +50,12 @@ public:
      */
     static void applyFrame(QPixmap& icon, const QSize& scaledSize);
 
+    /**
+     * Like applyFrame(QPixmap&, const QSize&), but can be used in worker
+     * threads. The image is scaled by the device pixel ratio \a dpr.
+     */
+    static void applyFrame(QImage& icon, const QSize& scaledSize, qreal dpr);
+
     /**
      * return and paint a frame round an icon
      * @arg framesize is in device-independent pixels
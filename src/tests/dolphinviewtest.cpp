@@ -0,0 +1,139 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemviews/kfileitemmodel.h"
+#include "kitemviews/kitemlistcontainer.h"
+#include "kitemviews/kitemlistcontroller.h"
+#include "kitemviews/kitemlistselectionmanager.h"
+#include "views/dolphinview.h"
+#include "testdir.h"
+
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+class DolphinViewTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testSelectionStatistics();
+    void testSelectionStatisticsAfterFileSizeChange();
+
+private:
+    TestDir* m_testDir;
+};
+
+void DolphinViewTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void DolphinViewTest::init()
+{
+    m_testDir = new TestDir();
+}
+
+void DolphinViewTest::cleanup()
+{
+    delete m_testDir;
+    m_testDir = nullptr;
+}
+
+void DolphinViewTest::testSelectionStatistics()
+{
+    m_testDir->createFile("a.txt", "12345");
+    m_testDir->createFile("b.txt", "123");
+    m_testDir->createDir("c");
+
+    DolphinView view(m_testDir->url(), nullptr);
+    QSignalSpy loadingCompletedSpy(&view, &DolphinView::directoryLoadingCompleted);
+    QVERIFY(loadingCompletedSpy.wait());
+    QCOMPARE(view.itemsCount(), 3);
+
+    int fileCount = 0;
+    int folderCount = 0;
+    KIO::filesize_t totalFileSize = 0;
+    view.calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 0);
+    QCOMPARE(folderCount, 0);
+    QCOMPARE(totalFileSize, KIO::filesize_t(0));
+
+    view.selectAll();
+    view.calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 2);
+    QCOMPARE(folderCount, 1);
+    QCOMPARE(totalFileSize, KIO::filesize_t(8));
+
+    // Deselect a.txt. The statistics are updated from the changed selection only.
+    const int index = view.m_model->index(QUrl::fromLocalFile(m_testDir->path() + "/a.txt"));
+    view.m_container->controller()->selectionManager()->setSelected(index, 1, KItemListSelectionManager::Deselect);
+    view.calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 1);
+    QCOMPARE(folderCount, 1);
+    QCOMPARE(totalFileSize, KIO::filesize_t(3));
+}
+
+/**
+ * The size of a selected file must be taken into account even if the
+ * "size" role is not shown, see DolphinView::slotItemsChanged().
+ */
+void DolphinViewTest::testSelectionStatisticsAfterFileSizeChange()
+{
+    m_testDir->createFile("a.txt", "12345");
+    m_testDir->createFile("b.txt", "123");
+
+    DolphinView view(m_testDir->url(), nullptr);
+    QSignalSpy loadingCompletedSpy(&view, &DolphinView::directoryLoadingCompleted);
+    QVERIFY(loadingCompletedSpy.wait());
+    view.setMode(DolphinView::IconsView);
+    QVERIFY(!view.m_model->roles().contains("size"));
+
+    view.selectAll();
+    int fileCount = 0;
+    int folderCount = 0;
+    KIO::filesize_t totalFileSize = 0;
+    view.calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 2);
+    QCOMPARE(totalFileSize, KIO::filesize_t(8));
+
+    // Let a.txt grow and pass the refreshed item to the model like the dir lister does.
+    m_testDir->createFile("a.txt", "1234567890");
+    const int index = view.m_model->index(QUrl::fromLocalFile(m_testDir->path() + "/a.txt"));
+    const KFileItem oldItem = view.m_model->fileItem(index);
+    KFileItem newItem = oldItem;
+    newItem.refresh();
+    QCOMPARE(newItem.size(), KIO::filesize_t(10));
+
+    QSignalSpy itemsChangedSpy(view.m_model, &KFileItemModel::itemsChanged);
+    view.m_model->slotRefreshItems({qMakePair(oldItem, newItem)});
+    QCOMPARE(itemsChangedSpy.count(), 1);
+
+    view.calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 2);
+    QCOMPARE(totalFileSize, KIO::filesize_t(13));
+}
+
+QTEST_MAIN(DolphinViewTest)
+
+#include "dolphinviewtest.moc"
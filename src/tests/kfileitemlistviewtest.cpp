@@ -19,10 +19,13 @@
 
 #include "kitemviews/kfileitemlistview.h"
 #include "kitemviews/kfileitemmodel.h"
+#include "kitemviews/kitemlistcontainer.h"
+#include "kitemviews/kitemlistcontroller.h"
 #include "kitemviews/private/kfileitemmodeldirlister.h"
 #include "testdir.h"
 
 #include <QGraphicsView>
+#include <QPointer>
 #include <QTest>
 #include <QSignalSpy>
 
@@ -34,6 +37,8 @@ private slots:
     void init();
     void cleanup();
     void testGroupedItemChanges();
+    void testDeleteViewWhileResolvingRoles_data();
+    void testDeleteViewWhileResolvingRoles();
 
 private:
     KFileItemListView* m_listView;
@@ -110,6 +115,68 @@ void KFileItemListViewTest::testGroupedItemChanges()
     QCOMPARE(m_model->count(), 2);
 }
 
+void KFileItemListViewTest::testDeleteViewWhileResolvingRoles_data()
+{
+    QTest::addColumn<int>("delay");
+    QTest::addColumn<bool>("cachedItemPainting");
+
+    QTest::newRow("Immediately") << 0 << false;
+    QTest::newRow("After 10 ms") << 10 << false;
+    QTest::newRow("After 50 ms") << 50 << false;
+    QTest::newRow("Immediately, cached painting") << 0 << true;
+    QTest::newRow("After 50 ms, cached painting") << 50 << true;
+}
+
+/**
+ * KItemListContainer deletes its controller, which is the parent of the view
+ * and of the model (see KItemListController::setView() and setModel()). The
+ * view must not be deleted a second time, and deleting it while the roles
+ * updater is still determining MIME types or creating previews in worker
+ * threads must not crash when the results of the workers arrive later.
+ */
+void KFileItemListViewTest::testDeleteViewWhileResolvingRoles()
+{
+    QFETCH(int, delay);
+    QFETCH(bool, cachedItemPainting);
+
+    QStringList files;
+    for (int i = 0; i < 200; ++i) {
+        files << QStringLiteral("file%1.txt").arg(i)
+              << QStringLiteral("image%1.png").arg(i);
+    }
+    m_testDir->createFiles(files);
+
+    KFileItemModel* model = new KFileItemModel();
+    model->m_dirLister->setAutoUpdate(false);
+    model->setRoles({"text", "size", "type"});
+
+    KFileItemListView* view = new KFileItemListView();
+    KItemListController* controller = new KItemListController(model, view);
+    KItemListContainer* container = new KItemListContainer(controller);
+    view->setCachedItemPainting(cachedItemPainting);
+    container->resize(800, 600);
+    container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(container));
+
+    view->setPreviewsShown(true);
+
+    QSignalSpy itemsInsertedSpy(model, &KFileItemModel::itemsInserted);
+    model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QTest::qWait(delay);
+
+    QPointer<KFileItemListView> viewPointer(view);
+    QPointer<KFileItemModel> modelPointer(model);
+    delete container;
+    QVERIFY(viewPointer.isNull());
+
+    // Process the deferred deletion of the model and the results
+    // of the worker threads that are still running.
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    QVERIFY(modelPointer.isNull());
+    QTest::qWait(100);
+}
+
 QTEST_MAIN(KFileItemListViewTest)
 
 #include "kfileitemlistviewtest.moc"
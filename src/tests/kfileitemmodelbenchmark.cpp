@@ -20,9 +20,14 @@
 
 #include <QTest>
 #include <QSignalSpy>
+#include <QThread>
 
 #include <random>
 
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
 #include "kitemviews/kfileitemmodel.h"
 #include "kitemviews/private/kfileitemmodelsortalgorithm.h"
 
@@ -33,6 +38,10 @@ void myMessageOutput(QtMsgType type, const QMessageLogContext& context, const QS
     switch (type) {
     case QtDebugMsg:
         break;
+    case QtInfoMsg:
+        // Used by the benchmarks to report memory statistics.
+        fprintf(stdout, "%s\n", msg.toLocal8Bit().data());
+        break;
     case QtWarningMsg:
         break;
     case QtCriticalMsg:
@@ -59,9 +68,18 @@ public:
 private slots:
     void insertAndRemoveManyItems_data();
     void insertAndRemoveManyItems();
+    void itemDataCreations_data();
+    void itemDataCreations();
+    void sortManyItems_data();
+    void sortManyItems();
 
 private:
     static KFileItemList createFileItemList(const QStringList& fileNames, const QString& urlPrefix = QLatin1String("file:///"));
+
+    /**
+     * @return Peak resident set size of the process in KiB, or -1 if it is not known.
+     */
+    static long peakResidentSetSize();
 };
 
 KFileItemModelBenchmark::KFileItemModelBenchmark()
@@ -167,6 +185,8 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems()
     QSignalSpy spyItemsInserted(&model, &KFileItemModel::itemsInserted);
     QSignalSpy spyItemsRemoved(&model, &KFileItemModel::itemsRemoved);
 
+    const int creationCount = model.m_itemDataPool.creationCount();
+
     QBENCHMARK {
         model.slotClear();
         model.slotItemsAdded(model.directory(), initialItems);
@@ -185,6 +205,11 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems()
         QCOMPARE(model.count(), initialItems.count() + newItems.count() - removedItems.count());
     }
 
+    // The ItemData instances are allocated in slabs, which are reused after each slotClear().
+    qInfo("%s: %i ItemData instances created, %i slab allocations, peak RSS %li KiB",
+          QTest::currentDataTag(), model.m_itemDataPool.creationCount() - creationCount,
+          model.m_itemDataPool.slabAllocationCount(), peakResidentSetSize());
+
     QVERIFY(model.isConsistent());
 
     for (int i = 0; i < model.count(); ++i) {
@@ -204,6 +229,102 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems()
     }
 }
 
+void KFileItemModelBenchmark::itemDataCreations_data()
+{
+    insertAndRemoveManyItems_data();
+}
+
+void KFileItemModelBenchmark::itemDataCreations()
+{
+    QFETCH(KFileItemList, initialItems);
+    QFETCH(KFileItemList, newItems);
+    QFETCH(KFileItemList, removedItems);
+
+    KFileItemModel model;
+    model.m_naturalSorting = false;
+    model.setRoles({"text"});
+
+    int slabAllocationCount = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        const int creationCount = model.m_itemDataPool.creationCount();
+
+        model.slotClear();
+        model.slotItemsAdded(model.directory(), initialItems);
+        model.slotCompleted();
+        if (!newItems.isEmpty()) {
+            model.slotItemsAdded(model.directory(), newItems);
+            model.slotCompleted();
+        }
+        if (!removedItems.isEmpty()) {
+            model.slotItemsDeleted(removedItems);
+        }
+
+        if (pass == 0) {
+            slabAllocationCount = model.m_itemDataPool.slabAllocationCount();
+        } else {
+            // The slabs of the first pass must have been reused.
+            QCOMPARE(model.m_itemDataPool.slabAllocationCount(), slabAllocationCount);
+            QTest::setBenchmarkResult(model.m_itemDataPool.creationCount() - creationCount, QTest::Events);
+        }
+    }
+}
+
+void KFileItemModelBenchmark::sortManyItems_data()
+{
+    QTest::addColumn<int>("itemCount");
+    QTest::addColumn<int>("numberOfThreads");
+
+    QList<int> sizes;
+    sizes << 500000;
+
+    foreach (int n, sizes) {
+        const int bufferSize = 128;
+        char buffer[bufferSize];
+
+        snprintf(buffer, bufferSize, "1 thread--n=%i", n);
+        QTest::newRow(buffer) << n << 1;
+
+        const int idealThreadCount = QThread::idealThreadCount();
+        snprintf(buffer, bufferSize, "%i threads--n=%i", idealThreadCount, n);
+        QTest::newRow(buffer) << n << idealThreadCount;
+    }
+}
+
+void KFileItemModelBenchmark::sortManyItems()
+{
+    QFETCH(int, itemCount);
+    QFETCH(int, numberOfThreads);
+
+    typedef QPair<int, int> Item;
+
+    // Each item consists of a random sort value and its original position.
+    // Many sort values are equal, which allows to verify that the sorting
+    // is stable.
+    std::mt19937 randomEngine(itemCount);
+    std::uniform_int_distribution<int> distribution(0, itemCount / 10);
+
+    QVector<Item> items;
+    items.reserve(itemCount);
+    for (int i = 0; i < itemCount; ++i) {
+        items.append(qMakePair(distribution(randomEngine), i));
+    }
+
+    const auto lessThan = [](const Item& a, const Item& b) {
+        return a.first < b.first;
+    };
+
+    QVector<Item> expectedItems = items;
+    std::stable_sort(expectedItems.begin(), expectedItems.end(), lessThan);
+
+    QVector<Item> sortedItems;
+    QBENCHMARK {
+        sortedItems = items;
+        parallelMergeSort(sortedItems.begin(), sortedItems.end(), lessThan, numberOfThreads);
+    }
+
+    QCOMPARE(sortedItems, expectedItems);
+}
+
 KFileItemList KFileItemModelBenchmark::createFileItemList(const QStringList& fileNames, const QString& prefix)
 {
     // Suppress 'file does not exist anymore' messages from KFileItemPrivate::init().
@@ -217,6 +338,22 @@ KFileItemList KFileItemModelBenchmark::createFileItemList(const QStringList& fil
     return result;
 }
 
+long KFileItemModelBenchmark::peakResidentSetSize()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+        // macOS reports bytes instead of KiB
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return -1;
+}
+
 QTEST_MAIN(KFileItemModelBenchmark)
 
 #include "kfileitemmodelbenchmark.moc"
@@ -22,6 +22,7 @@
 #include <QSignalSpy>
 #include <QTimer>
 #include <QMimeData>
+#include <QMimeDatabase>
 
 #include <kio/job.h>
 
@@ -66,11 +67,15 @@ private slots:
     void testDefaultGroupedSorting();
     void testNewItems();
     void testRemoveItems();
+    void testItemStatistics();
     void testDirLoadingCompleted();
     void testSetData();
+    void testSetDataForMultipleItems();
     void testSetDataWithModifiedSortRole_data();
     void testSetDataWithModifiedSortRole();
+    void testResortPendingItems();
     void testChangeSortRole();
+    void testLoadDirectorySortedByType();
     void testResortAfterChangingName();
     void testModelConsistencyWhenInsertingItems();
     void testItemRangeConsistencyWhenInsertingItems();
@@ -89,6 +94,7 @@ private slots:
     void testGeneralParentChildRelationships();
     void testNameRoleGroups();
     void testNameRoleGroupsWithExpandedItems();
+    void testNameRoleGroupsAfterInsertingAndRemovingItems();
     void testInconsistentModel();
     void testChangeRolesForFilteredItems();
     void testChangeSortRoleWhileFiltering();
@@ -96,6 +102,8 @@ private slots:
     void testCollapseFolderWhileLoading();
     void testCreateMimeData();
     void testDeleteFileMoreThanOnce();
+    void testTypeOfFoldersWithUnknownMimeType();
+    void testSizeRoleGroups();
 
 private:
     QStringList itemsInModel() const;
@@ -120,7 +128,7 @@ void KFileItemModelTest::init()
     m_model->m_dirLister->setAutoUpdate(false);
 
     // Reduce the timer interval to make the test run faster.
-    m_model->m_resortAllItemsTimer->setInterval(0);
+    m_model->m_resortPendingItemsTimer->setInterval(0);
 }
 
 void KFileItemModelTest::cleanup()
@@ -197,6 +205,43 @@ void KFileItemModelTest::testRemoveItems()
     QVERIFY(m_model->isConsistent());
 }
 
+void KFileItemModelTest::testItemStatistics()
+{
+    QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
+    QSignalSpy itemsRemovedSpy(m_model, &KFileItemModel::itemsRemoved);
+
+    m_testDir->createFile("a.txt", "12345");
+    m_testDir->createFile("b.txt", "123");
+    m_testDir->createDir("c");
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->count(), 3);
+
+    int fileCount = 0;
+    int folderCount = 0;
+    KIO::filesize_t totalFileSize = 0;
+    m_model->itemStatistics(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 2);
+    QCOMPARE(folderCount, 1);
+    QCOMPARE(totalFileSize, KIO::filesize_t(8));
+
+    m_testDir->removeFile("a.txt");
+    m_model->m_dirLister->updateDirectory(m_testDir->url());
+    QVERIFY(itemsRemovedSpy.wait());
+    QCOMPARE(m_model->count(), 2);
+
+    m_model->itemStatistics(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 1);
+    QCOMPARE(folderCount, 1);
+    QCOMPARE(totalFileSize, KIO::filesize_t(3));
+
+    m_model->clear();
+    m_model->itemStatistics(fileCount, folderCount, totalFileSize);
+    QCOMPARE(fileCount, 0);
+    QCOMPARE(folderCount, 0);
+    QCOMPARE(totalFileSize, KIO::filesize_t(0));
+}
+
 void KFileItemModelTest::testDirLoadingCompleted()
 {
     QSignalSpy loadingCompletedSpy(m_model, &KFileItemModel::directoryLoadingCompleted);
@@ -265,6 +310,47 @@ void KFileItemModelTest::testSetData()
     QVERIFY(m_model->isConsistent());
 }
 
+void KFileItemModelTest::testSetDataForMultipleItems()
+{
+    QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
+    QVERIFY(itemsInsertedSpy.isValid());
+    QSignalSpy itemsChangedSpy(m_model, &KFileItemModel::itemsChanged);
+    QVERIFY(itemsChangedSpy.isValid());
+
+    m_testDir->createFiles({"a.txt", "b.txt", "c.txt", "d.txt"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+
+    QHash<QByteArray, QVariant> values1;
+    values1.insert("customRole1", "Test1");
+    QHash<QByteArray, QVariant> values2;
+    values2.insert("customRole2", "Test2");
+
+    QMap<int, QHash<QByteArray, QVariant> > values;
+    values.insert(0, values1);
+    values.insert(1, values1);
+    values.insert(3, values2);
+    values.insert(4, values2); // Invalid index, must be ignored.
+
+    QVERIFY(m_model->setData(values));
+    QCOMPARE(itemsChangedSpy.count(), 1);
+
+    const QList<QVariant> arguments = itemsChangedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRangeList>(), KItemRangeList() << KItemRange(0, 2) << KItemRange(3, 1));
+    QCOMPARE(arguments.at(1).value<QSet<QByteArray> >(), QSet<QByteArray>() << "customRole1" << "customRole2");
+
+    QCOMPARE(m_model->data(0).value("customRole1").toString(), QString("Test1"));
+    QCOMPARE(m_model->data(1).value("customRole1").toString(), QString("Test1"));
+    QVERIFY(!m_model->data(2).contains("customRole1"));
+    QCOMPARE(m_model->data(3).value("customRole2").toString(), QString("Test2"));
+
+    // Setting the same values again does not change anything.
+    QVERIFY(!m_model->setData(values));
+    QCOMPARE(itemsChangedSpy.count(), 0);
+    QVERIFY(m_model->isConsistent());
+}
+
 void KFileItemModelTest::testSetDataWithModifiedSortRole_data()
 {
     QTest::addColumn<int>("changedIndex");
@@ -350,6 +436,55 @@ void KFileItemModelTest::testSetDataWithModifiedSortRole()
     QVERIFY(m_model->isConsistent());
 }
 
+void KFileItemModelTest::testResortPendingItems()
+{
+    QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
+    QVERIFY(itemsInsertedSpy.isValid());
+    QSignalSpy itemsMovedSpy(m_model, &KFileItemModel::itemsMoved);
+    QVERIFY(itemsMovedSpy.isValid());
+
+    m_model->setSortRole("rating");
+    m_testDir->createFiles({"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b" << "c" << "d" << "e" << "f" << "g" << "h" << "i" << "j");
+
+    // Assign the ratings 0, 2, ..., 18 to the items, starting with the last
+    // item, so that the order of the items is always correct.
+    for (int index = m_model->count() - 1; index >= 0; --index) {
+        QHash<QByteArray, QVariant> rating;
+        rating.insert("rating", 2 * index);
+        m_model->setData(index, rating);
+    }
+    QCOMPARE(itemsMovedSpy.count(), 0);
+
+    // Change the rating of "h" from 14 to 5. Only the items between the old
+    // and the new position of "h" must be moved.
+    QHash<QByteArray, QVariant> rating;
+    rating.insert("rating", 5);
+    m_model->setData(7, rating);
+    QCOMPARE(m_model->m_pendingItemsToResort.count(), 1);
+
+    // Change the rating of "b" from 2 to 3 and the rating of "g" from 12 to 15.
+    // Both items are still in order relative to their neighbors that are not
+    // pending and must not be queued for resorting.
+    rating.insert("rating", 3);
+    m_model->setData(1, rating);
+    rating.insert("rating", 15);
+    m_model->setData(6, rating);
+    QCOMPARE(m_model->m_pendingItemsToResort.count(), 1);
+
+    QVERIFY(itemsMovedSpy.wait());
+    QCOMPARE(itemsMovedSpy.count(), 1);
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b" << "c" << "h" << "d" << "e" << "f" << "g" << "i" << "j");
+
+    const QList<QVariant> arguments = itemsMovedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRange>(), KItemRange(3, 5));
+    QCOMPARE(arguments.at(1).value<QList<int> >(), QList<int>() << 4 << 5 << 6 << 7 << 3);
+    QVERIFY(m_model->isConsistent());
+}
+
 void KFileItemModelTest::testChangeSortRole()
 {
     QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
@@ -390,6 +525,30 @@ void KFileItemModelTest::testChangeSortRole()
     QVERIFY(ok1 || ok2);
 }
 
+void KFileItemModelTest::testLoadDirectorySortedByType()
+{
+    QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
+    QSignalSpy itemsMovedSpy(m_model, &KFileItemModel::itemsMoved);
+
+    m_model->setSortRole("type");
+    m_testDir->createFiles({"a.txt", "b.jpg", "c.txt"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->count(), 3);
+
+    // The MIME types are determined before the items are inserted,
+    // so the items are sorted correctly right away.
+    for (int index = 0; index < m_model->count(); ++index) {
+        QVERIFY(m_model->fileItem(index).isMimeTypeKnown());
+    }
+    QVERIFY(itemsMovedSpy.isEmpty());
+
+    const QStringList version1 = {"b.jpg", "a.txt", "c.txt"};
+    const QStringList version2 = {"a.txt", "c.txt", "b.jpg"};
+    QVERIFY(itemsInModel() == version1 || itemsInModel() == version2);
+}
+
 void KFileItemModelTest::testResortAfterChangingName()
 {
     QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
@@ -997,6 +1156,37 @@ void KFileItemModelTest::testIndexForKeyboardSearch()
     QCOMPARE(m_model->indexForKeyboardSearch("TexT", 5), 5);
     QCOMPARE(m_model->indexForKeyboardSearch("IMAGE", 4), 2);
 
+    // Test that the search takes removed items into account
+    QSignalSpy itemsRemovedSpy(m_model, &KFileItemModel::itemsRemoved);
+    m_testDir->removeFile("a");
+    m_model->m_dirLister->updateDirectory(m_testDir->url());
+    QVERIFY(itemsRemovedSpy.wait());
+    QCOMPARE(m_model->indexForKeyboardSearch("a", 0), 0);
+    QCOMPARE(m_model->indexForKeyboardSearch("aa", 1), 0);
+    QCOMPARE(m_model->indexForKeyboardSearch("image.png", 0), 2);
+
+    // Test that the search takes inserted items into account
+    itemsInsertedSpy.clear();
+    m_testDir->createFile("ab");
+    m_model->m_dirLister->updateDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->indexForKeyboardSearch("a", 1), 1);
+    QCOMPARE(m_model->indexForKeyboardSearch("a", 2), 0);
+    QCOMPARE(m_model->indexForKeyboardSearch("ab", 0), 1);
+    QCOMPARE(m_model->indexForKeyboardSearch("image.png", 0), 3);
+
+    // Test that the search takes renamed and moved items into account
+    QSignalSpy itemsMovedSpy(m_model, &KFileItemModel::itemsMoved);
+    QHash<QByteArray, QVariant> data;
+    data.insert("text", "Zz");
+    m_model->setData(0, data);
+    QCOMPARE(m_model->indexForKeyboardSearch("aa", 0), -1);
+    QCOMPARE(m_model->indexForKeyboardSearch("z", 0), 0);
+    QVERIFY(itemsMovedSpy.wait());
+    QCOMPARE(m_model->indexForKeyboardSearch("z", 0), 7);
+    QCOMPARE(m_model->indexForKeyboardSearch("a", 0), 0);
+    QCOMPARE(m_model->indexForKeyboardSearch("t", 5), 5);
+
     // TODO: Maybe we should also test keyboard searches in directories which are not sorted by Name?
 }
 
@@ -1024,6 +1214,24 @@ void KFileItemModelTest::testNameFilter()
     m_model->setNameFilter("bC"); // Shows "Abc" and "Bcd"
     QCOMPARE(m_model->count(), 2);
 
+    m_model->setNameFilter("bCd"); // Shows only "Bcd"
+    QCOMPARE(m_model->count(), 1);
+
+    m_model->setNameFilter("c"); // Shows "Abc", "Bcd" and "Cde"
+    QCOMPARE(m_model->count(), 3);
+
+    m_model->setNameFilter("a?"); // Shows "A1" and "A2"
+    QCOMPARE(m_model->count(), 2);
+
+    m_model->setNameFilter("[ab]*"); // Shows "A1", "A2", "Abc" and "Bcd"
+    QCOMPARE(m_model->count(), 4);
+
+    m_model->setNameFilter("*[!0-9]"); // Shows "Abc", "Bcd" and "Cde"
+    QCOMPARE(m_model->count(), 3);
+
+    m_model->setNameFilter("[a"); // No valid wildcard expression, shows no item
+    QCOMPARE(m_model->count(), 0);
+
     m_model->setNameFilter(QString()); // Shows again all items
     QCOMPARE(m_model->count(), 5);
 }
@@ -1365,10 +1573,11 @@ void KFileItemModelTest::testNameRoleGroups()
     expectedGroups << QPair<int, QVariant>(3, QLatin1String("E"));
     QCOMPARE(m_model->groups(), expectedGroups);
 
-    // Rename c.txt to d.txt.
+    // Rename c.txt to d.txt. The groups are updated immediately.
+    groupsChangedSpy.clear();
     data.insert("text", "d.txt");
     m_model->setData(2, data);
-    QVERIFY(groupsChangedSpy.wait());
+    QCOMPARE(groupsChangedSpy.count(), 1);
     QCOMPARE(itemsInModel(), QStringList() << "a.txt" << "b.txt" << "d.txt" << "e.txt");
 
     expectedGroups.clear();
@@ -1385,8 +1594,9 @@ void KFileItemModelTest::testNameRoleGroups()
     urlC.setPath(urlC.path() + "c.txt");
     fileItemC.setUrl(urlC);
 
+    groupsChangedSpy.clear();
     m_model->slotRefreshItems({qMakePair(fileItemD, fileItemC)});
-    QVERIFY(groupsChangedSpy.wait());
+    QCOMPARE(groupsChangedSpy.count(), 1);
     QCOMPARE(itemsInModel(), QStringList() << "a.txt" << "b.txt" << "c.txt" << "e.txt");
 
     expectedGroups.clear();
@@ -1435,6 +1645,70 @@ void KFileItemModelTest::testNameRoleGroupsWithExpandedItems()
     QCOMPARE(m_model->groups(), expectedGroups);
 }
 
+void KFileItemModelTest::testNameRoleGroupsAfterInsertingAndRemovingItems()
+{
+    auto createFileItems = [this](const QStringList& names) {
+        KFileItemList items;
+        foreach (const QString& name, names) {
+            KIO::UDSEntry entry;
+            entry.fastInsert(KIO::UDSEntry::UDS_NAME, name);
+            entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, 0100000);    // S_IFREG might not be defined on non-Unix platforms.
+            entry.fastInsert(KIO::UDSEntry::UDS_ACCESS, 07777);
+            entry.fastInsert(KIO::UDSEntry::UDS_SIZE, 0);
+            entry.fastInsert(KIO::UDSEntry::UDS_MODIFICATION_TIME, 0);
+            items.append(KFileItem(entry, m_testDir->url(), false, true));
+        }
+        return items;
+    };
+
+    m_model->setGroupedSorting(true);
+    m_model->slotItemsAdded(m_testDir->url(), createFileItems({"b1.txt", "d1.txt", "f1.txt"}));
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "b1.txt" << "d1.txt" << "f1.txt");
+
+    QList<QPair<int, QVariant> > expectedGroups;
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("B"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(2, QLatin1String("F"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // Insert items in front of, between, and behind the existing items. Some of
+    // them start new groups, and some of them are added to existing groups.
+    m_model->slotItemsAdded(m_testDir->url(), createFileItems({"a1.txt", "b2.txt", "c1.txt", "d0.txt", "g1.txt"}));
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "a1.txt" << "b1.txt" << "b2.txt" << "c1.txt" << "d0.txt" << "d1.txt" << "f1.txt" << "g1.txt");
+
+    expectedGroups.clear();
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("A"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("B"));
+    expectedGroups << QPair<int, QVariant>(3, QLatin1String("C"));
+    expectedGroups << QPair<int, QVariant>(4, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(6, QLatin1String("F"));
+    expectedGroups << QPair<int, QVariant>(7, QLatin1String("G"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // Remove the first item of a group, the only item of a group, and the last item.
+    m_model->slotItemsDeleted(KFileItemList() << m_model->fileItem(1) << m_model->fileItem(3) << m_model->fileItem(7));
+    QCOMPARE(itemsInModel(), QStringList() << "a1.txt" << "b2.txt" << "d0.txt" << "d1.txt" << "f1.txt");
+
+    expectedGroups.clear();
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("A"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("B"));
+    expectedGroups << QPair<int, QVariant>(2, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(4, QLatin1String("F"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // Remove all items of the groups "B" and "D", such that the items "a1.txt"
+    // and "f1.txt" become neighbors.
+    m_model->slotItemsDeleted(KFileItemList() << m_model->fileItem(1) << m_model->fileItem(2) << m_model->fileItem(3));
+    QCOMPARE(itemsInModel(), QStringList() << "a1.txt" << "f1.txt");
+
+    expectedGroups.clear();
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("A"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("F"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+}
+
 void KFileItemModelTest::testInconsistentModel()
 {
     QSignalSpy itemsInsertedSpy(m_model, &KFileItemModel::itemsInserted);
@@ -1744,6 +2018,74 @@ void KFileItemModelTest::testDeleteFileMoreThanOnce()
     QCOMPARE(itemsInModel(), QStringList() << "a.txt" << "c.txt" << "d.txt");
 }
 
+void KFileItemModelTest::testTypeOfFoldersWithUnknownMimeType()
+{
+    KFileItemList items;
+    foreach (const QString& name, QStringList() << "a" << "b.txt" << "c.jpg") {
+        m_testDir->createDir(name);
+
+        KIO::UDSEntry entry;
+        entry.fastInsert(KIO::UDSEntry::UDS_NAME, name);
+        entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, 0040000);    // S_IFDIR might not be defined on non-Unix platforms.
+        entry.fastInsert(KIO::UDSEntry::UDS_ACCESS, 07777);
+        entry.fastInsert(KIO::UDSEntry::UDS_SIZE, 0);
+        entry.fastInsert(KIO::UDSEntry::UDS_MODIFICATION_TIME, 0);
+        // Delay the MIME type determination like KFileItemModelDirLister does.
+        items.append(KFileItem(entry, m_testDir->url(), true, true));
+    }
+
+    m_model->slotItemsAdded(m_testDir->url(), items);
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b.txt" << "c.jpg");
+
+    // The folders must be sorted by the comment of the folder MIME type, no
+    // matter which folder has been seen first and what its name looks like.
+    m_model->setSortRole("type");
+    const QString folderMimeComment = QMimeDatabase().mimeTypeForName(QStringLiteral("inode/directory")).comment();
+    for (int index = 0; index < m_model->count(); ++index) {
+        const KFileItemModel::ItemData* data = m_model->m_itemData.at(index);
+        QCOMPARE(m_model->m_columns.string(KFileItemModel::TypeRole, data->slot), folderMimeComment);
+    }
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b.txt" << "c.jpg");
+}
+
+void KFileItemModelTest::testSizeRoleGroups()
+{
+    auto createItem = [this](const QString& name, int fileType, qint64 size) {
+        KIO::UDSEntry entry;
+        entry.fastInsert(KIO::UDSEntry::UDS_NAME, name);
+        entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, fileType);
+        entry.fastInsert(KIO::UDSEntry::UDS_ACCESS, 07777);
+        entry.fastInsert(KIO::UDSEntry::UDS_SIZE, size);
+        entry.fastInsert(KIO::UDSEntry::UDS_MODIFICATION_TIME, 0);
+        return KFileItem(entry, m_testDir->url(), false, true);
+    };
+
+    // S_IFDIR and S_IFREG might not be defined on non-Unix platforms.
+    const qint64 mebibyte = 1024 * 1024;
+    KFileItemList items;
+    items << createItem("a", 0040000, 0)
+          << createItem("b.txt", 0100000, 0)
+          << createItem("c.txt", 0100000, 6 * mebibyte)
+          << createItem("d.txt", 0100000, 20 * mebibyte)
+          << createItem("e.txt", 0100000, 5 * 1024 * mebibyte);
+
+    m_model->setGroupedSorting(true);
+    m_model->setSortRole("size");
+    m_model->slotItemsAdded(m_testDir->url(), items);
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b.txt" << "c.txt" << "d.txt" << "e.txt");
+
+    // Sizes beyond 4 GiB may not be truncated, so "e.txt" shares the
+    // group of "d.txt" (Folders, Small, Medium, Big).
+    const QList<QPair<int, QVariant> > groups = m_model->groups();
+    QCOMPARE(groups.count(), 4);
+    QCOMPARE(groups.at(0).first, 0);
+    QCOMPARE(groups.at(1).first, 1);
+    QCOMPARE(groups.at(2).first, 2);
+    QCOMPARE(groups.at(3).first, 3);
+}
+
 QStringList KFileItemModelTest::itemsInModel() const
 {
     QStringList items;
@@ -73,6 +73,7 @@ private slots:
     void testCurrentItemAnchorItem();
     void testSetSelected_data();
     void testSetSelected();
+    void testSetSelectedItemSet();
     void testItemsInserted();
     void testItemsRemoved();
     void testAnchoredSelection();
@@ -211,6 +212,27 @@ void KItemListSelectionManagerTest::testSetSelected()
     QCOMPARE(m_selectionManager->selectedItems().count(), expectedSelectionCount);
 }
 
+void KItemListSelectionManagerTest::testSetSelectedItemSet()
+{
+    QSignalSpy spySelectionChanged(m_selectionManager, &KItemListSelectionManager::selectionChanged);
+
+    m_selectionManager->setSelected(KItemSet() << 2 << 3 << 4 << 10 << 50);
+    QCOMPARE(m_selectionManager->selectedItems(), KItemSet() << 2 << 3 << 4 << 10 << 50);
+    QCOMPARE(spySelectionChanged.count(), 1);
+
+    m_selectionManager->setSelected(KItemSet() << 3 << 10 << 11, KItemListSelectionManager::Deselect);
+    QCOMPARE(m_selectionManager->selectedItems(), KItemSet() << 2 << 4 << 50);
+    QCOMPARE(spySelectionChanged.count(), 2);
+
+    m_selectionManager->setSelected(KItemSet() << 1 << 2 << 3, KItemListSelectionManager::Toggle);
+    QCOMPARE(m_selectionManager->selectedItems(), KItemSet() << 1 << 3 << 4 << 50);
+    QCOMPARE(spySelectionChanged.count(), 3);
+
+    // Selecting already selected items must not emit a signal
+    m_selectionManager->setSelected(KItemSet() << 3 << 4);
+    QCOMPARE(spySelectionChanged.count(), 3);
+}
+
 void KItemListSelectionManagerTest::testItemsInserted()
 {
     // Select items 10 to 12
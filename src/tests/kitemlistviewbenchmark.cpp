@@ -0,0 +1,405 @@
+/***************************************************************************
+ *   Copyright (C) 2019 by KDE e.V. <kde-ev-board@kde.org>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemviews/kfileitemmodel.h"
+#include "kitemviews/kitemlistcontainer.h"
+#include "kitemviews/kitemlistcontroller.h"
+#include "views/dolphinitemlistview.h"
+#include "views/zoomlevelinfo.h"
+
+#include <KIO/UDSEntry>
+
+#include <QElapsedTimer>
+#include <QGraphicsView>
+#include <QStandardPaths>
+#include <QTest>
+
+/**
+ * Measures the performance of DolphinItemListView for synthetic models
+ * in the Icons, Compact and Details layouts:
+ *
+ * - firstPaint: Time from showing the view until the first frame is painted.
+ * - scroll:     Time for scrolling one page and painting the frame.
+ * - smoothScroll: Time for scrolling a few pixels and painting the frame,
+ *               with and without cached item painting.
+ * - insertItems: Time for inserting items at spread positions into a shown
+ *               view and painting the next frame.
+ * - zoom:       Time for changing the zoom level and painting the next frame.
+ *
+ * The benchmark is meant to be run on the offscreen platform, e.g.
+ * "QT_QPA_PLATFORM=offscreen kitemlistviewbenchmark -o results.xml,xml".
+ * QTest writes the results in a machine-readable format with the
+ * "-o <file>,<format>" option, where format can be xml, csv or lightxml.
+ *
+ * Per default models with up to 100000 items are used. The environment
+ * variable DOLPHIN_BENCHMARK_MAX_ITEMS allows to include larger models.
+ */
+class KItemListViewBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void firstPaint_data();
+    void firstPaint();
+
+    void scroll_data();
+    void scroll();
+
+    void smoothScroll_data();
+    void smoothScroll();
+
+    void insertItems_data();
+    void insertItems();
+
+    void zoom_data();
+    void zoom();
+
+private:
+    /**
+     * Adds the rows for all layouts and model sizes to the current test data.
+     */
+    static void addLayoutRows();
+
+    /**
+     * @return Items named like "File 42.txt" with \a suffix appended to the number.
+     *         The numbers are \a step apart from each other.
+     */
+    static KFileItemList createFileItems(int count, int step, const QString& suffix);
+
+    static void addItems(KFileItemModel* model, const KFileItemList& items);
+
+    /**
+     * @return Container that shows \a model in \a view using the layout \a layout.
+     *         The container is not shown yet. Deleting the container also deletes
+     *         \a model and \a view, as the controller of the container owns both.
+     */
+    static KItemListContainer* createContainer(KFileItemModel* model, DolphinItemListView* view,
+                                               KStandardItemListView::ItemLayout layout);
+
+    /**
+     * Paints the container synchronously, like the event loop would do for the next frame.
+     */
+    static void paint(KItemListContainer* container);
+
+    static void setResult(qint64 nanoseconds, int count);
+};
+
+Q_DECLARE_METATYPE(KStandardItemListView::ItemLayout)
+
+namespace {
+    const QUrl DirectoryUrl(QStringLiteral("file:///benchmark"));
+    const QSize ViewSize(1024, 768);
+
+    // Number of frames that are painted while scrolling
+    const int ScrollFrameCount = 100;
+
+    // Number of items that are inserted by KItemListViewBenchmark::insertItems()
+    const int InsertedItemCount = 1000;
+
+    const int DefaultMaximumItemCount = 100000;
+}
+
+void KItemListViewBenchmark::initTestCase()
+{
+    // DolphinItemListView reads and writes its settings
+    QStandardPaths::setTestModeEnabled(true);
+
+    qRegisterMetaType<KStandardItemListView::ItemLayout>();
+}
+
+void KItemListViewBenchmark::firstPaint_data()
+{
+    addLayoutRows();
+}
+
+void KItemListViewBenchmark::firstPaint()
+{
+    QFETCH(KStandardItemListView::ItemLayout, layout);
+    QFETCH(int, itemCount);
+
+    KFileItemModel* model = new KFileItemModel();
+    addItems(model, createFileItems(itemCount, 1, QString()));
+
+    DolphinItemListView* view = new DolphinItemListView();
+    KItemListContainer* container = createContainer(model, view, layout);
+
+    QElapsedTimer timer;
+    timer.start();
+    container->show();
+    paint(container);
+    setResult(timer.nsecsElapsed(), 1);
+
+    delete container;
+}
+
+void KItemListViewBenchmark::scroll_data()
+{
+    addLayoutRows();
+}
+
+void KItemListViewBenchmark::scroll()
+{
+    QFETCH(KStandardItemListView::ItemLayout, layout);
+    QFETCH(int, itemCount);
+
+    KFileItemModel* model = new KFileItemModel();
+    addItems(model, createFileItems(itemCount, 1, QString()));
+
+    DolphinItemListView* view = new DolphinItemListView();
+    KItemListContainer* container = createContainer(model, view, layout);
+    container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(container));
+    paint(container);
+
+    // Scroll by one page per frame. When the end is reached, scroll
+    // back to the top, which requires a full relayout of the view.
+    const qreal pageStep = (layout == KStandardItemListView::CompactLayout)
+                         ? view->size().width() : view->size().height();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int frame = 0; frame < ScrollFrameCount; ++frame) {
+        qreal offset = view->scrollOffset() + pageStep;
+        if (offset > view->maximumScrollOffset()) {
+            offset = 0;
+        }
+        view->setScrollOffset(offset);
+        paint(container);
+    }
+    setResult(timer.nsecsElapsed(), ScrollFrameCount);
+
+    delete container;
+}
+
+void KItemListViewBenchmark::smoothScroll_data()
+{
+    QTest::addColumn<KStandardItemListView::ItemLayout>("layout");
+    QTest::addColumn<bool>("cachedItemPainting");
+
+    QTest::newRow("icons") << KStandardItemListView::IconsLayout << false;
+    QTest::newRow("icons--cached") << KStandardItemListView::IconsLayout << true;
+    QTest::newRow("compact") << KStandardItemListView::CompactLayout << false;
+    QTest::newRow("compact--cached") << KStandardItemListView::CompactLayout << true;
+    QTest::newRow("details") << KStandardItemListView::DetailsLayout << false;
+    QTest::newRow("details--cached") << KStandardItemListView::DetailsLayout << true;
+}
+
+void KItemListViewBenchmark::smoothScroll()
+{
+    QFETCH(KStandardItemListView::ItemLayout, layout);
+    QFETCH(bool, cachedItemPainting);
+
+    KFileItemModel* model = new KFileItemModel();
+    addItems(model, createFileItems(10000, 1, QString()));
+
+    DolphinItemListView* view = new DolphinItemListView();
+    KItemListContainer* container = createContainer(model, view, layout);
+    view->setCachedItemPainting(cachedItemPainting);
+    container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(container));
+    paint(container);
+
+    // Scroll by a few pixels per frame like the smooth scroller does, so
+    // that most of the widgets stay visible between two frames.
+    const qreal step = 4;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int frame = 0; frame < ScrollFrameCount; ++frame) {
+        qreal offset = view->scrollOffset() + step;
+        if (offset > view->maximumScrollOffset()) {
+            offset = 0;
+        }
+        view->setScrollOffset(offset);
+        paint(container);
+    }
+    setResult(timer.nsecsElapsed(), ScrollFrameCount);
+
+    delete container;
+}
+
+void KItemListViewBenchmark::insertItems_data()
+{
+    addLayoutRows();
+}
+
+void KItemListViewBenchmark::insertItems()
+{
+    QFETCH(KStandardItemListView::ItemLayout, layout);
+    QFETCH(int, itemCount);
+
+    KFileItemModel* model = new KFileItemModel();
+    addItems(model, createFileItems(itemCount, 1, QString()));
+
+    DolphinItemListView* view = new DolphinItemListView();
+    KItemListContainer* container = createContainer(model, view, layout);
+    container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(container));
+    paint(container);
+
+    // Spread the new items over the whole model, so that
+    // items in front of the visible area are moved, too.
+    const int step = qMax(1, itemCount / InsertedItemCount);
+    const KFileItemList newItems = createFileItems(InsertedItemCount, step, QStringLiteral(" copy"));
+
+    QElapsedTimer timer;
+    timer.start();
+    addItems(model, newItems);
+    paint(container);
+    setResult(timer.nsecsElapsed(), 1);
+
+    QCOMPARE(model->count(), itemCount + InsertedItemCount);
+
+    delete container;
+}
+
+void KItemListViewBenchmark::zoom_data()
+{
+    addLayoutRows();
+}
+
+void KItemListViewBenchmark::zoom()
+{
+    QFETCH(KStandardItemListView::ItemLayout, layout);
+    QFETCH(int, itemCount);
+
+    KFileItemModel* model = new KFileItemModel();
+    addItems(model, createFileItems(itemCount, 1, QString()));
+
+    DolphinItemListView* view = new DolphinItemListView();
+    KItemListContainer* container = createContainer(model, view, layout);
+    container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(container));
+    paint(container);
+
+    const int initialZoomLevel = view->zoomLevel();
+
+    // Step through all zoom levels and back to the initial one
+    int zoomChangeCount = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int level = ZoomLevelInfo::minimumLevel(); level <= ZoomLevelInfo::maximumLevel(); ++level) {
+        if (level != view->zoomLevel()) {
+            view->setZoomLevel(level);
+            paint(container);
+            ++zoomChangeCount;
+        }
+    }
+    view->setZoomLevel(initialZoomLevel);
+    paint(container);
+    ++zoomChangeCount;
+    setResult(timer.nsecsElapsed(), zoomChangeCount);
+
+    delete container;
+}
+
+void KItemListViewBenchmark::addLayoutRows()
+{
+    QTest::addColumn<KStandardItemListView::ItemLayout>("layout");
+    QTest::addColumn<int>("itemCount");
+
+    bool ok = false;
+    int maximumItemCount = qEnvironmentVariableIntValue("DOLPHIN_BENCHMARK_MAX_ITEMS", &ok);
+    if (!ok) {
+        maximumItemCount = DefaultMaximumItemCount;
+    }
+
+    const QList<QPair<KStandardItemListView::ItemLayout, const char*> > layouts = {
+        qMakePair(KStandardItemListView::IconsLayout, "icons"),
+        qMakePair(KStandardItemListView::CompactLayout, "compact"),
+        qMakePair(KStandardItemListView::DetailsLayout, "details")
+    };
+
+    foreach (const auto& layout, layouts) {
+        for (int itemCount = 1000; itemCount <= maximumItemCount; itemCount *= 10) {
+            const QByteArray name = QByteArray(layout.second) + "--n=" + QByteArray::number(itemCount);
+            QTest::newRow(name.constData()) << layout.first << itemCount;
+        }
+    }
+}
+
+KFileItemList KItemListViewBenchmark::createFileItems(int count, int step, const QString& suffix)
+{
+    static const QStringList extensions = {
+        QStringLiteral("txt"), QStringLiteral("jpg"), QStringLiteral("pdf"), QStringLiteral("cpp")
+    };
+
+    KFileItemList items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const int number = i * step;
+        const QString name = QStringLiteral("File ") + QString::number(number) + suffix
+                           + QLatin1Char('.') + extensions.at(number % extensions.count());
+
+        // Items with a complete UDSEntry don't access the file system
+        KIO::UDSEntry entry;
+        entry.fastInsert(KIO::UDSEntry::UDS_NAME, name);
+        entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, 0100000);    // S_IFREG might not be defined on non-Unix platforms.
+        entry.fastInsert(KIO::UDSEntry::UDS_ACCESS, 0644);
+        entry.fastInsert(KIO::UDSEntry::UDS_SIZE, number * 1024);
+        entry.fastInsert(KIO::UDSEntry::UDS_MODIFICATION_TIME, 1500000000 + number);
+        items.append(KFileItem(entry, DirectoryUrl, false, true));
+    }
+    return items;
+}
+
+void KItemListViewBenchmark::addItems(KFileItemModel* model, const KFileItemList& items)
+{
+    model->slotItemsAdded(DirectoryUrl, items);
+    model->slotCompleted();
+}
+
+KItemListContainer* KItemListViewBenchmark::createContainer(KFileItemModel* model, DolphinItemListView* view,
+                                                            KStandardItemListView::ItemLayout layout)
+{
+    const QList<QByteArray> visibleRoles = (layout == KStandardItemListView::DetailsLayout)
+                                         ? QList<QByteArray>({"text", "size", "modificationtime", "type"})
+                                         : QList<QByteArray>({"text"});
+
+    QSet<QByteArray> roles = model->roles();
+    foreach (const QByteArray& role, visibleRoles) {
+        roles.insert(role);
+    }
+    model->setRoles(roles);
+
+    view->setItemLayout(layout);
+    view->setVisibleRoles(visibleRoles);
+
+    KItemListController* controller = new KItemListController(model, view);
+    KItemListContainer* container = new KItemListContainer(controller);
+    container->resize(ViewSize);
+    return container;
+}
+
+void KItemListViewBenchmark::paint(KItemListContainer* container)
+{
+    QGraphicsView* graphicsView = static_cast<QGraphicsView*>(container->viewport());
+    graphicsView->viewport()->repaint();
+}
+
+void KItemListViewBenchmark::setResult(qint64 nanoseconds, int count)
+{
+    QTest::setBenchmarkResult(nanoseconds / 1000000.0 / qMax(1, count), QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(KItemListViewBenchmark)
+
+#include "kitemlistviewbenchmark.moc"
@@ -66,9 +66,33 @@
 #include <QPixmapCache>
 #include <QPointer>
 #include <QScrollBar>
+#include <QThread>
 #include <QTimer>
+#include <QtConcurrentRun>
 #include <QVBoxLayout>
 
+namespace {
+    // Minimum number of items that are matched by one thread in DolphinView::selectItems()
+    const int MinItemsPerPatternMatchingChunk = 5000;
+
+    /**
+     * @return Indexes of the items from \a first to \a last of \a model whose
+     *         names match \a pattern. Is invoked by DolphinView::selectItems() in
+     *         worker threads; \a pattern is passed by value, as QRegExp
+     *         must not be shared between threads.
+     */
+    KItemSet matchingItems(const KFileItemModel* model, QRegExp pattern, int first, int last)
+    {
+        KItemSet indexes;
+        for (int index = first; index <= last; ++index) {
+            if (pattern.exactMatch(model->fileItem(index).text())) {
+                indexes << index;
+            }
+        }
+        return indexes;
+    }
+}
+
 DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
     QWidget(parent),
     m_active(true),
@@ -86,6 +110,11 @@ DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
     m_container(nullptr),
     m_toolTipManager(nullptr),
     m_selectionChangedTimer(nullptr),
+    m_statisticsSelection(),
+    m_selectedFileCount(0),
+    m_selectedFolderCount(0),
+    m_selectedFilesSize(0),
+    m_selectionStatisticsValid(false),
     m_currentItemUrl(),
     m_scrollToCurrentItem(false),
     m_restoredContentsPosition(),
@@ -112,8 +141,17 @@ DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
             this, &DolphinView::emitSelectionChangedSignal);
 
     m_model = new KFileItemModel(this);
+
+    // The selection manager adjusts the selection if items get inserted, removed or moved.
+    // The connections must be done before the controller is created to invalidate the
+    // selection statistics before the adjusted selection is reported by slotSelectionChanged().
+    connect(m_model, &KFileItemModel::itemsInserted, this, &DolphinView::invalidateSelectionStatistics);
+    connect(m_model, &KFileItemModel::itemsRemoved, this, &DolphinView::invalidateSelectionStatistics);
+    connect(m_model, &KFileItemModel::itemsMoved, this, &DolphinView::invalidateSelectionStatistics);
+
     m_view = new DolphinItemListView();
     m_view->setEnabledSelectionToggles(GeneralSettings::showSelectionToggle());
+    m_view->setCachedItemPainting(GeneralSettings::cachedItemPainting());
     m_view->setVisibleRoles({"text"});
     applyModeToView();
 
@@ -121,9 +159,10 @@ DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
     const int delay = GeneralSettings::autoExpandFolders() ? 750 : -1;
     controller->setAutoActivationDelay(delay);
 
-    // The EnlargeSmallPreviews setting can only be changed after the model
-    // has been set in the view by KItemListController.
+    // The EnlargeSmallPreviews and PreviewMemoryBudget settings can only be
+    // changed after the model has been set in the view by KItemListController.
     m_view->setEnlargeSmallPreviews(GeneralSettings::enlargeSmallPreviews());
+    m_view->setPreviewMemoryBudget(qint64(GeneralSettings::previewMemoryBudget()) * 1024 * 1024);
 
     m_container = new KItemListContainer(controller, this);
     m_container->installEventFilter(this);
@@ -169,6 +208,8 @@ DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
             this, &DolphinView::slotVisibleRolesChangedByHeader);
     connect(m_view, &DolphinItemListView::roleEditingCanceled,
             this, &DolphinView::slotRoleEditingCanceled);
+    connect(m_view, &DolphinItemListView::previewMemoryUsageChanged,
+            this, &DolphinView::previewMemoryUsageChanged);
     connect(m_view->header(), &KItemListHeader::columnWidthChangeFinished,
             this, &DolphinView::slotHeaderColumnWidthChangeFinished);
 
@@ -272,6 +313,11 @@ bool DolphinView::previewsShown() const
     return m_view->previewsShown();
 }
 
+qint64 DolphinView::previewMemoryUsage() const
+{
+    return m_view->previewMemoryUsage();
+}
+
 void DolphinView::setHiddenFilesShown(bool show)
 {
     if (m_model->showHiddenFiles() == show) {
@@ -369,16 +415,24 @@ void DolphinView::selectItems(const QRegExp& pattern, bool enabled)
                                                         : KItemListSelectionManager::Deselect;
     KItemListSelectionManager* selectionManager = m_container->controller()->selectionManager();
 
-    for (int index = 0; index < m_model->count(); index++) {
-        const KFileItem item = m_model->fileItem(index);
-        if (pattern.exactMatch(item.text())) {
-            // An alternative approach would be to store the matching items in a KItemSet and
-            // select them in one go after the loop, but we'd need a new function
-            // KItemListSelectionManager::setSelected(KItemSet, SelectionMode mode)
-            // for that.
-            selectionManager->setSelected(index, 1, mode);
-        }
+    // Match the names in chunks in parallel. The model is not changed while
+    // waiting for the results, so it is safe to read it from the worker threads.
+    const int itemCount = m_model->count();
+    const int chunkCount = qBound(1, itemCount / MinItemsPerPatternMatchingChunk, QThread::idealThreadCount());
+    const int chunkSize = (itemCount + chunkCount - 1) / qMax(1, chunkCount);
+
+    QList<QFuture<KItemSet> > futures;
+    for (int first = 0; first < itemCount; first += chunkSize) {
+        const int last = qMin(first + chunkSize, itemCount) - 1;
+        futures.append(QtConcurrent::run(matchingItems, m_model, pattern, first, last));
+    }
+
+    KItemSet matchingIndexes;
+    foreach (const QFuture<KItemSet>& future, futures) {
+        matchingIndexes = matchingIndexes + future.result();
     }
+
+    selectionManager->setSelected(matchingIndexes, mode);
 }
 
 void DolphinView::setZoomLevel(int level)
@@ -470,6 +524,7 @@ void DolphinView::readSettings()
 
     GeneralSettings::self()->load();
     m_view->readSettings();
+    m_view->setPreviewMemoryBudget(qint64(GeneralSettings::previewMemoryBudget()) * 1024 * 1024);
     applyViewProperties();
 
     const int delay = GeneralSettings::autoExpandFolders() ? 750 : -1;
@@ -517,21 +572,14 @@ QString DolphinView::statusBarText() const
     int fileCount = 0;
     KIO::filesize_t totalFileSize = 0;
 
-    if (m_container->controller()->selectionManager()->hasSelection()) {
+    const KItemListSelectionManager* selectionManager = m_container->controller()->selectionManager();
+    if (selectionManager->hasSelection()) {
         // Give a summary of the status of the selected files
-        const KFileItemList list = selectedItems();
-        foreach (const KFileItem& item, list) {
-            if (item.isDir()) {
-                ++folderCount;
-            } else {
-                ++fileCount;
-                totalFileSize += item.size();
-            }
-        }
+        calculateSelectedItemCount(fileCount, folderCount, totalFileSize);
 
         if (folderCount + fileCount == 1) {
             // If only one item is selected, show info about it
-            return list.first().getStatusBarInfo();
+            return m_model->fileItem(selectionManager->selectedItems().first()).getStatusBarInfo();
         } else {
             // At least 2 items are selected
             foldersText = i18ncp("@info:status", "1 Folder selected", "%1 Folders selected", folderCount);
@@ -1165,6 +1213,21 @@ void DolphinView::slotSelectionChanged(const KItemSet& current, const KItemSet&
     // be emitted asynchronously as fast as possible to update the edit-actions.
     m_selectionChangedTimer->setInterval(selectionStateChanged ? 0 : 300);
     m_selectionChangedTimer->start();
+
+    if (m_selectionStatisticsValid) {
+        // Only the items that got selected or deselected must be taken into account
+        const KItemSet changedItems = current ^ m_statisticsSelection;
+        for (KItemSet::const_iterator it = changedItems.begin(); it != changedItems.end(); ++it) {
+            const int index = *it;
+            updateSelectionStatistics(index, current.contains(index) ? 1 : -1);
+        }
+        m_statisticsSelection = current;
+    }
+}
+
+void DolphinView::invalidateSelectionStatistics()
+{
+    m_selectionStatisticsValid = false;
 }
 
 void DolphinView::emitSelectionChangedSignal()
@@ -1427,14 +1490,40 @@ void DolphinView::calculateItemCount(int& fileCount,
                                      int& folderCount,
                                      KIO::filesize_t& totalFileSize) const
 {
-    const int itemCount = m_model->count();
-    for (int i = 0; i < itemCount; ++i) {
-        const KFileItem item = m_model->fileItem(i);
-        if (item.isDir()) {
-            ++folderCount;
+    m_model->itemStatistics(fileCount, folderCount, totalFileSize);
+}
+
+void DolphinView::calculateSelectedItemCount(int& fileCount,
+                                             int& folderCount,
+                                             KIO::filesize_t& totalFileSize) const
+{
+    if (!m_selectionStatisticsValid) {
+        m_statisticsSelection = m_container->controller()->selectionManager()->selectedItems();
+        m_selectedFileCount = 0;
+        m_selectedFolderCount = 0;
+        m_selectedFilesSize = 0;
+        for (KItemSet::const_iterator it = m_statisticsSelection.begin(); it != m_statisticsSelection.end(); ++it) {
+            updateSelectionStatistics(*it, 1);
+        }
+        m_selectionStatisticsValid = true;
+    }
+
+    fileCount = m_selectedFileCount;
+    folderCount = m_selectedFolderCount;
+    totalFileSize = m_selectedFilesSize;
+}
+
+void DolphinView::updateSelectionStatistics(int index, int sign) const
+{
+    const KFileItem item = m_model->fileItem(index);
+    if (item.isDir()) {
+        m_selectedFolderCount += sign;
+    } else {
+        m_selectedFileCount += sign;
+        if (sign > 0) {
+            m_selectedFilesSize += item.size();
         } else {
-            ++fileCount;
-            totalFileSize += item.size();
+            m_selectedFilesSize -= item.size();
         }
     }
 }
@@ -1512,9 +1601,24 @@ void DolphinView::slotDirectoryLoadingCompleted()
     updateWritableState();
 }
 
-void DolphinView::slotItemsChanged()
+void DolphinView::slotItemsChanged(const KItemRangeList& itemRanges)
 {
     m_assureVisibleCurrentIndex = false;
+
+    if (m_selectionStatisticsValid) {
+        // The previous state of a changed item is not known anymore. Recalculate the
+        // selection statistics if a selected item has been changed. The changed roles
+        // cannot be used to skip this: The "size" role is only reported if it is
+        // shown, but the size of the file item is used for the statistics anyway.
+        foreach (const KItemRange& range, itemRanges) {
+            for (int index = range.index; index < range.index + range.count; ++index) {
+                if (m_statisticsSelection.contains(index)) {
+                    invalidateSelectionStatistics();
+                    return;
+                }
+            }
+        }
+    }
 }
 
 void DolphinView::slotSortOrderChangedByHeader(Qt::SortOrder current, Qt::SortOrder previous)
@@ -23,6 +23,7 @@
 
 #include "dolphintabwidget.h"
 #include "dolphin_export.h"
+#include "kitemviews/kitemset.h"
 
 #include <KFileItem>
 #include <KIO/Job>
@@ -40,7 +41,6 @@ class DolphinItemListView;
 class KFileItemModel;
 class KItemListContainer;
 class KItemModelBase;
-class KItemSet;
 class ToolTipManager;
 class VersionControlObserver;
 class ViewProperties;
@@ -128,6 +128,12 @@ public:
     void setPreviewsShown(bool show);
     bool previewsShown() const;
 
+    /**
+     * @return Memory in bytes that is used by the previews of the view
+     *         and by the cache of the previews.
+     */
+    qint64 previewMemoryUsage() const;
+
     /**
      * Shows all hidden files of the current directory,
      * if \a show is true.
@@ -412,6 +418,9 @@ signals:
     /** Is emitted if the 'show preview' property has been changed. */
     void previewsShownChanged(bool shown);
 
+    /** Is emitted if the result of previewMemoryUsage() has been changed. */
+    void previewMemoryUsageChanged();
+
     /** Is emitted if the 'show hidden files' property has been changed. */
     void hiddenFilesShownChanged(bool shown);
 
@@ -598,6 +607,13 @@ private slots:
      */
     void slotSelectionChanged(const KItemSet& current, const KItemSet& previous);
 
+    /**
+     * Is invoked if items of the model have been inserted, removed or moved.
+     * The indexes of the selection statistics are not valid anymore in this
+     * case and the statistics get recalculated on demand.
+     */
+    void invalidateSelectionStatistics();
+
     /**
      * Is called by emitDelayedSelectionChangedSignal() and emits the
      * signal \a selectionChanged() with all selected file items as parameter.
@@ -654,7 +670,7 @@ private slots:
     /**
      * Is invoked when items of KFileItemModel have been changed.
      */
-    void slotItemsChanged();
+    void slotItemsChanged(const KItemRangeList& itemRanges);
 
     /**
      * Is invoked when the sort order has been changed by the user by clicking
@@ -709,6 +725,21 @@ private slots:
      */
     void calculateItemCount(int& fileCount, int& folderCount, KIO::filesize_t& totalFileSize) const;
 
+    /**
+     * Calculates the number of selected files into \a fileCount, the number
+     * of selected folders into \a folderCount and the size of the selected files
+     * into \a totalFileSize. The statistics are updated incrementally by
+     * slotSelectionChanged() and only recalculated completely if the items
+     * of the model have been changed.
+     */
+    void calculateSelectedItemCount(int& fileCount, int& folderCount, KIO::filesize_t& totalFileSize) const;
+
+    /**
+     * Adds the item with the index \a index to the selection statistics
+     * if \a sign is 1, or removes it from the statistics if \a sign is -1.
+     */
+    void updateSelectionStatistics(int index, int sign) const;
+
     void slotTwoClicksRenamingTimerTimeout();
 
 private:
@@ -800,6 +831,14 @@ private:
 
     QTimer* m_selectionChangedTimer;
 
+    // Statistics of the selected items, see calculateSelectedItemCount().
+    // m_statisticsSelection contains the indexes the statistics are based on.
+    mutable KItemSet m_statisticsSelection;
+    mutable int m_selectedFileCount;
+    mutable int m_selectedFolderCount;
+    mutable KIO::filesize_t m_selectedFilesSize;
+    mutable bool m_selectionStatisticsValid;
+
     QUrl m_currentItemUrl; // Used for making the view to remember the current URL after F5
     bool m_scrollToCurrentItem; // Used for marking we need to scroll to current item or not
     QPoint m_restoredContentsPosition;
@@ -816,6 +855,7 @@ private:
     // For unit tests
     friend class TestBase;
     friend class DolphinDetailsViewTest;
+    friend class DolphinViewTest;
     friend class DolphinPart;                   // Accesses m_model
 };
 
@@ -190,6 +190,10 @@ void VersionControlObserver::slotThreadFinished()
         return;
     }
 
+    // Apply all versions at once, so that the view gets only one
+    // notification about the changed items.
+    QMap<int, QHash<QByteArray, QVariant> > values;
+
     const QMap<QString, QVector<ItemState> >& itemStates = thread->itemStates();
     QMap<QString, QVector<ItemState> >::const_iterator it = itemStates.constBegin();
     for (; it != itemStates.constEnd(); ++it) {
@@ -198,12 +202,15 @@ void VersionControlObserver::slotThreadFinished()
         foreach (const ItemState& item, items) {
             const KFileItem& fileItem = item.first;
             const KVersionControlPlugin::ItemVersion version = item.second;
-            QHash<QByteArray, QVariant> values;
-            values.insert("version", QVariant(version));
-            m_model->setData(m_model->index(fileItem), values);
+            const int index = m_model->index(fileItem);
+            if (index >= 0) {
+                values[index].insert("version", QVariant(version));
+            }
         }
     }
 
+    m_model->setData(values);
+
     if (!m_silentUpdate) {
         // Using an empty message results in clearing the previously shown information message and showing
         // the default status bar information. This is useful as the user already gets feedback that the